@@ -5,6 +5,17 @@
 void costRun();
 void costStop();
 
+// Suspend COST for a host command that uses the YARC. COST resumes
+// by itself after the host has left the YARC alone for a while.
+void costPreempt();
+
+// Free the COST test data for a command that needs the scratch arena.
+// The current test starts over when the tests next run.
+void costDropTestData();
+
+// Format the COST results table for the host. Returns the byte count.
+int costGetResults(byte *bp, int bmax);
+
 namespace CostPrivate {
   void flagsInit(void);
   bool flagsTest(void);
@@ -9,9 +9,10 @@
 //
 // Each test ("xyz") may define a distinct xyzTestData structure for its
 // data. The contents are preserved across calls while the Test is running.
-// The multiple per-test structs are contained in an anonymous union that
-// is tagged with the running Test. Running tests have complete ownership
-// of all YARC resources and may assume that nothing else will interfere.
+// The multiple per-test structs are contained in a union that is tagged
+// with the running Test and allocated in the scratch arena while the tests
+// are running. A running test may assume that nothing else changes the
+// YARC state it writes between its calls, except as described below.
 //
 // A single call to all the tests is a test cycle. The COST executive runs
 // a test cycle every few seconds (currently one cycle ever 6 seconds).
@@ -32,6 +33,34 @@
 // per cycle, typically when it completes or fails. Tests don't need to
 // worry about overrunning the log if they follow this rule because the
 // executive will not call them "too often".
+//
+// Every test also has an entry in a results table that is maintained by
+// the executive and can be fetched by the host in a single binary response
+// (see costGetResults() at the bottom of this file). Tests that don't panic
+// must call recordFailure() where they detect a failure; all tests should
+// call recordCoverage() to account for the YARC storage they exercised.
+//
+// COST may be preempted by host commands that use the YARC. Since the
+// tasks are cooperative, a command always runs between two calls to a
+// test, i.e. at a test step boundary. The serial task calls costPreempt()
+// before such a command; the executive saves the MCR and makes the YARC
+// safe (which also returns K to the idle word), then suspends the tests
+// until the host has left the YARC alone for a while. On resume it
+// restores the MCR and continues the current test where it left off,
+// unless a command needed the test data's part of the scratch arena (see
+// small_tasks.h). Then the data was dropped and the test starts over.
+//
+// The Tests[] table records what each test writes. The general registers
+// and flags are saved when a test that writes them starts, and restored
+// when it completes and when it's suspended, so the host sees its own
+// values. The stores (WCS, memory, ALU RAM) are too big to save, so a
+// test that writes a store holding the image the host recorded (see
+// PortSaveImage()) doesn't start, or resume, until the image bit is
+// cleared (e.g. the host writes the store). COST waits meanwhile; stop it
+// to keep a downloaded program. Tests whose progress depends on the
+// content of a store (e.g. a memory pattern) are marked to be restarted
+// from their init function on resume, since the host may have written
+// the store.
 
 #define COST 1
 
@@ -44,7 +73,7 @@ namespace CostPrivate {
   constexpr byte aluChunkSize = 17;
   constexpr short CHUNK_WORDS = (CHUNK_SIZE / sizeof(unsigned int));
 
-  static union {
+  union TestData {
     struct delayData {
       long int delay;      
     } delayData;
@@ -102,8 +131,30 @@ namespace CostPrivate {
       byte callLoc;
       byte state;
     } memCleanData;
+    struct aluExecData {
+      ushort words[CHUNK_WORDS];
+      ushort seed;      // first B operand and the operations are derived from it
+      ushort a0;        // first A operand, incremented by the YARC
+      byte carry;       // carry into the next instruction to run or verify
+      byte chunk;
+      byte state;
+    } aluExecData;
   };
 
+  static_assert(sizeof(TestData) <= SCRATCH_TEST_BYTES, "COST test data exceeds scratch budget");
+
+  // The test data is allocated in the scratch arena (see small_tasks.h)
+  // by the executive while the tests are running. It's dropped when they
+  // stop, and whenever a command needs its space (see costDropTestData()).
+  TestData *td = 0;
+
+  void dropTestData() {
+    if (td != 0) {
+      ScratchRelease(SCRATCH_TEST, 0);
+      td = 0;
+    }
+  }
+
   typedef void (*TestInit)();
   typedef bool (*Test)();
 
@@ -127,24 +178,43 @@ namespace CostPrivate {
   bool writeCheckALUTest(void);
   void memCleanInit(void);
   bool memCleanBody(void);
+  void aluExecInit(void);
+  bool aluExecTest(void);
+
+  // What to do with the current test when resuming after preemption
+  constexpr byte PREEMPT_RESUME = 0;  // call the test body again
+  constexpr byte PREEMPT_RESTART = 1; // call the test init function again
+
+  // What a test writes. A test doesn't run while a store it writes holds
+  // the host's image (see writesImage(), below). The registers and
+  // flags are saved and restored by the executive, which uses scratch
+  // memory to read the registers, so tests that write them also write
+  // memory. The ALU RAM writers load the address into R0 and R1.
+  constexpr byte WR_WCS = 1 << STORE_WCS;
+  constexpr byte WR_MEM = 1 << STORE_MEM;
+  constexpr byte WR_ALU = 1 << STORE_ALU;
+  constexpr byte WR_REGS = 0x80; // R0..R3 and the flags
 
   typedef struct tr {
     TestInit init;
     Test test;
     const char* name;
+    byte preempt;
+    byte writes;
   } TestRef;
 
   const PROGMEM TestRef Tests[] = {
-    { delayTaskInit,     delayTaskBody,     "delay"     },
-    { m16TestInit,       m16TestBody,       "mem16"     },
-    { regTestInit,       regTestBody,       "reg"       },
-    { ucodeTestInit,     ucodeBasicTest,    "ucode"     },
-    { memBasicTestInit,  memBasicTest,      "membasic"  },
-    { memHammerInit,     memHammerTest,     "memhammer" },
-    { flagsInit,         flagsTest,         "flags"     },
-    { aluRamInit,        aluRamTest,        "alu"       },
-    { writeCheckALUInit, writeCheckALUTest, "wrALU"     },
-    { memCleanInit,      memCleanBody,      "memclean"  }  
+    { delayTaskInit,     delayTaskBody,     "delay",     PREEMPT_RESUME,  0                          },
+    { m16TestInit,       m16TestBody,       "mem16",     PREEMPT_RESUME,  WR_MEM                     },
+    { regTestInit,       regTestBody,       "reg",       PREEMPT_RESUME,  WR_MEM | WR_REGS           },
+    { ucodeTestInit,     ucodeBasicTest,    "ucode",     PREEMPT_RESUME,  WR_WCS                     },
+    { memBasicTestInit,  memBasicTest,      "membasic",  PREEMPT_RESUME,  WR_MEM                     },
+    { memHammerInit,     memHammerTest,     "memhammer", PREEMPT_RESUME,  WR_MEM                     },
+    { flagsInit,         flagsTest,         "flags",     PREEMPT_RESUME,  WR_MEM | WR_REGS           },
+    { aluRamInit,        aluRamTest,        "alu",       PREEMPT_RESUME,  WR_MEM | WR_ALU | WR_REGS  },
+    { writeCheckALUInit, writeCheckALUTest, "wrALU",     PREEMPT_RESUME,  WR_MEM | WR_ALU | WR_REGS  },
+    { aluExecInit,       aluExecTest,       "aluexec",   PREEMPT_RESTART, WR_MEM | WR_ALU | WR_REGS  },
+    { memCleanInit,      memCleanBody,      "memclean",  PREEMPT_RESTART, WR_MEM                     }
    };
 
   constexpr byte N_TESTS = (sizeof(Tests) / sizeof(TestRef));
@@ -152,26 +222,173 @@ namespace CostPrivate {
   byte currentTestId = 0;
   byte lastTestId = 0;
 
+  // The results table. Unlike the union above, entries persist across
+  // tests and test cycles; they are cleared only by a Nano reset. The
+  // executive maintains the counts and durations. The failure details
+  // are test-specific and are set by recordFailure(), below.
+
+  typedef struct testResult {
+    ushort passCount;
+    ushort failCount;
+    ushort lastRunMillis;       // duration of the most recent run
+    ushort lastFailDetail;      // test-specific, often an address
+    byte lastFailCode;          // test-specific, often a location
+    unsigned long bytesCovered; // cumulative bytes of YARC storage tested
+  } TestResult;
+
+  TestResult results[N_TESTS];
+
+  // The values the failure messages log. Messages are formatted when the
+  // host polls, and by then the test data may have been dropped for a
+  // command (see costDropTestData()), so a test copies what it logs here,
+  // next to the results table, before it queues the message.
+
+  constexpr byte ALU_RAM_LOGGED = 7; // bytes of the ALU RAM chunk logged
+
+  union LogData {
+    TestData::memory16Data m16Data;
+    TestData::registerBasicData regData;
+    TestData::memoryBasicData mbData; // reused by memHammer test
+    struct TestData::flagsData flagsData;
+    struct {
+      byte opcode;
+      byte slice;
+      byte failOffset;
+      byte data;
+    } ubData;
+    struct {
+      byte data[ALU_RAM_LOGGED];
+      byte readback[ALU_RAM_LOGGED];
+      ushort address;
+      byte ram;
+      byte b0;
+      byte b1;
+      byte b2;
+    } aluRamData;
+    struct {
+      ushort data;
+      ushort writeAt;
+      ushort readAt;
+      ushort readValue;
+      byte callLoc;
+      byte state;
+    } memCleanData;
+    struct {
+      ushort a;
+      ushort b;
+      ushort got;
+      ushort expected;
+      byte fn;
+      byte carry;
+      byte gotFlags;
+      byte expectedFlags;
+    } aluExecData;
+  } logData;
+
+  bool currentTestFailed = false;
+  unsigned long currentTestStart = 0;
+  ushort cycleCount = 0;
+
+  // Record a failure of the running test. Only the most recent
+  // failure detail is retained.
+  void recordFailure(byte code, ushort detail) {
+    currentTestFailed = true;
+    results[currentTestId].lastFailCode = code;
+    results[currentTestId].lastFailDetail = detail;
+  }
+
+  // Account for nBytes of YARC storage exercised by the running test.
+  inline void recordCoverage(ushort nBytes) {
+    results[currentTestId].bytesCovered += nBytes;
+  }
+
+  // Return true if a store the current test writes holds the image the
+  // host recorded. Many tests write with their own bus cycles or by
+  // running the YARC, which the store writers in yarc_utils.h can't see,
+  // so the executive keeps the test from running instead.
+  bool writesImage() {
+    const byte writes = pgm_read_byte_near(&Tests[currentTestId].writes);
+    for (byte store = 0; store < N_STORES; ++store) {
+      if ((writes & (1 << store)) && (PortInitStatus() & (INIT_WCS_IMAGE << store))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The registers and flags saved for the current test, if it writes them
+  ushort savedRegs[4];
+  byte savedFlags;
+  bool regsSaved = false;
+
+  void saveRegs() {
+    regsSaved = false;
+    if ((pgm_read_byte_near(&Tests[currentTestId].writes) & WR_REGS) == 0) {
+      return;
+    }
+    savedFlags = ReadFlags() & 0x0F;
+    for (byte reg = 0; reg < 4; ++reg) {
+      savedRegs[reg] = ReadReg(reg, SCRATCH_MEM);
+    }
+    regsSaved = true;
+  }
+
+  // WriteFlags() uses R3, so the registers are written after it.
+  void restoreRegs() {
+    if (!regsSaved) {
+      return;
+    }
+    MakeSafe();
+    WriteFlags(savedFlags);
+    for (byte reg = 0; reg < 4; ++reg) {
+      WriteReg(reg, savedRegs[reg]);
+    }
+    regsSaved = false;
+  }
+
+  // Called by the executive when the running test returns false.
+  void recordCompletion() {
+    TestResult* const tr = &results[currentTestId];
+    if (currentTestFailed) {
+      tr->failCount++;
+    } else {
+      tr->passCount++;
+    }
+    tr->lastRunMillis = millis() - currentTestStart;
+  }
+
   // General note about logging: there is a (necessary) issue throughout
   // the Nano firmware caused by the design of the logger. To conserve
   // memory, there is just a single line buffer, and the message isn't
   // formatted until it's about to sent to the host (Mac). There is no
   // dynamic heap so no easy way to "close" over the value of a variable
-  // to be logged. And the tests here share memory through the anonymous
-  // union above. So test "N+1" tends to change the value of the variables
-  // that test "N" wanted to log before the old values get formatted into
-  // the log buffer. Here in the COST tests only, we address this by
-  // tracking the number of log messages *we* enqueue and not running the
-  // "next" test in a test cycle until that number drops to 0. The max
-  // value of queued messages is 2 because of the "test cycle starting"
-  // message just below, but it doesn't rely on the value of any variable.
+  // to be logged. The tests copy the values they log into logData (above)
+  // because the test data may be dropped, but all the tests share logData.
+  // So test "N+1" tends to change the values that test "N" wanted to log
+  // before the old values get formatted into the log buffer. Here in the
+  // COST tests only, we address this by tracking the number of log
+  // messages *we* enqueue and not running the "next" test in a test cycle
+  // until that number drops to 0. The max value of queued messages is 2
+  // because of the "test cycle starting" message just below, but it
+  // doesn't rely on the value of any variable.
   //
-  // N.B. - this means the tests will come to a halt unless the the host
-  // program is runnning to soak up the log messages, because the serial
-  // task doesn't invoke the log callbacks unless it's connected. 
+  // Originally this meant the tests came to a halt unless the host program
+  // was running to soak up the log messages. Now messages are queued only
+  // while a host is connected, and the executive only waits for them while
+  // a host is connected. The failure details that matter are kept in the
+  // results table whether or not they are logged.
 
   int queuedLogMessageCount = 0;
 
+  // Queue a log callback if there is a host to receive it. The
+  // callback must decrement queuedLogMessageCount.
+  void queueLog(logCallback callback) {
+    if (SerialIsConnected()) {
+      queuedLogMessageCount++;
+      logQueueCallback(callback);
+    }
+  }
+
   // Callback for the executive's single log line per cycle
   int testCycleStarting(char* bp, int bmax) {
     int result = snprintf_P(bp, bmax, PSTR("cost: test cycle starting"));
@@ -199,46 +416,126 @@ namespace CostPrivate {
     return result;
   }
 
+  // Preemption state. The tests are suspended from the first preempting
+  // command until RESUME_QUIET_MILLIS after the most recent one.
+  constexpr unsigned long RESUME_QUIET_MILLIS = 500;
+  bool suspended = false;
+  unsigned long suspendStart = 0;
+  unsigned long lastPreemptMillis = 0;
+  byte savedMcr = 0;
+
+  void stopTests() {
+    queueLog(costTestsStopped);
+    MakeSafe();
+    running = false;
+    stopping = false;
+    suspended = false;
+    dropTestData();
+  }
+
+  void suspendTests() {
+    savedMcr = GetMCR();
+    suspendStart = millis();
+    suspended = true;
+    MakeSafe();
+    restoreRegs();
+  }
+
+  // Don't resume while the host has the YARC running or is clocking it,
+  // while there are trace entries (which may be in scratch memory), or
+  // while the test that was running writes a store holding an image.
+  bool canResume() {
+    return millis() - lastPreemptMillis >= RESUME_QUIET_MILLIS
+      && !IsYarcRun() && GetClockControl() == 0
+      && ClockBurstRemaining() == 0 && TracePending() == 0
+      && !(currentTestId < N_TESTS && lastTestId == currentTestId && writesImage());
+  }
+
+  void resumeTests() {
+    suspended = false;
+    currentTestStart += millis() - suspendStart; // don't charge the test
+    MakeSafe();
+
+    // If the current test has been initialized, the host may have changed
+    // what it writes in the meantime. It may need to start over. (If its
+    // data was dropped, it starts over when the data is allocated again.)
+    if (currentTestId < N_TESTS && lastTestId == currentTestId) {
+      saveRegs();
+      if (td != 0 && pgm_read_byte_near(&Tests[currentTestId].preempt) == PREEMPT_RESTART) {
+        const TestInit testInit = pgm_read_ptr_near(&Tests[currentTestId].init);
+        (*testInit)();
+      }
+    }
+    SetMCR(savedMcr);
+  }
+
   // The test executive
   int internalCostTask() {
     constexpr int TIMEOUT_HOST_NOT_POLLING = 43; // check about 24 times a second
     constexpr int TIMEOUT_NOT_RUNNING = 513; // check about twice a second
+    constexpr int TIMEOUT_SUSPENDED = 97;     // check about 10 times a second
     
     // Wait for all previously queued log messages to be formatted and sent
     // to the host. See the block comment above ("General note about...")
-    if (queuedLogMessageCount > 0) {
+    if (queuedLogMessageCount > 0 && SerialIsConnected()) {
       return TIMEOUT_HOST_NOT_POLLING;
     }
     
-    if (!running) {
+    if (!running || !PortIsReady()) {
       return TIMEOUT_NOT_RUNNING; // come back and check once or twice each second
     }
 
-    // COST tests are running
+    // COST tests are running, but may be suspended for the host
+    if (suspended) {
+      if (stopping) {
+        stopTests(); // the YARC was made safe when we were suspended
+        return TIMEOUT_NOT_RUNNING;
+      }
+      if (!canResume()) {
+        return TIMEOUT_SUSPENDED;
+      }
+      resumeTests();
+      return 0;
+    }
+
+    // Allocate the test data when the tests start, and again after it was
+    // dropped for a command. A test that had started then starts over.
+    if (td == 0) {
+      if (ScratchAvailable() < sizeof(TestData)) {
+        return TIMEOUT_SUSPENDED; // a command is still using the space
+      }
+      td = (TestData*) ScratchAlloc(SCRATCH_TEST, sizeof(TestData));
+      if (currentTestId < N_TESTS && lastTestId == currentTestId) {
+        const TestInit testInit = pgm_read_ptr_near(&Tests[currentTestId].init);
+        (*testInit)();
+      }
+      return 0;
+    }
 
     // Is a new test cycle starting? (Including first-time initialization)
     if (currentTestId >= N_TESTS) {
       currentTestId = 0;
+      cycleCount++;
       randomSeed(millis());
-      queuedLogMessageCount++;
-      logQueueCallback(testCycleStarting);
+      queueLog(testCycleStarting);
       return 0; // come back and check right away
     }
 
     // Is a new test starting within the current cycle?
     if (lastTestId != currentTestId) {
       if (stopping) {
-        logQueueCallback(costTestsStopped);
-        queuedLogMessageCount++;
-        MakeSafe();
-        running = false;
-        stopping = false;
+        stopTests();
         return TIMEOUT_NOT_RUNNING;
       }
-      queuedLogMessageCount++;
-      logQueueCallback(testStarting);
+      if (writesImage()) {
+        return TIMEOUT_SUSPENDED; // leave the host's image alone
+      }
+      queueLog(testStarting);
       lastTestId = currentTestId;
       MakeSafe(); // clean up YARC state for the next test
+      saveRegs();
+      currentTestFailed = false;
+      currentTestStart = millis();
       const TestInit testInit = pgm_read_ptr_near(&Tests[currentTestId].init);
       (*testInit)();
       return 0;
@@ -247,6 +544,8 @@ namespace CostPrivate {
     // Run the test function and move on to the next test if it returns false
     const Test test = pgm_read_ptr_near(&Tests[currentTestId].test);
     if (! (*test)()) {
+      restoreRegs();
+      recordCompletion();
       currentTestId++;
     }
     return 0;
@@ -261,9 +560,9 @@ namespace CostPrivate {
 
   int memCleanCallback(char* bp, int bmax) {
     int result = snprintf_P(bp, bmax, PSTR("  F memClean[%d %d]: wr 0x%04X @ 0x%04X rd 0x%04X @ 0x%04X"),
-                                            memCleanData.state, memCleanData.callLoc,
-                                            memCleanData.data[0], memCleanData.writeAt,
-                                            memCleanData.readValue, memCleanData.readAt);
+                                            logData.memCleanData.state, logData.memCleanData.callLoc,
+                                            logData.memCleanData.data, logData.memCleanData.writeAt,
+                                            logData.memCleanData.readValue, logData.memCleanData.readAt);
     if (result > bmax) result = bmax;
     queuedLogMessageCount--;
     return result;
@@ -271,12 +570,18 @@ namespace CostPrivate {
 
   // An error has occurred, queue a print callback with the specifics.
   void queueCallback(byte callLoc, ushort readAt, ushort readValue) {
-    memCleanData.errorCount++;
-    memCleanData.callLoc = callLoc;
-    memCleanData.readAt = readAt;
-    memCleanData.readValue = readValue;
-    queuedLogMessageCount++;
-    logQueueCallback(memCleanCallback);
+    td->memCleanData.errorCount++;
+    td->memCleanData.callLoc = callLoc;
+    td->memCleanData.readAt = readAt;
+    td->memCleanData.readValue = readValue;
+    recordFailure(callLoc, readAt);
+    logData.memCleanData.data = td->memCleanData.data[0];
+    logData.memCleanData.writeAt = td->memCleanData.writeAt;
+    logData.memCleanData.readAt = readAt;
+    logData.memCleanData.readValue = readValue;
+    logData.memCleanData.callLoc = callLoc;
+    logData.memCleanData.state = td->memCleanData.state;
+    queueLog(memCleanCallback);
   }
 
   // Check all of memory, allowing the exceptAddr to have a value that differs
@@ -285,20 +590,21 @@ namespace CostPrivate {
   bool memCheckAll(byte callLoc, ushort exceptAddr) {
     if (exceptAddr > END_MEM) exceptAddr = END_MEM;
 
-    ushort expected = memCleanData.data[0];
+    ushort expected = td->memCleanData.data[0];
     ushort addr;
     for (addr = 0; addr < END_MEM; addr += CHUNK_SIZE) {
-      ReadMem16(addr, memCleanData.readback, CHUNK_WORDS);
+      ReadMem16(addr, td->memCleanData.readback, CHUNK_WORDS);
       for (byte i = 0; i < CHUNK_WORDS; ++i) {
-        if (memCleanData.readback[i] != expected) {
-          if ((addr + (i<<1) == exceptAddr) && memCleanData.readback[i] == ~expected) {
+        if (td->memCleanData.readback[i] != expected) {
+          if ((addr + (i<<1) == exceptAddr) && td->memCleanData.readback[i] == ~expected) {
             // The one expected difference. I don't want to turn this test around...
           } else {
-            queueCallback(callLoc, addr + (i<<1), memCleanData.readback[i]);
+            queueCallback(callLoc, addr + (i<<1), td->memCleanData.readback[i]);
             return false;
           }
         }
       }
+      recordCoverage(CHUNK_SIZE);
     }
     return true;
   }
@@ -306,7 +612,7 @@ namespace CostPrivate {
   // In order to have a consistent state-based implementation that doesn't
   // run for too long on any call, all the code is in the body function.
   void memCleanInit() {
-    memCleanData.state = S_INIT_0;
+    td->memCleanData.state = S_INIT_0;
   }
 
   // Write one word to some location and then scan all of memory.
@@ -317,19 +623,20 @@ namespace CostPrivate {
   // here and terminate the serial session with the host. Any call
   // to memCheckAll() is a complete pass over memory.
   bool memCleanBody() {
-    switch (memCleanData.state) {
+    switch (td->memCleanData.state) {
       case S_INIT_0: {
-        memCleanData.errorCount = 0;
-        memCleanData.writeAt = 0;
+        td->memCleanData.errorCount = 0;
+        td->memCleanData.writeAt = 0;
         ushort writeVal = random();
         for (byte i = 0; i < CHUNK_WORDS; ++i) {
-          memCleanData.data[i] = writeVal;
+          td->memCleanData.data[i] = writeVal;
         }
         for (ushort addr = 0; addr < END_MEM; addr += CHUNK_SIZE) {
           SetDisplay(addr >> 8);
-          WriteMem16(addr, memCleanData.data, CHUNK_WORDS);
+          WriteMem16(addr, td->memCleanData.data, CHUNK_WORDS);
         }
-        memCleanData.state = S_INIT_1;
+        recordCoverage(END_MEM);
+        td->memCleanData.state = S_INIT_1;
         return true;
       }
       case S_INIT_1: {
@@ -339,32 +646,32 @@ namespace CostPrivate {
           return false;
         }
         SetDisplay(0);
-        memCleanData.state = S_RUN_0;
+        td->memCleanData.state = S_RUN_0;
         return true;
       }
       case S_RUN_0: {
-        memCleanData.writeAt += (random() & 0xFFE);
-        if (memCleanData.writeAt >= END_MEM) {
+        td->memCleanData.writeAt += (random() & 0xFFE);
+        if (td->memCleanData.writeAt >= END_MEM) {
           return false;
         }
         // Change a word, check all of memory excepting the changed word,
         // and then put the word back.
-        ushort alt = ~memCleanData.data[0];
-        WriteMem16(memCleanData.writeAt, &alt, 1);
-        memCheckAll(2, memCleanData.writeAt);    
-        WriteMem16(memCleanData.writeAt, memCleanData.data, 1);
-        memCleanData.state = S_RUN_1;
+        ushort alt = ~td->memCleanData.data[0];
+        WriteMem16(td->memCleanData.writeAt, &alt, 1);
+        memCheckAll(2, td->memCleanData.writeAt);    
+        WriteMem16(td->memCleanData.writeAt, td->memCleanData.data, 1);
+        td->memCleanData.state = S_RUN_1;
         return true;
       }
       case S_RUN_1: {
-        if (memCleanData.errorCount > 10) {
+        if (td->memCleanData.errorCount > 10) {
           return false;
         }
         if (stopping) {
           return false;
         }
-        SetDisplay(memCleanData.writeAt>>8);
-        memCleanData.state = S_RUN_0;
+        SetDisplay(td->memCleanData.writeAt>>8);
+        td->memCleanData.state = S_RUN_0;
         return true;
       }
       default:
@@ -387,17 +694,16 @@ namespace CostPrivate {
     constexpr long callsPerMillisecond = 25L; // estimate
     constexpr long delaySeconds = 1L;         // arbitrary
     constexpr long millisPerSecond = 1000L;    
-    delayData.delay = callsPerMillisecond * delaySeconds * millisPerSecond; 
+    td->delayData.delay = callsPerMillisecond * delaySeconds * millisPerSecond; 
   }
 
   bool delayTaskBody() {
-    if (delayData.delay < 0L) {
-      queuedLogMessageCount++;
-      logQueueCallback(delayTaskMessageCallback);
+    if (td->delayData.delay < 0L) {
+      queueLog(delayTaskMessageCallback);
       /* XXX */ if (millis() < 1) WriteFlags(0x01);
       return false; // done
     }
-    delayData.delay = delayData.delay - 1L;
+    td->delayData.delay = td->delayData.delay - 1L;
     return true; // not done
   }
 
@@ -405,7 +711,7 @@ namespace CostPrivate {
   int m16LowByteCallback(char* bp, int bmax) {
     int result = snprintf_P(bp, bmax,
       PSTR("  F m16 lo: A 0x%02X 0x%02X D 0x%02X 0x%02X got 0x%02X"),
-      m16Data.AH, m16Data.AL, m16Data.DH, m16Data.DL, m16Data.readValue);
+      logData.m16Data.AH, logData.m16Data.AL, logData.m16Data.DH, logData.m16Data.DL, logData.m16Data.readValue);
     if (result > bmax) result = bmax;
     queuedLogMessageCount--;
     return result;
@@ -414,53 +720,53 @@ namespace CostPrivate {
   int m16HighByteCallback(char* bp, int bmax) {
     int result = snprintf_P(bp, bmax,
       PSTR("  F m16 hi: A 0x%02X 0x%02X D 0x%02X 0x%02X got 0x%02X"),
-      m16Data.AH, m16Data.AL, m16Data.DH, m16Data.DL, m16Data.readValue);
+      logData.m16Data.AH, logData.m16Data.AL, logData.m16Data.DH, logData.m16Data.DL, logData.m16Data.readValue);
     if (result > bmax) result = bmax;
     queuedLogMessageCount--;
     return result;
   }
 
   void m16TestInit() {
-    m16Data.AH = 0x00;
-    m16Data.AL = 0x00;
-    m16Data.DH = random(0, 255);
-    m16Data.DL = random(0, 255);
+    td->m16Data.AH = 0x00;
+    td->m16Data.AL = 0x00;
+    td->m16Data.DH = random(0, 255);
+    td->m16Data.DL = random(0, 255);
   }
 
   // Write 256 bytes memory with 16-bit cycles. All
-  // arguments are passed through the anonymous union.
+  // arguments are passed through the test data union.
   void writeStep16() {
-    WriteK(0xFF, 0xFF, 0xFF, 0x3F);  // write memory, 16-bit access
+    WriteK(K_WRMEM16_FROM_NANO);  // write memory, 16-bit access
     SetMCR(McrEnableSysbus(MCR_SAFE)); // YARC/NANO# low, SYSBUS_EN# low
 
     do {
-      SetAH(m16Data.AH);
-      SetAL(m16Data.AL);
-      SetDH(m16Data.DH);
-      SetDL(m16Data.DL);
+      SetAH(td->m16Data.AH);
+      SetAL(td->m16Data.AL);
+      SetDH(td->m16Data.DH);
+      SetDL(td->m16Data.DL);
       SingleClock();
-      m16Data.AL += 2;       
-    } while (m16Data.AL != 0);
+      td->m16Data.AL += 2;       
+    } while (td->m16Data.AL != 0);
   }
 
   // Verify 256 bytes memory using 16-bit cycles. For each cycle, check
   // just the low-order 8 bits of the value. The Nano only has an
   // 8-bit bus read register (a holdover of the previous 8-bit design)
   // so it cannot see the high byte of a 16-bit read. All arguments
-  // are passed through the anonymous union.
+  // are passed through the test data union.
   bool readStep16() {
-    WriteK(0xFF, 0xFF, 0x9F, 0xBF); // read memory word (16-bit reads)      
+    WriteK(K_RDMEM16_TO_NANO); // read memory word (16-bit reads)      
     SetMCR(McrEnableSysbus(MCR_SAFE));
 
     do {
-      SetAH(m16Data.AH | 0x80); // 0x80 => read
-      SetAL(m16Data.AL);
+      SetAH(td->m16Data.AH | 0x80); // 0x80 => read
+      SetAL(td->m16Data.AL);
       SingleClock();
-      if ((m16Data.readValue = GetBIR()) != m16Data.DL) {
+      if ((td->m16Data.readValue = GetBIR()) != td->m16Data.DL) {
         return false; // just detect one failure
       }
-      m16Data.AL += 2;       
-    }  while (m16Data.AL != 0);
+      td->m16Data.AL += 2;       
+    }  while (td->m16Data.AL != 0);
     return true;   
   }
 
@@ -471,42 +777,45 @@ namespace CostPrivate {
   // triggering a byte transfer, which engagesthe "cross" transceiver to
   // return the high byte on the low-order bits of sysdata.
   bool readStep8() {
-    WriteK(0xFF, 0xFF, 0x9F, 0xFF); // read memory word (byte read)      
+    WriteK(K_RDMEM8_TO_NANO); // read memory word (byte read)      
     SetMCR(McrEnableSysbus(MCR_SAFE));
 
     do {
-      SetAH(m16Data.AH | 0x80); // 0x80 => read
-      SetAL(m16Data.AL | 0x01); // the high byte
+      SetAH(td->m16Data.AH | 0x80); // 0x80 => read
+      SetAL(td->m16Data.AL | 0x01); // the high byte
       SingleClock();
-      if ((m16Data.readValue = GetBIR()) != m16Data.DH) {
+      if ((td->m16Data.readValue = GetBIR()) != td->m16Data.DH) {
         return false; // just detect one failure
       }
-      m16Data.AL += 2;       
-    } while (m16Data.AL != 0);
+      td->m16Data.AL += 2;       
+    } while (td->m16Data.AL != 0);
     return true;
   }
 
   bool m16TestBody() {
-    if (m16Data.AH == 0x78) {
+    if (td->m16Data.AH == 0x78) {
       return false; // done
     }
 
     writeStep16();
     if (!readStep16()) {
-      queuedLogMessageCount++;
-      logQueueCallback(m16LowByteCallback);
+      recordFailure(1, BtoS(td->m16Data.AH, td->m16Data.AL));
+      logData.m16Data = td->m16Data;
+      queueLog(m16LowByteCallback);
       return false; // only detect 1 failure
     }
 
     if (!readStep8()) {
-      queuedLogMessageCount++;
-      logQueueCallback(m16HighByteCallback);
+      recordFailure(2, BtoS(td->m16Data.AH, td->m16Data.AL | 0x01));
+      logData.m16Data = td->m16Data;
+      queueLog(m16HighByteCallback);
       return false; // only detect 1 failure
     }
+    recordCoverage(256);
 
-    m16Data.AH++;
-    m16Data.DL += 7;
-    m16Data.DH += 17;
+    td->m16Data.AH++;
+    td->m16Data.DL += 7;
+    td->m16Data.DH += 17;
     
     return true; // not done  
   }
@@ -520,7 +829,7 @@ namespace CostPrivate {
   //  This function acts only on its arguments and the hardware,
   // so it's portable to other parts of the code.
   void Write16(unsigned int addr, unsigned int data) {
-    WriteK(0xFF, 0xFF, 0xFF, 0x3F);  // write memory, 16-bit access
+    WriteK(K_WRMEM16_FROM_NANO);  // write memory, 16-bit access
     SetADHL(StoHB(addr & 0x7F00), StoLB(addr), StoHB(data), StoLB(data));
     SingleClock();
   }
@@ -529,7 +838,7 @@ namespace CostPrivate {
   // Changes AH, AL, DH, DL. This function acts only on its arguments
   // and the hardware, so it's portable to other parts of the code.
   byte Read8(unsigned int addr, unsigned int noise) {
-    WriteK(0xFF, 0xFF, 0x9F, 0xFF); // read memory byte     
+    WriteK(K_RDMEM8_TO_NANO); // read memory byte     
     SetADHL(StoHB(addr | 0x8000), StoLB(addr), StoHB(noise), StoLB(noise));
     SetMCR(McrEnableSysbus(MCR_SAFE));
     SingleClock();
@@ -540,7 +849,7 @@ namespace CostPrivate {
   int regCallback(char* bp, int bmax) {
     int result = snprintf_P(bp, bmax,
       PSTR("  F reg: (%d): A 0x%02X 0x%02X D 0x%02X 0x%02X got 0x%02X save 0x%02X 0x%02X"),
-      regData.location, regData.AH, regData.AL, regData.DH, regData.DL, regData.readValue, regData.save_DH, regData.save_DL);
+      logData.regData.location, logData.regData.AH, logData.regData.AL, logData.regData.DH, logData.regData.DL, logData.regData.readValue, logData.regData.save_DH, logData.regData.save_DL);
     if (result > bmax) result = bmax;
     queuedLogMessageCount--;
     return result;
@@ -552,11 +861,12 @@ namespace CostPrivate {
   // Return true if OK and false if read doesn't match expected.
   // This function uses the regData union so it's not portable.
   bool check8(unsigned int addr, unsigned int noise, byte expected, byte loc) {
-    regData.readValue = Read8(addr, noise);
-    if (regData.readValue != expected) {
-      regData.location = loc;
-      queuedLogMessageCount++;
-      logQueueCallback(regCallback);
+    td->regData.readValue = Read8(addr, noise);
+    if (td->regData.readValue != expected) {
+      td->regData.location = loc;
+      recordFailure(loc, addr);
+      logData.regData = td->regData;
+      queueLog(regCallback);
       return false;
     }
     return true;
@@ -604,77 +914,80 @@ namespace CostPrivate {
       location = 13;
     }
     if (fail) {
-      regData.location = location;
-      regData.AH = regData.AL = regData.DH = regData.DL = regData.readValue = regData.save_DH = regData.save_DL = 0;
-      queuedLogMessageCount++;
-      logQueueCallback(regCallback);
+      td->regData.location = location;
+      td->regData.AH = td->regData.AL = td->regData.DH = td->regData.DL = td->regData.readValue = td->regData.save_DH = td->regData.save_DL = 0;
+      recordFailure(location, 0x7700);
+      logData.regData = td->regData;
+      queueLog(regCallback);
       return false;
     }
+    recordCoverage(sizeof(regs));
 
     // The rest of this test was the first effort I made to read and write
     // the registers. But it only used register R3 (0b11) so it failed to
     // to catch the swapped write address lines that eventually cost me a
     // week of troubleshooting.
     
-    regData.save_DH = random(0, 256);
-    regData.save_DL = random(0, 256);
-    regData.AH = 0;
-    regData.AL = 0x10;
-    regData.DH = regData.save_DH;
-    regData.DL = regData.save_DL;
+    td->regData.save_DH = random(0, 256);
+    td->regData.save_DL = random(0, 256);
+    td->regData.AH = 0;
+    td->regData.AL = 0x10;
+    td->regData.DH = td->regData.save_DH;
+    td->regData.DL = td->regData.save_DL;
 
     // (1) write the random values at 0x10 and 0x11
-    Write16(BtoS(regData.AH, regData.AL), BtoS(regData.DH, regData.DL));
+    Write16(BtoS(td->regData.AH, td->regData.AL), BtoS(td->regData.DH, td->regData.DL));
 
     // (2) Check the both bytes. Set the data registers to
     // some arbitrary value different than what we wrote
     // (here AA, 55) make sure we're not reading from them.
-    regData.AH = 0x80;
-    regData.AL = 0x10; 
-    regData.DH = 0xAA;
-    regData.DL = 0x55;
-    if (!check8(BtoS(regData.AH, regData.AL), BtoS(regData.DH, regData.DL), regData.save_DL, 1)) {
+    td->regData.AH = 0x80;
+    td->regData.AL = 0x10; 
+    td->regData.DH = 0xAA;
+    td->regData.DL = 0x55;
+    if (!check8(BtoS(td->regData.AH, td->regData.AL), BtoS(td->regData.DH, td->regData.DL), td->regData.save_DL, 1)) {
       return false;
     }
 
-    regData.AL = 0x11;
-    if (!check8(BtoS(regData.AH, regData.AL), BtoS(regData.DH, regData.DL), regData.save_DH, 2)) {
+    td->regData.AL = 0x11;
+    if (!check8(BtoS(td->regData.AH, td->regData.AL), BtoS(td->regData.DH, td->regData.DL), td->regData.save_DH, 2)) {
       return false;
     }
 
     // (3) preset 0xF00D at 0x20 and 0x21
-    WriteK(0xFF, 0xFF, 0xFF, 0x3F); // write memory, 16-bit access
-    regData.AH = 0x00;
-    regData.AL = 0x20; 
-    regData.DH = 0xF0; 
-    regData.DL = 0x0D;
-    Write16(BtoS(regData.AH, regData.AL), BtoS(regData.DH, regData.DL));
+    WriteK(K_WRMEM16_FROM_NANO); // write memory, 16-bit access
+    td->regData.AH = 0x00;
+    td->regData.AL = 0x20; 
+    td->regData.DH = 0xF0; 
+    td->regData.DL = 0x0D;
+    Write16(BtoS(td->regData.AH, td->regData.AL), BtoS(td->regData.DH, td->regData.DL));
 
     // (4) check it, low byte first, byte at a time
-    regData.DH = 0x77;
-    regData.DL = 0xEE;    
-    regData.AH = 0x80;
-    regData.AL = 0x20; 
-    if (!check8(BtoS(regData.AH, regData.AL), BtoS(regData.DH, regData.DL), 0x0D, 3)) {
+    td->regData.DH = 0x77;
+    td->regData.DL = 0xEE;    
+    td->regData.AH = 0x80;
+    td->regData.AL = 0x20; 
+    if (!check8(BtoS(td->regData.AH, td->regData.AL), BtoS(td->regData.DH, td->regData.DL), 0x0D, 3)) {
       return false;
     }  
     SetMCR(MCR_SAFE);
 
-    regData.AL = 0x21;
-    if (!check8(BtoS(regData.AH, regData.AL), BtoS(regData.DH, regData.DL), 0xF0, 4)) {
+    td->regData.AL = 0x21;
+    if (!check8(BtoS(td->regData.AH, td->regData.AL), BtoS(td->regData.DH, td->regData.DL), 0xF0, 4)) {
       return false;
     }  
     SetMCR(MCR_SAFE);
     
     // Step (5) 16-bit move 0x10 and 0x11 to register 3.
-    WriteK(0xFB, 0xFF, 0x9E, 0xBF);
+    constexpr KWord loadR3 = ToKWord(Microcode().dst(3).sysdata(UCODE_BUS_MEM).regWrite().mem16());
+    WriteK(loadR3);
     
     // Now we need to set AH to 0x80 (SYSADDR:15 high) because this
     // will cause the Nano's data bus drivers to believe the bus cycle
     // is a read so it won't try to drive the bus; otherwise, it will.
     // Again, set the data registers to something "different".
-    regData.AH = 0x80; regData.AL = 0x10; regData.DH = 0xFF; regData.DL = 0xFF;
-    SetADHL(regData.AH, regData.AL, regData.DH, regData.DL);
+    td->regData.AH = 0x80; td->regData.AL = 0x10; td->regData.DH = 0xFF; td->regData.DL = 0xFF;
+    SetADHL(td->regData.AH, td->regData.AL, td->regData.DH, td->regData.DL);
     SetMCR(McrEnableRegisterWrite(McrEnableSysbus(MCR_SAFE)));
     SingleClock();
     SetMCR(MCR_SAFE); // freeze the registers and the bus
@@ -683,20 +996,21 @@ namespace CostPrivate {
     // provides the address, always, when it's in control - the Nano's address
     // bus drivers are enabled by YARC/NANO# low. But again, we'll set the high
     // order address bit to disable the Nano's data bus drivers.
-    WriteK(0xDF, 0xFF, 0x1F, 0x3F);
-    regData.AH = 0x80; regData.AL = 0x20; regData.DH = 0x33; regData.DL = 0x44;
-    SetADHL(regData.AH, regData.AL, regData.DH, regData.DL);
+    constexpr KWord storeR3 = ToKWord(Microcode().src2(3).dst(7).sysdata(UCODE_BUS_GR).memWrite().mem16());
+    WriteK(storeR3);
+    td->regData.AH = 0x80; td->regData.AL = 0x20; td->regData.DH = 0x33; td->regData.DL = 0x44;
+    SetADHL(td->regData.AH, td->regData.AL, td->regData.DH, td->regData.DL);
     SetMCR(McrEnableSysbus(MCR_SAFE));
     SingleClock();
 
     // (7) check it, low byte first, byte at a time
-    if (!check8(BtoS(regData.AH, regData.AL), BtoS(regData.DH, regData.DL), regData.save_DL, 5)) {
+    if (!check8(BtoS(td->regData.AH, td->regData.AL), BtoS(td->regData.DH, td->regData.DL), td->regData.save_DL, 5)) {
       return false;
     }  
     SetMCR(MCR_SAFE);
 
-    regData.AL = 0x21;
-    if (!check8(BtoS(regData.AH, regData.AL), BtoS(regData.DH, regData.DL), regData.save_DH, 6)) {
+    td->regData.AL = 0x21;
+    if (!check8(BtoS(td->regData.AH, td->regData.AL), BtoS(td->regData.DH, td->regData.DL), td->regData.save_DH, 6)) {
       return false;
     }  
     SetMCR(MCR_SAFE);
@@ -713,7 +1027,7 @@ namespace CostPrivate {
   int ucodeBasicMessageCallback(char* bp, int bmax) {
     int result = snprintf_P(bp, bmax,
       PSTR("  F ucodeBasic: fail op 0x%02X sl 0x%02X offset %d data 0x%02X"),
-      ubData.opcode, ubData.slice, ubData.failOffset, ubData.data[ubData.failOffset]);
+      logData.ubData.opcode, logData.ubData.slice, logData.ubData.failOffset, logData.ubData.data);
     if (result > bmax) result = bmax;
     queuedLogMessageCount--;
     return result;
@@ -723,14 +1037,14 @@ namespace CostPrivate {
   // values derived from the opcode. Read the data back from the slice
   // and check it.
   bool validateOpcodeForSlice(byte opcode, byte slice) {
-    constexpr int SIZE = sizeof(ubData.data);
+    constexpr int SIZE = sizeof(td->ubData.data);
 
     for (int i = 0; i < SIZE; ++i) {
-      ubData.data[i] = opcode + i;
+      td->ubData.data[i] = opcode + i;
     }
     
-    ubData.failOffset = WriteSlice(opcode, slice, ubData.data, SIZE, false);
-    if (ubData.failOffset != SIZE) {
+    td->ubData.failOffset = WriteSlice(opcode, slice, td->ubData.data, SIZE, false);
+    if (td->ubData.failOffset != SIZE) {
       return false;      
     }
 
@@ -738,22 +1052,27 @@ namespace CostPrivate {
   }
 
   void ucodeTestInit() {
-    ubData.opcode = 0x80;
-    ubData.slice = 0;
+    td->ubData.opcode = 0x80;
+    td->ubData.slice = 0;
   }
   
   bool ucodeBasicTest() {
-    if (!validateOpcodeForSlice(ubData.opcode, ubData.slice)) {
-      queuedLogMessageCount++;
-      logQueueCallback(ucodeBasicMessageCallback);
+    if (!validateOpcodeForSlice(td->ubData.opcode, td->ubData.slice)) {
+      recordFailure(td->ubData.slice, BtoS(td->ubData.opcode, td->ubData.failOffset));
+      logData.ubData.opcode = td->ubData.opcode;
+      logData.ubData.slice = td->ubData.slice;
+      logData.ubData.failOffset = td->ubData.failOffset;
+      logData.ubData.data = td->ubData.data[td->ubData.failOffset];
+      queueLog(ucodeBasicMessageCallback);
       return false;
     }
+    recordCoverage(sizeof(td->ubData.data));
 
-    if (++ubData.slice > 3) {
-      ubData.slice = 0;
-      ubData.opcode++;
+    if (++td->ubData.slice > 3) {
+      td->ubData.slice = 0;
+      td->ubData.opcode++;
     }
-    if ((ubData.opcode & 0x80) == 0) {
+    if ((td->ubData.opcode & 0x80) == 0) {
       return false; // done with one pass over all opcodes and slices
     }
     return true; // not done
@@ -764,49 +1083,51 @@ namespace CostPrivate {
   int memBasicMessageCallback(char* bp, int bmax) {
     int result = snprintf_P(bp, bmax,
       PSTR("  F memBasic: at 0x%02X 0x%02X data 0x%02X 0x%02X read 0x%02X"),
-      mbData.AH, mbData.AL, mbData.DH, mbData.DL, mbData.readValue);
+      logData.mbData.AH, logData.mbData.AL, logData.mbData.DH, logData.mbData.DL, logData.mbData.readValue);
     if (result > bmax) result = bmax;
     queuedLogMessageCount--;
     return result;
   }
 
   void memBasicTestInit() {
-    mbData.AH = random(0, 0x78);
-    mbData.AL = random(0, 256);
-    mbData.DH = random(0, 256);
-    mbData.DL = random(0, 256);
+    td->mbData.AH = random(0, 0x78);
+    td->mbData.AL = random(0, 256);
+    td->mbData.DH = random(0, 256);
+    td->mbData.DL = random(0, 256);
   }
 
   bool memBasicTest() {
-    WriteK(0xFF, 0xFF, 0xFF, 0x7F);  // write memory, 8-bit access
-    SetADHL(mbData.AH, mbData.AL, mbData.DH, mbData.DL);
+    WriteK(K_WRMEM8_FROM_NANO);  // write memory, 8-bit access
+    SetADHL(td->mbData.AH, td->mbData.AL, td->mbData.DH, td->mbData.DL);
     SetMCR(MCR_SAFE);
     SingleClock();
 
     // Now write some nearby locations with different data
     // We don't worry about carries out of AL
-    SetDL(~mbData.DL);
+    SetDL(~td->mbData.DL);
     for (byte i = 1; i < 64; i = i << 1) {
-      SetAL(mbData.AL + i);
+      SetAL(td->mbData.AL + i);
       SingleClock();
-      SetAL(mbData.AL - i);
+      SetAL(td->mbData.AL - i);
       SingleClock();
     }
 
     // Check the original location. Set the data registers
     // to some arbitrary value.
-    WriteK(0xFF, 0xFF, 0x9F, 0xFF);  // read memory, 8-bit access
-    SetADHL(mbData.AH | 0x80, mbData.AL, 0x55, 0x55); // 0x80 = nano read
+    WriteK(K_RDMEM8_TO_NANO);  // read memory, 8-bit access
+    SetADHL(td->mbData.AH | 0x80, td->mbData.AL, 0x55, 0x55); // 0x80 = nano read
     SetMCR(McrEnableSysbus(MCR_SAFE));
     SingleClock();
-    if ((mbData.readValue = GetBIR()) != mbData.DL) {
-      queuedLogMessageCount++;
-      logQueueCallback(memBasicMessageCallback);
+    if ((td->mbData.readValue = GetBIR()) != td->mbData.DL) {
+      recordFailure(0, BtoS(td->mbData.AH, td->mbData.AL));
+      logData.mbData = td->mbData;
+      queueLog(memBasicMessageCallback);
       return false;
     }
+    recordCoverage(1);
 
-    mbData.AL++;
-    if (mbData.AL == 0) {
+    td->mbData.AL++;
+    if (td->mbData.AL == 0) {
       return false; // done
     }
     return true;
@@ -818,7 +1139,7 @@ namespace CostPrivate {
   int memHammerCallback(char* bp, int bmax) {
     int result = snprintf_P(bp, bmax,
       PSTR("  F memHammer: at 0x%02X 0x%02X data 0x%02X 0x%02X read 0x%02X"),
-      mbData.AH, mbData.AL, mbData.DH, mbData.DL, mbData.readValue);
+      logData.mbData.AH, logData.mbData.AL, logData.mbData.DH, logData.mbData.DL, logData.mbData.readValue);
     if (result > bmax) result = bmax;
     queuedLogMessageCount--;
     return result;
@@ -832,11 +1153,11 @@ namespace CostPrivate {
     ushort writeData[N];
     ushort readData[N];
 
-    mbData.AH = random(0x10, 0x78 - 0x11);
-    mbData.AL = 2 * random(0, 0x70);
-    mbData.DH = 0;
-    mbData.DL = 0;
-    const ushort addr = BtoS(mbData.AH, mbData.AL);
+    td->mbData.AH = random(0x10, 0x78 - 0x11);
+    td->mbData.AL = 2 * random(0, 0x70);
+    td->mbData.DH = 0;
+    td->mbData.DL = 0;
+    const ushort addr = BtoS(td->mbData.AH, td->mbData.AL);
         
     // We use the misnamed "read data" for all the noise writes
     for (short i = 0, s = random(0, 0x8000); i < N; ++i, s += 137) {
@@ -854,12 +1175,14 @@ namespace CostPrivate {
     ReadMem16(addr, readData, N);
     for (short i = 0; i < N; ++i) {
       if (writeData[i] != readData[i]) {
-        mbData.readValue = readData[i]; // truncates
-        queuedLogMessageCount++;
-        logQueueCallback(memHammerCallback);
+        td->mbData.readValue = readData[i]; // truncates
+        recordFailure(i, addr);
+        logData.mbData = td->mbData;
+        queueLog(memHammerCallback);
         return false;
       }
     }
+    recordCoverage(sizeof(writeData));
     return false;
   }
 
@@ -870,16 +1193,16 @@ namespace CostPrivate {
     ReadMem16(SCRATCH_MEM, memvalues, 2);
     int result = snprintf_P(bp, bmax,
       PSTR("  F flagTest: (%d) flags 0x%02X cond 0x%02X SCRATCH 0x%04X 0x%04X"),
-      flagsData.location, flagsData.flags, flagsData.condition, memvalues[0], memvalues[1]);
+      logData.flagsData.location, logData.flagsData.flags, logData.flagsData.condition, memvalues[0], memvalues[1]);
     if (result > bmax) result = bmax;
     queuedLogMessageCount--;
     return result;
   }
 
   void flagsInit() {
-    flagsData.location = 1; // i.e. do the first test in flagsTest()
-    flagsData.flags = 0;
-    flagsData.condition = 0;
+    td->flagsData.location = 1; // i.e. do the first test in flagsTest()
+    td->flagsData.flags = 0;
+    td->flagsData.condition = 0;
     ushort memval = 0x3C3C;
     WriteMem16(SCRATCH_MEM, &memval, 1);
     WriteMem16(SCRATCH_MEM + 2, &memval, 1);
@@ -892,17 +1215,19 @@ namespace CostPrivate {
 
   bool flagsTest() {
     // First test: just read and write the flags register
-    if (flagsData.location == 1) {
-      for (flagsData.flags = 0; flagsData.flags <= 0x0F; ++flagsData.flags) {
-        WriteFlags(flagsData.flags);
-        flagsData.condition = ReadFlags() & 0x0F;
-        if (flagsData.flags != flagsData.condition) {
-          queuedLogMessageCount++;
-          logQueueCallback(flagsCallback);
+    if (td->flagsData.location == 1) {
+      for (td->flagsData.flags = 0; td->flagsData.flags <= 0x0F; ++td->flagsData.flags) {
+        WriteFlags(td->flagsData.flags);
+        td->flagsData.condition = ReadFlags() & 0x0F;
+        if (td->flagsData.flags != td->flagsData.condition) {
+          recordFailure(td->flagsData.location, BtoS(td->flagsData.flags, td->flagsData.condition));
+          logData.flagsData = td->flagsData;
+          queueLog(flagsCallback);
           return false;
         }
       }
-      flagsData.location = 2;
+      recordCoverage(1);
+      td->flagsData.location = 2;
       return true; // come back and do the second test
     }
     return false; // done, success or failure
@@ -913,22 +1238,22 @@ namespace CostPrivate {
     int aluRamCallback(char* bp, int bmax) {
     int result = snprintf_P(bp, bmax,
       PSTR("  F aluRamTest: ram %d: at 0x%04x [%02X %02X %02X] wrote %02X %02X %02X %02X %02X %02X %02X read %02X %02X %02X %02X %02X %02X %02X"),
-        aluRamData.ram, aluRamData.address,
-        aluRamData.b0, aluRamData.b1, aluRamData.b2,
-        aluRamData.data[0],
-        aluRamData.data[1],
-        aluRamData.data[2],
-        aluRamData.data[3],
-        aluRamData.data[4],
-        aluRamData.data[5],
-        aluRamData.data[6],
-        aluRamData.readback[0],
-        aluRamData.readback[1],
-        aluRamData.readback[2],
-        aluRamData.readback[3],
-        aluRamData.readback[4],
-        aluRamData.readback[5],
-        aluRamData.readback[6]
+        logData.aluRamData.ram, logData.aluRamData.address,
+        logData.aluRamData.b0, logData.aluRamData.b1, logData.aluRamData.b2,
+        logData.aluRamData.data[0],
+        logData.aluRamData.data[1],
+        logData.aluRamData.data[2],
+        logData.aluRamData.data[3],
+        logData.aluRamData.data[4],
+        logData.aluRamData.data[5],
+        logData.aluRamData.data[6],
+        logData.aluRamData.readback[0],
+        logData.aluRamData.readback[1],
+        logData.aluRamData.readback[2],
+        logData.aluRamData.readback[3],
+        logData.aluRamData.readback[4],
+        logData.aluRamData.readback[5],
+        logData.aluRamData.readback[6]
         );
     if (result > bmax) result = bmax;
     queuedLogMessageCount--;
@@ -936,7 +1261,7 @@ namespace CostPrivate {
   }
 
   int aluRamOKCallback(char* bp, int bmax) {
-    int result = snprintf_P(bp, bmax, PSTR(" OK aluRamTest: at 0x%04X"), aluRamData.address);
+    int result = snprintf_P(bp, bmax, PSTR(" OK aluRamTest: at 0x%04X"), logData.aluRamData.address);
     if (result > bmax) result = bmax;
     queuedLogMessageCount--;
     return result;
@@ -949,31 +1274,38 @@ namespace CostPrivate {
     byte b = random();
 
     for (byte i = 0; i < aluChunkSize; ++i) {
-      aluRamData.data[i] = b + 131;
+      td->aluRamData.data[i] = b + 131;
       b += 131;
     }
 
     ushort addr = random(0, END_ALU_MEM - aluChunkSize);
-    WriteALU(addr, aluRamData.data, aluChunkSize);
+    WriteALU(addr, td->aluRamData.data, aluChunkSize);
 
     for (byte ram = 0; ram < 3; ++ram) {
-      ReadALU(addr, aluRamData.readback, aluChunkSize, ram);
+      ReadALU(addr, td->aluRamData.readback, aluChunkSize, ram);
       for (int i = 0; i < aluChunkSize; ++i) {
-        if (aluRamData.readback[i] != aluRamData.data[i]) {
-          aluRamData.address = addr;
-          aluRamData.ram = ram;
-          ReadALU(addr+i, &aluRamData.b0, 1, 0);
-          ReadALU(addr+i, &aluRamData.b1, 1, 1);
-          ReadALU(addr+i, &aluRamData.b2, 1, 2);
-          queuedLogMessageCount++;
-          logQueueCallback(aluRamCallback);
+        if (td->aluRamData.readback[i] != td->aluRamData.data[i]) {
+          td->aluRamData.address = addr;
+          td->aluRamData.ram = ram;
+          ReadALU(addr+i, &td->aluRamData.b0, 1, 0);
+          ReadALU(addr+i, &td->aluRamData.b1, 1, 1);
+          ReadALU(addr+i, &td->aluRamData.b2, 1, 2);
+          recordFailure(ram, addr + i);
+          memcpy(logData.aluRamData.data, td->aluRamData.data, ALU_RAM_LOGGED);
+          memcpy(logData.aluRamData.readback, td->aluRamData.readback, ALU_RAM_LOGGED);
+          logData.aluRamData.address = addr;
+          logData.aluRamData.ram = ram;
+          logData.aluRamData.b0 = td->aluRamData.b0;
+          logData.aluRamData.b1 = td->aluRamData.b1;
+          logData.aluRamData.b2 = td->aluRamData.b2;
+          queueLog(aluRamCallback);
           return false;
         }
       }
     }
-    aluRamData.address = addr;
-    queuedLogMessageCount++;
-    logQueueCallback(aluRamOKCallback);
+    recordCoverage(3 * aluChunkSize);
+    logData.aluRamData.address = addr;
+    queueLog(aluRamOKCallback);
     return false;
   }
 
@@ -984,14 +1316,264 @@ namespace CostPrivate {
     byte b = random();
 
     for (byte i = 0; i < aluChunkSize; ++i) {
-      aluRamData.data[i] = b + 53;
+      td->aluRamData.data[i] = b + 53;
       b += 17;
     }
     // Write to 64-byte chunky 0, 1, 2, or 3. WriteCheckALU() panics
     // if the write doesn't verify. We only want to call it once since
     // it's really slow.
     byte whichChunkOf64 = random();
-    WriteCheckALU((whichChunkOf64 & 0x03) << 6, aluRamData.data, 64);
+    WriteCheckALU((whichChunkOf64 & 0x03) << 6, td->aluRamData.data, 64, true);
+    recordCoverage(3 * 64);
+    return false;
+  }
+
+  // === aluExec: the YARC performs ALU operations at fast clock ===
+
+  // The alu and wrALU tests only read back the ALU RAMs. This test has
+  // the YARC itself perform AX_OPS 16-bit ALU operations through the real
+  // two-phase datapath and store the results and flags in memory, then
+  // checks them all. The ALU RAMs are overwritten with random data by the
+  // other ALU tests, so this test first generates the tables it uses (see
+  // GenerateALURange()): the add table (ALU operation 0), which fetch and
+  // decode also use to increment the PC, and one table for each operation
+  // in axOps[], below.
+  //
+  // The program is a sequence of instructions chosen from axOps[], each
+  // followed by an immediate B operand. Each instruction does R0 op B into
+  // R2, with the carry in from the C flag, and stores R2 and the flags at
+  // (R1), advancing R1 by 4 and R0 by 1. Its ALU operation comes from the
+  // low nybble of its opcode. The flags are set by the instruction before,
+  // so the arithmetic operations carry into whatever follows them. The
+  // last instruction is SCRATCH_OPCODE_F4, which has no-op microcode, so
+  // the YARC spins there until the Nano takes control back. All of them
+  // are resident helpers (see yarc_utils.h), so they're only written again
+  // after the ucode test has overwritten them.
+
+  constexpr byte AX_OPS = 128;
+  constexpr ushort AX_PROGRAM = 0x7000;               // 2 words per op
+  constexpr ushort AX_RESULTS = AX_PROGRAM + 4*AX_OPS; // 2 words per op
+  constexpr byte AX_CHUNKS = (4*AX_OPS) / CHUNK_SIZE;  // for either of them
+  constexpr ushort AX_B_STRIDE = 0x9E37;
+  constexpr ushort AX_OP_STRIDE = 0x5A3D;
+  constexpr unsigned int AX_RUN_MICROS = 4000;        // >= 2000 clocks at 1MHz
+
+  // The opcodes of the test and the function of the ALU table each one's
+  // ACN (low nybble) selects. The opcodes share the helper microcode.
+  typedef struct axOp {
+    byte opcode;
+    byte fn;
+  } AxOp;
+
+  const PROGMEM AxOp axOps[] = {
+    { SCRATCH_OPCODE_F3, ALU_FN_ADD  },
+    { SCRATCH_OPCODE_F5, ALU_FN_SUB  },
+    { SCRATCH_OPCODE_F6, ALU_FN_RSUB },
+    { SCRATCH_OPCODE_F7, ALU_FN_NAND },
+    { SCRATCH_OPCODE_F8, ALU_FN_OR   },
+    { SCRATCH_OPCODE_F9, ALU_FN_XOR  },
+    { SCRATCH_OPCODE_FA, ALU_FN_NOT  },
+    { SCRATCH_OPCODE_FB, ALU_FN_NEG  },
+  };
+  constexpr byte AX_N_OPS = sizeof(axOps) / sizeof(AxOp);
+  static_assert(AX_N_OPS == 8, "axOp() chooses among 8 operations");
+
+  constexpr byte AX_TABLE_CHUNKS = (2 * 256) / CHUNK_SIZE; // per ALU operation
+
+  constexpr byte AX_LOAD_ALU = 1;
+  constexpr byte AX_LOAD_PROGRAM = 2;
+  constexpr byte AX_RUN = 3;
+  constexpr byte AX_VERIFY = 4;
+
+  inline ushort axOperandA(ushort i) {
+    return td->aluExecData.a0 + i;
+  }
+
+  inline ushort axOperandB(ushort i) {
+    return td->aluExecData.seed + i * AX_B_STRIDE;
+  }
+
+  // Return the index in axOps[] of the operation of instruction i
+  inline byte axOp(ushort i) {
+    return ((td->aluExecData.seed ^ (i * AX_OP_STRIDE)) >> 9) & (AX_N_OPS - 1);
+  }
+
+  inline byte axOpcode(byte op) {
+    return pgm_read_byte_near(&axOps[op].opcode);
+  }
+
+  inline byte axFunction(byte op) {
+    return pgm_read_byte_near(&axOps[op].fn);
+  }
+
+  // Return the result of the ALU function on 16-bit operands a and b
+  // with the carry in c, as the YARC computes it from the 4-bit tables of
+  // AluTableValue(): the carry ripples from nybble to nybble, Z is the AND
+  // of the nybble zero flags, and N and V come from the top nybble. The
+  // flags are returned in the low nybble of *flags (C, Z, N, V in bits 0
+  // through 3, as in the flags register).
+  ushort axExpected(byte fn, ushort a, ushort b, byte c, byte *flags) {
+    ushort x = a;        // the operands of an arithmetic function, for V
+    ushort y = b;
+    unsigned long sum;
+    bool arithmetic = true;
+
+    switch (fn) {
+    case ALU_FN_ADD:  sum = (unsigned long)a + b + c; break;
+    case ALU_FN_SUB:  y = ~b; sum = (unsigned long)a + y + c; break;
+    case ALU_FN_RSUB: x = b; y = ~a; sum = (unsigned long)x + y + c; break;
+    case ALU_FN_NEG:  x = ~a; y = 0; sum = (unsigned long)x + c; break;
+    case ALU_FN_NAND: sum = (ushort)~(a & b); arithmetic = false; break;
+    case ALU_FN_OR:   sum = a | b; arithmetic = false; break;
+    case ALU_FN_XOR:  sum = a ^ b; arithmetic = false; break;
+    case ALU_FN_NOT:  sum = (ushort)~a; arithmetic = false; break;
+    default:
+      panic(PANIC_ARGUMENT, 28);
+      return 0;
+    }
+
+    ushort result = sum;
+    byte f = 0;
+    if (sum & 0x10000UL) f |= 0x01;
+    if (result == 0) f |= 0x02;
+    if (result & 0x8000) f |= 0x04;
+    if (arithmetic && ((x ^ y) & 0x8000) == 0 && ((result ^ x) & 0x8000) != 0) f |= 0x08;
+    *flags = f;
+    return result;
+  }
+
+  int aluExecCallback(char* bp, int bmax) {
+    int result = snprintf_P(bp, bmax, PSTR("  F aluexec: fn %d %04X, %04X c %d got %04X f %X expected %04X f %X"),
+                            logData.aluExecData.fn, logData.aluExecData.a, logData.aluExecData.b,
+                            logData.aluExecData.carry, logData.aluExecData.got, logData.aluExecData.gotFlags,
+                            logData.aluExecData.expected, logData.aluExecData.expectedFlags);
+    if (result > bmax) result = bmax;
+    queuedLogMessageCount--;
+    return result;
+  }
+
+  // Generate the given 64-byte chunk of the tables the test uses: first
+  // the add table at ALU operation 0, then the table at each opcode's ACN.
+  // The descriptors of the other operations are ALU_FN_NONE, so they're
+  // left alone.
+  void axLoadTables(byte chunk) {
+    byte descriptors[16];
+    for (byte k = 0; k < sizeof(descriptors); ++k) {
+      descriptors[k] = ALU_FN_NONE;
+    }
+    descriptors[0] = ALU_FN_ADD;
+    for (byte op = 0; op < AX_N_OPS; ++op) {
+      descriptors[axOpcode(op) & 0x0F] = axFunction(op);
+    }
+
+    byte table = chunk / AX_TABLE_CHUNKS;
+    byte acn = (table == 0) ? 0 : axOpcode(table - 1) & 0x0F;
+    ushort offset = acn * (2 * 256) + (chunk % AX_TABLE_CHUNKS) * CHUNK_SIZE;
+    GenerateALURange(descriptors, offset, CHUNK_SIZE, 0);
+  }
+
+  // Fill the data buffer with the given chunk of the program. Word 2i is
+  // the immediate of instruction i, and word 2i + 1 is the instruction
+  // after it. The Nano loads instruction 0 into the IR.
+  void axMakeProgram(byte chunk) {
+    for (byte k = 0; k < CHUNK_WORDS; ++k) {
+      ushort w = chunk * CHUNK_WORDS + k;
+      ushort i = w >> 1;
+      if ((w & 1) == 0) {
+        td->aluExecData.words[k] = axOperandB(i);
+      } else if (i < AX_OPS - 1) {
+        td->aluExecData.words[k] = BtoS(axOpcode(axOp(i + 1)), 0);
+      } else {
+        td->aluExecData.words[k] = BtoS(SCRATCH_OPCODE_F4, 0);
+      }
+    }
+  }
+
+  void aluExecInit() {
+    td->aluExecData.seed = random();
+    td->aluExecData.a0 = random();
+    td->aluExecData.carry = random() & 1;
+    td->aluExecData.chunk = 0;
+    td->aluExecData.state = AX_LOAD_ALU;
+  }
+
+  // One chunk of ALU table, program, or results per call.
+  bool aluExecTest() {
+    switch (td->aluExecData.state) {
+      case AX_LOAD_ALU: {
+        axLoadTables(td->aluExecData.chunk);
+        if (++td->aluExecData.chunk == (1 + AX_N_OPS) * AX_TABLE_CHUNKS) {
+          td->aluExecData.chunk = 0;
+          td->aluExecData.state = AX_LOAD_PROGRAM;
+        }
+        return true;
+      }
+      case AX_LOAD_PROGRAM: {
+        axMakeProgram(td->aluExecData.chunk);
+        WriteMem16(AX_PROGRAM + td->aluExecData.chunk * CHUNK_SIZE, td->aluExecData.words, CHUNK_WORDS);
+        if (++td->aluExecData.chunk == AX_CHUNKS) {
+          td->aluExecData.chunk = 0;
+          td->aluExecData.state = AX_RUN;
+        }
+        return true;
+      }
+      case AX_RUN: {
+        for (byte op = 0; op < AX_N_OPS; ++op) {
+          EnsureHelper(axOpcode(op));
+        }
+        EnsureHelper(SCRATCH_OPCODE_F4);
+
+        // The carry into the first instruction. WriteFlags() uses R3,
+        // so it comes first. R3 points at the first immediate because
+        // the Nano loads the first instruction into the IR.
+        WriteFlags(td->aluExecData.carry);
+        WriteReg(0, td->aluExecData.a0);
+        WriteReg(1, AX_RESULTS);
+        WriteReg(2, 0);
+        WriteReg(3, AX_PROGRAM);
+        MakeSafe();
+        WriteIR(axOpcode(axOp(0)), 0x00);
+        SetMCR(McrEnableFastclock(McrEnableSysbus(McrEnableYarc(MCR_SAFE))));
+        delayMicroseconds(AX_RUN_MICROS);
+        SetMCR(McrDisableFastclock(McrEnableSysbus(McrEnableYarc(MCR_SAFE))));
+        SetMCR(MCR_SAFE);
+        MakeSafe();
+        td->aluExecData.state = AX_VERIFY;
+        return true;
+      }
+      case AX_VERIFY: {
+        // The expected carry into each instruction is the C flag of the
+        // one before, so a failure ends the test.
+        ReadMem16(AX_RESULTS + td->aluExecData.chunk * CHUNK_SIZE, td->aluExecData.words, CHUNK_WORDS);
+        for (byte k = 0; k < CHUNK_WORDS; k += 2) {
+          ushort i = (td->aluExecData.chunk * CHUNK_WORDS + k) >> 1;
+          byte fn = axFunction(axOp(i));
+          ushort a = axOperandA(i);
+          ushort b = axOperandB(i);
+          byte carry = td->aluExecData.carry;
+          byte expectedFlags;
+          ushort expected = axExpected(fn, a, b, carry, &expectedFlags);
+          ushort got = td->aluExecData.words[k];
+          byte gotFlags = td->aluExecData.words[k + 1] & 0x0F;
+          if (got != expected || gotFlags != expectedFlags) {
+            recordFailure((got != expected) ? 1 : 2, i);
+            logData.aluExecData.a = a;
+            logData.aluExecData.b = b;
+            logData.aluExecData.got = got;
+            logData.aluExecData.expected = expected;
+            logData.aluExecData.fn = fn;
+            logData.aluExecData.carry = carry;
+            logData.aluExecData.gotFlags = gotFlags;
+            logData.aluExecData.expectedFlags = expectedFlags;
+            queueLog(aluExecCallback);
+            return false;
+          }
+          td->aluExecData.carry = expectedFlags & 0x01;
+        }
+        recordCoverage(CHUNK_SIZE);
+        return ++td->aluExecData.chunk < AX_CHUNKS;
+      }
+    }
     return false;
   }
 
@@ -1005,8 +1587,10 @@ namespace CostPrivate {
 // all activity runs in the foreground. 
 void costRun() {
   MakeSafe();
+  CostPrivate::restoreRegs(); // if a test was running
   CostPrivate::currentTestId = CostPrivate::N_TESTS;
   CostPrivate::lastTestId = CostPrivate::N_TESTS - 1;  
+  CostPrivate::suspended = false;
 	CostPrivate::running = true;
 }
 
@@ -1027,6 +1611,67 @@ void costStop() {
   }
 }
 
+// Called from the serial task before a host command that uses the YARC.
+// If the tests are running, suspend them at the current step boundary;
+// in any case, postpone resumption. See the note at the top of the file.
+void costPreempt() {
+  CostPrivate::lastPreemptMillis = millis();
+  if (CostPrivate::running && !CostPrivate::suspended) {
+    CostPrivate::suspendTests();
+  }
+}
+
+// Called from the serial task when a command needs the scratch space the
+// test data occupies. Unlike costPreempt(), this doesn't suspend the tests.
+void costDropTestData() {
+  CostPrivate::dropTestData();
+}
+
+// Format the results table into bp for transmission to the host. Returns
+// the number of bytes placed at bp, which will not exceed bmax. Multibyte
+// values are big-endian, as elsewhere in the protocol. The layout is a
+// 6-byte header followed by one fixed-size record per test:
+//
+// header: number of tests, record size, flags (0x01 running, 0x02 stopping,
+//         0x04 suspended), current test ID, completed test cycles (2 bytes)
+// record: pass count (2), fail count (2), last run milliseconds (2),
+//         last failure detail (2), last failure code (1), bytes covered (4)
+int costGetResults(byte *bp, int bmax) {
+  constexpr int HEADER_SIZE = 6;
+  constexpr int RECORD_SIZE = 13;
+  if (bmax < HEADER_SIZE) {
+    return 0;
+  }
+
+  *bp++ = CostPrivate::N_TESTS;
+  *bp++ = RECORD_SIZE;
+  *bp++ = (CostPrivate::running ? 0x01 : 0) | (CostPrivate::stopping ? 0x02 : 0)
+        | (CostPrivate::suspended ? 0x04 : 0);
+  *bp++ = CostPrivate::currentTestId;
+  *bp++ = StoHB(CostPrivate::cycleCount);
+  *bp++ = StoLB(CostPrivate::cycleCount);
+  int n = HEADER_SIZE;
+
+  for (byte t = 0; t < CostPrivate::N_TESTS && n + RECORD_SIZE <= bmax; ++t) {
+    const CostPrivate::TestResult* const tr = &CostPrivate::results[t];
+    *bp++ = StoHB(tr->passCount);
+    *bp++ = StoLB(tr->passCount);
+    *bp++ = StoHB(tr->failCount);
+    *bp++ = StoLB(tr->failCount);
+    *bp++ = StoHB(tr->lastRunMillis);
+    *bp++ = StoLB(tr->lastRunMillis);
+    *bp++ = StoHB(tr->lastFailDetail);
+    *bp++ = StoLB(tr->lastFailDetail);
+    *bp++ = tr->lastFailCode;
+    *bp++ = (byte)(tr->bytesCovered >> 24);
+    *bp++ = (byte)(tr->bytesCovered >> 16);
+    *bp++ = (byte)(tr->bytesCovered >> 8);
+    *bp++ = (byte)(tr->bytesCovered);
+    n += RECORD_SIZE;
+  }
+  return n;
+}
+
 void costTaskInit() {
   // The individual tests have their own init functions, called from task.
 }
@@ -22,10 +22,42 @@ byte GetMCR(void);
 byte GetBIR(void);
 void MakeSafe(void);
 void SingleClock(void);
+void ClockBurst(unsigned short n);
 void RunYARC(unsigned short r0, unsigned short r1, unsigned short r2);
 void StopYARC(void);
 bool IsYarcRun(void);
 bool IsYarcRequest(void);
 
-
-
+// Saved write-only state of the bus (see PortSaveBus() in port_task.h).
+typedef struct busState {
+  byte kReversed[4];  // K, bit-reversed, indexed by slice
+  byte adhl[4];       // AH, AL, DH, DL
+  byte mcr;
+} BusState;
+
+void PortSaveBus(BusState *s);
+void PortRestoreBus(const BusState *s);
+
+// Background initialization (see internalPostInit() in port_task.h).
+// The status bits are reported to the host by the init status command.
+// Commands that use the YARC are deferred until PortIsReady(). After a
+// warm reset (Nano only), the self test is skipped and the WCS and memory
+// are preserved rather than cleared; the image bits are set for stores
+// that still hold the image last recorded by PortSaveImage().
+
+enum : byte {
+  INIT_SELF_TEST  = 0x01, // memory and flags read back reliably
+  INIT_POR_CLEAR  = 0x02, // the YARC is out of power-on reset
+  INIT_WCS        = 0x04, // the WCS has been cleared or preserved
+  INIT_MEM        = 0x08, // main memory has been cleared or preserved
+  INIT_WCS_IMAGE  = 0x10, // the WCS holds the recorded image
+  INIT_MEM_IMAGE  = 0x20, // main memory holds the recorded image
+  INIT_ALU_IMAGE  = 0x40, // the ALU RAM holds the recorded image
+  INIT_DONE       = 0x80, // initialization is complete
+};
+
+bool PortIsReady(void);
+byte PortInitStatus(void);
+void PortSaveImage(byte store, unsigned short fileDigest, unsigned short contentDigest);
+unsigned short PortGetImage(byte store);
+void PortInvalidateImage(byte store);
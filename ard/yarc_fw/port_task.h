@@ -13,14 +13,17 @@ namespace PortPrivate {
   // which calls the init functions of all the tasks, in the order specified
   // in the static task definition table in task_runner.h. At this point all
   // the system facilities are usable. Then InitTasks() calls postInit() which
-  // just calls PortPrivate::internalPostInit() near line 270 in this file.
-  // If postInit() returns false, InitTasks() calls panic(). internalPostInit()
-  // has some built-in functionality and calls out to the following three
+  // just calls PortPrivate::internalPostInit() below in this file. If
+  // postInit() returns false, InitTasks() calls panic(). internalPostInit()
+  // only does the quick steps; the slow ones (self tests and clearing the
+  // WCS and memory) are done in the background by portTask() so the serial
+  // link is available immediately. Commands that use the YARC are deferred
+  // until PortIsReady(). Initialization calls out to the following three
   // functions.
 
   void callWhenAnyReset(void);      // Called from the top of postInit() always
   void callWhenPowerOnReset(void);  // Called only when power-on reset occurring
-  void callAfterPostInit(void);     // Called from the end of postInit() always
+  void callAfterPostInit(void);     // Called from portTask() when init is done
   
   // Ahem. The internal bus that connects the system data bus to the
   // four slice busses is wired backwards. So all the bits written to
@@ -34,6 +37,8 @@ namespace PortPrivate {
   // have plenty of, and performance isn't particularly critical because
   // writes only happen during system initialization. The code came
   // from StackOverflow and probably cannot be covered by copyright.
+  // Constant K words are reversed by the compiler instead (see KWord
+  // in task_decls.h).
   
   byte reverse_byte(byte b) {
     static const PROGMEM byte table[] = {
@@ -95,57 +100,119 @@ namespace PortPrivate {
     nanoTogglePulse(EnableUCRamOut);
   }
 
+  // Write one byte of the K register, already bit-reversed. The caller
+  // must have disabled the microcode RAM outputs and set up the UCR for
+  // a K register write. K is write-only, so we shadow it (reversed).
+  byte kShadowReversed[4];
+
+  void writeKSliceReversed(byte slice, byte reversed) {
+    kShadowReversed[slice] = reversed;
+    ucrSetSlice(slice);
+    syncUCR();
+    SetMCR(McrEnableWcs(MCR_SAFE));
+    setAH(0x7F); setAL(0xFF);
+    setDH(0x00); setDL(reversed);
+    singleClock();
+    SetMCR(MCR_SAFE);
+  }
+
+  void writeKSlice(byte slice, byte value) {
+    writeKSliceReversed(slice, reverse_byte(value));
+  }
+
+  // Write the K register with bytes that are already bit-reversed, as
+  // in a KWord. The arguments are in the order bytes 3, 2, 1, 0.
+  void internalWriteKReversed(byte r3, byte r2, byte r1, byte r0) {
+    disableMicrocodeRamOutputs();
+
+    ucrSetDirectionWrite();
+    ucrEnableSliceTransceiver();
+    ucrSetKRegWrite();
+
+    writeKSliceReversed(3, r3);
+    writeKSliceReversed(2, r2);
+    writeKSliceReversed(1, r1);
+    writeKSliceReversed(0, r0);
+
+    ucrMakeSafe();
+    enableMicrocodeRamOutputs();
+    setAH(0xFF); 
+    McrMakeSafe();
+  }
+
   // Write the K register. The arguments follow the big-endian
   // convention (bytes 3, 2, 1, 0) we have for microcode.
   void internalWriteK(byte k3, byte k2, byte k1, byte k0) {
+    internalWriteKReversed(reverse_byte(k3), reverse_byte(k2), reverse_byte(k1), reverse_byte(k0));
+  }
+
+  // Write only the bytes of the K register that differ from the copy at
+  // *k (k3 at offset 0), which must hold the current content of K, and
+  // update the copy. Sequences that alternate between a few microcode
+  // words, like ALU RAM loading, often change just one or two bytes.
+  void internalUpdateK(byte *k, byte k3, byte k2, byte k1, byte k0) {
+    byte next[4] = { k3, k2, k1, k0 };
+    if (k[0] == k3 && k[1] == k2 && k[2] == k1 && k[3] == k0) {
+      return;
+    }
     disableMicrocodeRamOutputs();
 
     ucrSetDirectionWrite();
     ucrEnableSliceTransceiver();
     ucrSetKRegWrite();
 
-    ucrSetSlice(3);
-    syncUCR();
-    SetMCR(McrEnableWcs(MCR_SAFE));
-    setAH(0x7F); setAL(0xFF);
-    setDH(0x00); setDL(reverse_byte(k3));
-    singleClock();
-    SetMCR(MCR_SAFE);
+    for (byte i = 0; i < 4; ++i) {
+      if (k[i] != next[i]) {
+        writeKSlice(3 - i, next[i]);
+        k[i] = next[i];
+      }
+    }
 
-    ucrSetSlice(2);
-    syncUCR();
-    SetMCR(McrEnableWcs(MCR_SAFE));
-    setAH(0x7F); setAL(0xFF);
-    setDH(0x00); setDL(reverse_byte(k2));
-    singleClock();
-    SetMCR(MCR_SAFE);
+    ucrMakeSafe();
+    enableMicrocodeRamOutputs();
+    setAH(0xFF); 
+    McrMakeSafe();
+  }
 
-    ucrSetSlice(1);
-    syncUCR();
-    SetMCR(McrEnableWcs(MCR_SAFE));
-    setAH(0x7F); setAL(0xFF);
-    setDH(0x00); setDL(reverse_byte(k1));
-    singleClock();
-    SetMCR(MCR_SAFE);
+  // Called by the slice writers below for every write to the WCS. The
+  // scratch opcodes aren't part of the image (see DigestChunk()).
+  void wcsWritten(byte opcode) {
+    HelperOverwritten(opcode);
+    if (opcode < SCRATCH_OPCODE_F0 || opcode > SCRATCH_OPCODE_FB) {
+      PortInvalidateImage(STORE_WCS);
+    }
+  }
 
-    ucrSetSlice(0);
+  // Advance the state counter (the low bits of the microcode address) from
+  // slot 0 to slot first with read cycles, which don't alter the WCS. The
+  // IR must just have been written, which resets the counter.
+  void skipSlots(byte slice, byte first) {
+    if (first == 0) {
+      return;
+    }
+    ucrSetSlice(slice);
+    ucrSetDirectionRead();
+    ucrSetRAMRead();
+    ucrEnableSliceTransceiver();
     syncUCR();
-    SetMCR(McrEnableWcs(MCR_SAFE));
-    setAH(0x7F); setAL(0xFF);
-    setDH(0x00); setDL(reverse_byte(k0));
-    singleClock();
-    SetMCR(MCR_SAFE);
 
+    setAH(0xFF); setAL(0xFF);
+    for (byte i = 0; i < first; ++i) {
+      SetMCR(McrEnableWcs(MCR_SAFE));
+      singleClock();
+      SetMCR(McrDisableWcs(MCR_SAFE));
+    }
     ucrMakeSafe();
-    enableMicrocodeRamOutputs();
-    setAH(0xFF); 
-    McrMakeSafe();
   }
 
   // Write up to 64 bytes to the slice for the given opcode, which must be
-  // in the range 128 ... 255.
-  void writeBytesToSlice(byte opcode, byte slice, byte *data, byte n) {
+  // in the range 128 ... 255, starting at slot first. The bytes are stride
+  // bytes apart at *data, which allows writing a slice directly from
+  // interleaved microcode.
+  void writeBytesToSlice(byte opcode, byte slice, byte *data, byte n, byte stride = 1, byte first = 0) {
+    wcsWritten(opcode);
     WriteIR(opcode, 0);
+    skipSlots(slice, first);
     disableMicrocodeRamOutputs();
 
     // Now RAM OE# is high and we can safely enable the slice transceiver
@@ -160,7 +227,7 @@ namespace PortPrivate {
 
     setAH(0x7F); setAL(0xFF);
     setDH(0x00);
-    for (int i = 0; i < n; ++i, ++data) {
+    for (int i = 0; i < n; ++i, data += stride) {
       setDL(reverse_byte(*data));
       SetMCR(McrEnableWcs(MCR_SAFE));
       singleClock();
@@ -171,6 +238,32 @@ namespace PortPrivate {
     enableMicrocodeRamOutputs();
   }
 
+  // Fill n slots of the slice for the given opcode (128 ... 255) with the
+  // same byte. This is writeBytesToSlice() with the data register loaded
+  // once instead of once per slot, so each slot costs only a clock.
+  void fillBytesInSlice(byte opcode, byte slice, byte value, byte n) {
+    wcsWritten(opcode);
+    WriteIR(opcode, 0);
+    disableMicrocodeRamOutputs();
+
+    ucrSetSlice(slice);
+    ucrSetDirectionWrite();
+    ucrEnableSliceTransceiver();
+    ucrSetRAMWrite();
+    syncUCR();
+
+    setAH(0x7F); setAL(0xFF);
+    setDH(0x00); setDL(reverse_byte(value));
+    for (int i = 0; i < n; ++i) {
+      SetMCR(McrEnableWcs(MCR_SAFE));
+      singleClock();
+      SetMCR(McrDisableWcs(MCR_SAFE));
+    }
+
+    ucrMakeSafe();
+    enableMicrocodeRamOutputs();
+  }
+
   // Read up to 64 bytes from the slice for the given opcode, which must be
   // in the range 128 ... 255.
   void readBytesFromSlice(byte opcode, byte slice, byte *data, byte n) {
@@ -196,9 +289,39 @@ namespace PortPrivate {
     ucrMakeSafe();
   }
 
+  // Compare up to 64 bytes from the slice for the given opcode, starting at
+  // slot first, with the bytes stride bytes apart at *data. Return the index
+  // of the first byte that differs, or n if they are all the same. A stride
+  // of 0 compares every slot with the same byte (verifies a fill).
+  byte verifyBytesInSlice(byte opcode, byte slice, byte *data, byte n, byte stride, byte first = 0) {
+    WriteIR(opcode, 0);
+    skipSlots(slice, first);
+    
+    ucrSetSlice(slice);
+    ucrSetDirectionRead();
+    ucrSetRAMRead();
+    ucrEnableSliceTransceiver();
+    syncUCR();
+
+    setAH(0xFF); setAL(0xFF);
+    byte i;
+    for (i = 0; i < n; ++i, data += stride) {
+      SetMCR(McrEnableWcs(MCR_SAFE));
+      singleClock();
+      byte b = reverse_byte(getBIR());
+      SetMCR(McrDisableWcs(MCR_SAFE));
+      if (b != *data) {
+        break;
+      }
+    }
+
+    ucrMakeSafe();
+    return i;
+  }
+
   // Set the four K (microcode) registers to their "safe" value.
   void kRegMakeSafe() {
-    internalWriteK(0xFF, 0xFF, 0xFF, 0xFF);
+    internalWriteKReversed(K_IDLE.r3, K_IDLE.r2, K_IDLE.r1, K_IDLE.r0);
     ucrMakeSafe();
   }
 
@@ -262,7 +385,76 @@ namespace PortPrivate {
   // means the YARC is in the reset state. This state lasts at least two seconds after power-on, much
   // longer than it takes the Nano to initialize. The Nano detects this and performs initialization
   // steps both before and after the YARC comes out of the POR state as can be seen in the code below.
+  //
+  // Originally all of this ran to completion before the main loop started, so the host's sync attempts
+  // timed out on every connect. Now postInit() does only the quick steps, and the rest is a sequence
+  // of bounded steps run by portTask(), each of which leaves the YARC safe. The initStatus bits (see
+  // port_decls.h) record which steps are complete and are reported to the host.
     
+  // The steps of background initialization, in order.
+  enum : byte {
+    STEP_EXERCISE_MEM8,
+    STEP_EXERCISE_MEM16,
+    STEP_EXERCISE_FLAGS,
+    STEP_WAIT_POR,
+    STEP_FILL_WCS,
+    STEP_FILL_MEM,
+    STEP_DIGEST,           // warm reset only
+    STEP_DONE,
+  };
+
+  constexpr int STEP_MILLIS = 10;             // approximate time limit per step
+  constexpr int POR_WAIT_MILLIS = 5000;       // POR# must clear within this
+  constexpr byte WCS_OPCODES_PER_STEP = 2;    // 512 slots
+  constexpr int MEM_WORDS_PER_STEP = 512;     // 1k bytes
+  constexpr unsigned short MEM_FILL = 0x1122;
+
+  byte initStep = STEP_DONE;
+  byte initStatus = 0;
+  byte sequenceOK;         // consecutive good passes in an exercise step
+  byte seqByte;            // test values for the exercise steps
+  ushort seqWord;
+  unsigned short fillNext; // next opcode or memory address to fill
+  unsigned long porDeadline;
+  byte digestStore;        // store and chunk being digested, warm reset only
+  unsigned short digestChunk;
+  unsigned short digestCrc;
+
+  // The EEPROM holds a record of the last image loaded by the host. For
+  // each store, there's the digest of the download file section, which
+  // the host uses to identify the image, and the digest of the store's
+  // content (see DigestChunk()) after it was loaded. On a warm reset,
+  // the content digests are computed again; if one matches, the store
+  // still holds the image and the host can skip downloading it.
+  constexpr int IMAGE_RECORD_ADDR = 0;
+  constexpr unsigned short IMAGE_RECORD_MAGIC = 0x5943; // "YC"
+
+  typedef struct imageRecord {
+    unsigned short magic;
+    byte saved;                           // bit per store, 1 << store
+    unsigned short fileDigest[N_STORES];
+    unsigned short contentDigest[N_STORES];
+  } ImageRecord;
+
+  ImageRecord imageRecord;
+
+  void readImageRecord() {
+    EEPROM.get(IMAGE_RECORD_ADDR, imageRecord);
+    if (imageRecord.magic != IMAGE_RECORD_MAGIC) {
+      memset(&imageRecord, 0, sizeof(imageRecord));
+      imageRecord.magic = IMAGE_RECORD_MAGIC;
+    }
+  }
+
+  // EEPROM.put() only writes the bytes that changed.
+  void writeImageRecord() {
+    EEPROM.put(IMAGE_RECORD_ADDR, imageRecord);
+  }
+
+  byte imageBit(byte store) {
+    return INIT_WCS_IMAGE << store;
+  }
+
   // Power on self test and initialization. Startup will hang if this function returns false.
 
   bool internalPostInit() {
@@ -283,78 +475,185 @@ namespace PortPrivate {
       panic(PANIC_POST, 3);
     }
 
-    // The following section of the code exercises some historial
-    // and some still-existing startup time problems in the hardware.
-    // Turn on the LED solid and loop until the behavior is reliable.
-    // The flags problem (third loop below) was fixed, I think, on
-    // 2023-09-24. Memory read and write are still [often] unreliable
-    // at power on and this unreliability disappears as the parts
-    // warm up over a period of less than a minute. This makes the
-    // problem(s) very difficult to troubleshoot.
-
-    pinMode(LED_PIN, OUTPUT);
-    digitalWrite(LED_PIN, HIGH);
-
-    // Read and write the first byte of YARC RAM as the quickest
-    // possible check for basic functionality. This or the following
-    // test (loop) still fails intermittently as of 2023-09-24. The
-    // SetDisplay shows a flickering counting pattern.
-
-    byte b1, b2, sequenceOK;
-    for (b1 = random(), sequenceOK = 0; sequenceOK < 100; ++b1) {
-      WriteMem8(0, &b1, 1);
-      ReadMem8(0, &b2, 1);
-      sequenceOK = (b1 == b2) ? 1 + sequenceOK : 0;
-      if ((millis() & 1024) == 0)
-        SetDisplay(b2 - b1);
-      else
-        SetDisplay(0x38);
+    readImageRecord();
+
+    // If the YARC is not in power-on reset, only the Nano was reset
+    // (e.g. by the host opening the serial port) and the YARC's RAMs
+    // hold whatever was last loaded. Skip the self tests and clears,
+    // which would destroy it, and check the content against the image
+    // record instead.
+    if (!YarcIsPowerOnReset()) {
+      initStep = STEP_DIGEST;
+      initStatus = INIT_POR_CLEAR | INIT_WCS | INIT_MEM;
+      digestStore = 0;
+      digestChunk = 0;
+      digestCrc = 0;
+      return true;
     }
 
-    // And the same for words
-    ushort w1, w2; 
-    for (w1 = random(), sequenceOK = 0; sequenceOK < 100; ++w1) {
-      WriteMem16(0, &w1, 1);
-      ReadMem16(0, &w2, 1);
-      sequenceOK = (w1 == w2) ? 1 + sequenceOK : 0;
-      ushort diff = w2 - w1;
-      diff = ((diff >> 8) & 0xFF) | (diff & 0xFF);
-      if ((millis() & 1024) == 0)
-        SetDisplay(b2 - b1);
-      else
-        SetDisplay(0xA0);
-    }
+    initStep = STEP_EXERCISE_MEM8;
+    initStatus = 0;
+    sequenceOK = 0;
+    seqByte = random();
+    return true;
+  }
 
-    // And finally for the flags register. This was fixed, I believe,
-    // by a change that was wired on 2023-09-24.
-
-    for (b1 = 0, sequenceOK = 0; sequenceOK < 100; b1 = (1 + b1) & 0x0F) {
-      WriteFlags(b1);
-      b2 = ReadFlags() & 0x0F;
-      sequenceOK = (b1 == b2) ? 1 + sequenceOK : 0;
-      if ((millis() & 1024) == 0)
-        SetDisplay(b2 - b1);
-      else
-        SetDisplay(0x66);
-    }
+  // The following exercises some historial and some still-existing
+  // startup time problems in the hardware. Each step loops until
+  // the behavior is reliable (100 consecutive good passes). The
+  // flags problem (third step) was fixed, I think, on 2023-09-24.
+  // Memory read and write are still [often] unreliable at power on
+  // and this unreliability disappears as the parts warm up over a
+  // period of less than a minute. This makes the problem(s) very
+  // difficult to troubleshoot. The display shows a flickering
+  // counting pattern while a step is failing.
+
+  // Read and write the first byte of YARC RAM as the quickest
+  // possible check for basic functionality. Return true when done.
+  bool exerciseMem8() {
+    byte b2;
+    WriteMem8(0, &seqByte, 1);
+    ReadMem8(0, &b2, 1);
+    sequenceOK = (seqByte == b2) ? 1 + sequenceOK : 0;
+    if ((millis() & 1024) == 0)
+      SetDisplay(b2 - seqByte);
+    else
+      SetDisplay(0x38);
+    ++seqByte;
+    return sequenceOK >= 100;
+  }
 
-    // That's it for exercising known or recent startup-time failure paths.
-    pinMode(LED_PIN, OUTPUT);
-    digitalWrite(LED_PIN, LOW);
+  // And the same for words
+  bool exerciseMem16() {
+    ushort w2;
+    WriteMem16(0, &seqWord, 1);
+    ReadMem16(0, &w2, 1);
+    sequenceOK = (seqWord == w2) ? 1 + sequenceOK : 0;
+    if ((millis() & 1024) == 0)
+      SetDisplay(StoLB(w2 - seqWord));
+    else
+      SetDisplay(0xA0);
+    ++seqWord;
+    return sequenceOK >= 100;
+  }
 
-    // ------------
-    // Wait for the power on reset signal to clear
-    for (long now = millis(), end = millis() + 5000; now < end; now = millis()) {
-      if (!YarcIsPowerOnReset()) break;
-    }
-    if (YarcIsPowerOnReset()) {
-      panic(PANIC_POST, 6); // POR# never went high
+  // And finally for the flags register. This was fixed, I believe,
+  // by a change that was wired on 2023-09-24.
+  bool exerciseFlags() {
+    WriteFlags(seqByte);
+    byte b2 = ReadFlags() & 0x0F;
+    sequenceOK = (seqByte == b2) ? 1 + sequenceOK : 0;
+    if ((millis() & 1024) == 0)
+      SetDisplay(b2 - seqByte);
+    else
+      SetDisplay(0x66);
+    seqByte = (1 + seqByte) & 0x0F;
+    return sequenceOK >= 100;
+  }
+
+  // Do one bounded step of background initialization and return
+  // true when initialization is complete.
+  bool internalInitStep() {
+    unsigned long start = millis();
+
+    switch (initStep) {
+    case STEP_EXERCISE_MEM8:
+      while (millis() - start < STEP_MILLIS) {
+        if (exerciseMem8()) {
+          initStep = STEP_EXERCISE_MEM16;
+          sequenceOK = 0;
+          seqWord = random();
+          break;
+        }
+      }
+      break;
+    case STEP_EXERCISE_MEM16:
+      while (millis() - start < STEP_MILLIS) {
+        if (exerciseMem16()) {
+          initStep = STEP_EXERCISE_FLAGS;
+          sequenceOK = 0;
+          seqByte = 0;
+          break;
+        }
+      }
+      break;
+    case STEP_EXERCISE_FLAGS:
+      while (millis() - start < STEP_MILLIS) {
+        if (exerciseFlags()) {
+          initStep = STEP_WAIT_POR;
+          initStatus |= INIT_SELF_TEST;
+          porDeadline = millis() + POR_WAIT_MILLIS;
+          break;
+        }
+      }
+      break;
+    case STEP_WAIT_POR:
+      if (!YarcIsPowerOnReset()) {
+        initStep = STEP_FILL_WCS;
+        initStatus |= INIT_POR_CLEAR;
+        fillNext = 0x80;
+      } else if (millis() > porDeadline) {
+        panic(PANIC_POST, 6); // POR# never went high
+      }
+      break;
+    case STEP_FILL_WCS:
+      // Clear the WCS to all 1s (no-op microcode), verifying
+      // one opcode in 16.
+      SetDisplay(0xC8);
+      for (byte n = 0; n < WCS_OPCODES_PER_STEP; ++n, ++fillNext) {
+        byte op = fillNext;
+        bool verify = (op & 0x0F) == 0;
+        for (byte slice = 0; slice < 4; ++slice) {
+          if (FillSlice(op, slice, 0xFF, 64, verify) != 64) {
+            panic(PANIC_UCODE_VERIFY, op);
+          }
+        }
+      }
+      if (fillNext > 0xFF) {
+        initStep = STEP_FILL_MEM;
+        initStatus |= INIT_WCS;
+        fillNext = 0;
+      }
+      break;
+    case STEP_FILL_MEM:
+      // Fill main memory with a recognizable pattern,
+      // verifying one word in 256.
+      SetDisplay(0xC9);
+      if (FillMem16(fillNext, MEM_FILL, MEM_WORDS_PER_STEP, 256) != MEM_WORDS_PER_STEP) {
+        panic(PANIC_MEM_VERIFY, 0);
+      }
+      fillNext += 2 * MEM_WORDS_PER_STEP;
+      if (fillNext >= END_MEM) {
+        initStep = STEP_DONE;
+        initStatus |= INIT_MEM | INIT_DONE;
+        callAfterPostInit();
+      }
+      break;
+    case STEP_DIGEST:
+      SetDisplay(0xCA);
+      while (millis() - start < STEP_MILLIS) {
+        digestCrc = DigestChunk(digestStore, digestChunk, digestCrc);
+        if (++digestChunk < StoreChunks(digestStore)) {
+          continue;
+        }
+        if ((imageRecord.saved & (1 << digestStore)) != 0
+            && digestCrc == imageRecord.contentDigest[digestStore]) {
+          initStatus |= imageBit(digestStore);
+        }
+        digestChunk = 0;
+        digestCrc = 0;
+        if (++digestStore == N_STORES) {
+          initStep = STEP_DONE;
+          initStatus |= INIT_DONE;
+          callAfterPostInit();
+          break;
+        }
+      }
+      break;
     }
-    
-    // Now do some other tests, which can panic.
-    callAfterPostInit();
-    internalMakeSafe();
-    return true;
+
+    MakeSafe();
+    return initStep == STEP_DONE;
   }
 } // End of PortPrivate section
 
@@ -364,14 +663,60 @@ void portInit() {
   PortPrivate::internalPortInit();
 }
 
+// Run background initialization until it's complete, then idle.
 int portTask() {
-  return 171;
+  if (PortPrivate::initStep == PortPrivate::STEP_DONE) {
+    return 171;
+  }
+  PortPrivate::internalInitStep();
+  return 0;
 }
 
 bool postInit() {
   return PortPrivate::internalPostInit();
 }
 
+bool PortIsReady() {
+  return PortPrivate::initStep == PortPrivate::STEP_DONE;
+}
+
+byte PortInitStatus() {
+  return PortPrivate::initStatus;
+}
+
+// Record that the host has loaded a store from a download file section
+// with the given digest. The caller computes the digest of the store's
+// content a few chunks at a time with DigestChunk(), since the whole
+// store takes up to a couple of seconds (for the ALU RAM).
+void PortSaveImage(byte store, unsigned short fileDigest, unsigned short contentDigest) {
+  PortPrivate::imageRecord.saved |= (1 << store);
+  PortPrivate::imageRecord.fileDigest[store] = fileDigest;
+  PortPrivate::imageRecord.contentDigest[store] = contentDigest;
+  PortPrivate::writeImageRecord();
+  PortPrivate::initStatus |= PortPrivate::imageBit(store);
+}
+
+// Return the file digest of the image in a store, or 0 if the store
+// is not known to hold the image.
+unsigned short PortGetImage(byte store) {
+  if ((PortPrivate::initStatus & PortPrivate::imageBit(store)) == 0) {
+    return 0;
+  }
+  return PortPrivate::imageRecord.fileDigest[store];
+}
+
+// The store is being altered, so it no longer holds the image. The store
+// writers in yarc_utils.h and the slice writers above call this, so any
+// firmware path that writes through them (host commands, COST) is
+// covered; writes within scratch memory, which isn't part of the image,
+// don't call it. Code that writes a store with its own bus cycles or by
+// running the YARC must call it too. The EEPROM isn't changed; the
+// content digest will no longer match after a warm reset unless the store
+// is restored.
+void PortInvalidateImage(byte store) {
+  PortPrivate::initStatus &= ~PortPrivate::imageBit(store);
+}
+
 // Interface to the 4 write-only bus registers: setAH
 // (address high), AL, DH (data high), DL.
   
@@ -412,6 +757,10 @@ void SingleClock() {
   PortPrivate::singleClock();
 }
 
+void ClockBurst(unsigned short n) {
+  PortPrivate::clockBurst(n);
+}
+
 // Public interface to the write-only 8-bit Display Register (DR)
 
 void SetDisplay(byte b) {
@@ -422,6 +771,25 @@ void MakeSafe() {
   PortPrivate::internalMakeSafe();
 }
 
+// Save and restore the write-only registers the host's next clock
+// depends on: K, the bus registers, and the MCR. Firmware that must
+// use the bus between clocks the host gives (the trace spill) brackets
+// the use with these. The YARC must be stopped.
+void PortSaveBus(BusState *s) {
+  for (byte i = 0; i < 4; ++i) {
+    s->kReversed[i] = PortPrivate::kShadowReversed[i];
+    s->adhl[i] = PortPrivate::adhlShadow[i];
+  }
+  s->mcr = PortPrivate::getMCR();
+}
+
+void PortRestoreBus(const BusState *s) {
+  PortPrivate::internalWriteKReversed(s->kReversed[3], s->kReversed[2],
+                                      s->kReversed[1], s->kReversed[0]);
+  SetADHL(s->adhl[0], s->adhl[1], s->adhl[2], s->adhl[3]);
+  PortPrivate::setMCR(s->mcr);
+}
+
 // Set the bus registers (AH, AL, DH, DL)
 void SetADHL(byte ah, byte al, byte dh, byte dl) {
   SetAH(ah);
@@ -433,11 +801,15 @@ void SetADHL(byte ah, byte al, byte dh, byte dl) {
 // Set the YARC to RUN mode. Do not alter the clock settings, i.e.
 // don't start the clock running.
 void RunYARC(unsigned short r0, unsigned short r1, unsigned short r2) {
+  UpdateCounters();
   PortPrivate::internalRunYARC(r0, r1, r2);
+  UpdateCounters();
 }
 
 void StopYARC() {
+  UpdateCounters();
   PortPrivate::internalStopYARC();
+  UpdateCounters();
 }
 
 // These are convenience functions. Making them functions allows me to stash them
@@ -451,38 +823,11 @@ namespace PortPrivate {
     SerialReset();
   }
 
+  // Called when background initialization is complete.
   void callAfterPostInit() {
-    union {
-      byte bytes[64];
-      unsigned short words[32];
-    };
-
-    constexpr short BCOUNT = sizeof(bytes);
-    constexpr short WCOUNT = sizeof(words) >> 1;
-
-    for (byte b = 0; b < BCOUNT; ++b) {
-      bytes[b] = 0xFF;      
-    }
-
-    for (byte n = 0, b = 0x80; b != 0; b++, n++) {
-      SetDisplay(n);
-      WriteSlice(b, 0, bytes, BCOUNT, true); 
-      WriteSlice(b, 1, bytes, BCOUNT, true); 
-      WriteSlice(b, 2, bytes, BCOUNT, true); 
-      WriteSlice(b, 3, bytes, BCOUNT, true); 
-    }
-
-    for (byte w = 0; w < WCOUNT; ++w) {
-      words[w] = 0x1122;
-    }
-
-    for (unsigned short addr = 0; addr < END_MEM; addr += BCOUNT) {
-      SetDisplay(addr >> 8);
-      WriteMem16(addr, words, WCOUNT);
-    }
-
     SetDisplay(0xCC);
     enableMicrocodeRamOutputs();
+    InstallHelpers();
     MakeSafe();
   }
 }
@@ -451,6 +451,21 @@ namespace PortPrivate {
     nanoTogglePulse(RawNanoClock);
   }
 
+  // Generate n clock pulses as fast as the Nano can. The decoder address
+  // is set once, so each pulse is just the two writes to PORTC and the
+  // loop overhead, about 8 clocks (0.5us). This is well within the YARC's
+  // design clock rate.
+  void clockBurst(unsigned short n) {
+    PORTC &= ~BOTH_DECODERS;
+    nanoPutPort(portSelect, getAddressFromRegisterID(RawNanoClock));
+
+    constexpr byte decoderEnablePin = getDecoderSelectPinFromRegisterID(RawNanoClock);
+    while (n-- != 0) {
+      PORTC = PORTC | decoderEnablePin;
+      PORTC = PORTC & ~decoderEnablePin;
+    }
+  }
+
   void setMCR(byte mcr) {
     nanoSetMode(portData, OUTPUT);
     nanoPutPort(portData, mcr);
@@ -458,21 +473,28 @@ namespace PortPrivate {
   }
 
   // Interface to the 4 write-only bus registers: setAH
-  // (address high), AL, DH (data high), DL.
+  // (address high), AL, DH (data high), DL. The registers
+  // can't be read back, so we shadow them (see PortSaveBus()).
+
+  byte adhlShadow[4];
   
   inline void setAH(byte b) {
+    adhlShadow[0] = b;
     nanoSetRegister(AddrRegisterHigh, b);
   }
   
   inline void setAL(byte b) {
+    adhlShadow[1] = b;
     nanoSetRegister(AddrRegisterLow, b);  
   }
   
   inline void setDH(byte b) {
+    adhlShadow[2] = b;
     nanoSetRegister(DataRegisterHigh, b);
   }
   
   inline void setDL(byte b) {
+    adhlShadow[3] = b;
     nanoSetRegister(DataRegisterLow, b);
   }
   
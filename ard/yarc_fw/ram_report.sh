@@ -0,0 +1,32 @@
+#!/bin/sh
+# Copyright (c) Jeff Berkowitz 2023. All rights reserved.
+#
+# Report the static RAM of a firmware build. Run it after a build with
+# the ELF file, e.g. from the output directory of
+#   arduino-cli compile --fqbn arduino:avr:nano --output-dir build .
+# It prints the scratch arena budgets from small_task_decls.h and their
+# worst case (the arena size), the variables of 8 bytes or more, and the
+# totals from avr-size. The 2k of RAM also holds the stack, which the
+# heartbeat message doesn't report; keep the total "Data" well under it.
+
+elf=${1:?usage: ram_report.sh yarc_fw.ino.elf}
+dir=$(dirname "$0")
+
+awk '/constexpr unsigned short SCRATCH_[A-Z]*_BYTES = [0-9]+;/ {
+       name = $4; sub(/;/, "", $6); n[name] = $6
+       printf "%-24s %5d\n", name, $6
+     }
+     END {
+       both = n["SCRATCH_SHARED_BYTES"] + n["SCRATCH_TEST_BYTES"]
+       worst = (n["SCRATCH_COMMAND_BYTES"] > both) ? n["SCRATCH_COMMAND_BYTES"] : both
+       printf "%-24s %5d (command, or shared + test)\n", "arena worst case", worst
+     }' "$dir/small_task_decls.h"
+
+echo
+echo "Variables of 8 bytes or more:"
+avr-nm -C -S -t d --size-sort -r "$elf" | awk '$3 ~ /^[bBdD]$/ && $2 + 0 >= 8 {
+  size = $2 + 0; $1 = $2 = $3 = ""; sub(/^ +/, ""); printf "%5d %s\n", size, $0
+}'
+
+echo
+avr-size -C --mcu=atmega328p "$elf"
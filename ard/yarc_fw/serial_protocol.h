@@ -1,7 +1,7 @@
 // Copyright (c) Jeff Berkowitz 2021, 2023. All Rights Reserved
 // Automatically generated by Protogen - do not edit
 
-#define PROTOCOL_VERSION 11
+#define PROTOCOL_VERSION 32
 #define ACK(CMD) ((byte)~CMD)
 
 #define STCMD_BASE           0xE0
@@ -16,6 +16,7 @@
 #define STCMD_POLL           0xE9
 #define STCMD_SVC_RESPONSE   0xEA
 #define STCMD_DEBUG          0xEB
+#define STCMD_EXT            0xEC
 #define STCMD_GET_VER        0xEE
 #define STCMD_SYNC           0xEF
 #define STCMD_SET_ARH        0xF0
@@ -31,6 +32,31 @@
 #define STCMD_WR_ALU         0xFD
 #define STCMD_RD_ALU         0xFE
 
+#define STEXT_COST_RESULTS   0x01
+#define STEXT_WR_OPCODE      0x02
+#define STEXT_FILL           0x03
+#define STEXT_INIT_STATUS    0x04
+#define STEXT_SAVE_IMAGE     0x05
+#define STEXT_GET_IMAGE      0x06
+#define STEXT_GEN_ALU        0x07
+#define STEXT_RD_ALU3        0x08
+#define STEXT_VERIFY         0x09
+#define STEXT_DIGEST         0x0A
+#define STEXT_CHUNK_DIGESTS  0x0B
+#define STEXT_CLOCK_BURST    0x0C
+#define STEXT_BURST_STATUS   0x0D
+#define STEXT_RUN_UNTIL      0x0E
+#define STEXT_RUN_RESULT     0x0F
+#define STEXT_TRACE_CTL      0x10
+#define STEXT_TRACE_READ     0x11
+#define STEXT_COUNTERS       0x12
+#define STEXT_RD_SCATTER     0x13
+#define STEXT_MEM_SEARCH     0x14
+#define STEXT_MEM_COMPARE    0x15
+#define STEXT_FRAMED         0x16
+#define STEXT_WR_MEM_BYTES   0x17
+#define STEXT_RUN_SCRIPT     0x18
+
 #define STERR_NOSYNC         0x80
 #define STERR_PASSIVE        0x81
 #define STERR_ONECLOCK       0x82
@@ -20,12 +20,19 @@ namespace SerialPrivate {
 
   // Each ring buffer is a typical circular queue - since head == tail means "empty",
   // we can't use the last entry. So the queue can hold (RING_BUF_SIZE - 1) elements.
-  // Since the head and tail are byte variables, the RING_BUF_SIZE must be <= 127. I'm
-  // not sure that e.g. len() would work correctly for 128. The ring size does not have
-  // to be a power of 2.
+  // The size must be a power of 2 so the indexes can wrap with a mask, and since the
+  // head and tail are byte variables it must be at most 128.
+  //
+  // Bytes can be moved one at a time (peek, consume, put) or in bulk. The bulk
+  // functions work on spans, the contiguous runs of data or free space that end
+  // at the end of the body, so they can be copied with memcpy() and written to
+  // or read from the serial port in one call.
 
   constexpr int RING_BUF_SIZE = 16;
   constexpr int RING_MAX = (RING_BUF_SIZE - 1);
+  constexpr byte RING_MASK = (RING_BUF_SIZE - 1);
+  static_assert((RING_BUF_SIZE & RING_MASK) == 0 && RING_BUF_SIZE <= 128,
+                "ring size must be a power of 2 no larger than 128");
   
   typedef struct ring {
     byte head;  // Add at the head
@@ -42,37 +49,23 @@ namespace SerialPrivate {
   RING* const xmtBuf = &transmitBuffer;
 
   // Return the number of data bytes in ring r.
-  byte len(RING* const r) {
-    int result = (r->head >= r->tail) ? r->head - r->tail : (r->head + RING_BUF_SIZE) - r->tail;
-    if (result < 0 || result >= RING_BUF_SIZE) {
-      panic(PANIC_SERIAL_NUMBERED, 1);
-    }   
-    return result;
+  inline byte len(RING* const r) {
+    return (r->head - r->tail) & RING_MASK;
   }
 
   // Return the available space in r
-  byte avail(RING* const r) {
-    byte result = (RING_BUF_SIZE - len(r)) - 1;
-    if (result < 0 || result >= RING_BUF_SIZE) {
-      panic(PANIC_SERIAL_NUMBERED, 2);
-    }
-    return result;
+  inline byte avail(RING* const r) {
+    return RING_MAX - len(r);
   }
 
   // Consume n bytes from the ring buffer r. In this
   // design, reading and consuming are separated.
-  // panic: n < 0
+  // panic: n > len(r)
   void consume(RING* const r, byte n) {
-    if (n < 0) {
-      panic(PANIC_SERIAL_NUMBERED, 3);
-    }
-    if (n == 0) {
-      return;
-    }
     if (n > len(r)) {
       panic(PANIC_SERIAL_NUMBERED, 4);
     }
-    r->tail = (r->tail + n) % RING_BUF_SIZE;
+    r->tail = (r->tail + n) & RING_MASK;
   }
 
   // Return the next byte in the ring buffer. The state
@@ -85,6 +78,34 @@ namespace SerialPrivate {
     return r->body[r->tail];
   }
 
+  // Set *bp to the first data byte in r and return the number of
+  // data bytes that follow it contiguously, which may be 0. There
+  // may be more data at the start of the body; consume() the span
+  // and call again.
+  byte readSpan(RING* const r, byte **bp) {
+    *bp = &r->body[r->tail];
+    return (r->head >= r->tail) ? r->head - r->tail : RING_BUF_SIZE - r->tail;
+  }
+
+  // Set *bp to the first free byte in r and return the number of
+  // free bytes that follow it contiguously, which may be 0. After
+  // storing bytes in the span, call produce() to add them.
+  byte writeSpan(RING* const r, byte **bp) {
+    *bp = &r->body[r->head];
+    byte n = avail(r);
+    byte toEnd = RING_BUF_SIZE - r->head;
+    return (n < toEnd) ? n : toEnd;
+  }
+
+  // Add the n bytes stored in the write span to r.
+  // panic: n > avail(r)
+  void produce(RING* const r, byte n) {
+    if (n > avail(r)) {
+      panic(PANIC_SERIAL_NUMBERED, 8);
+    }
+    r->head = (r->head + n) & RING_MASK;
+  }
+
   // Returns up to bMax bytes from the ring buffer, if any.
   // Does not change the state of the ring buffer.
   //
@@ -97,17 +118,42 @@ namespace SerialPrivate {
   // returns the number of bytes placed at *bp, which may be
   // 0 and will not exceed bMax.
   byte copy(RING* const r, byte *bp, int bMax) {
-    if (bMax < 0) {
-      panic(PANIC_SERIAL_NUMBERED, 6);
+    byte n = len(r);
+    if (bMax < n) {
+      n = (bMax < 0) ? 0 : bMax;
     }
-    
-    int n = len(r);
-    int i;
-    for (i = 0; i < n && i < bMax; ++i) {
-      *bp = r->body[(r->tail + i) % RING_BUF_SIZE];
-      bp++;
+    byte first = RING_BUF_SIZE - r->tail;
+    if (first > n) {
+      first = n;
     }
-    return i;
+    memcpy(bp, &r->body[r->tail], first);
+    memcpy(bp + first, r->body, n - first);
+    return n;
+  }
+
+  // Remove up to bMax bytes from the ring buffer to *bp.
+  // Return the number of bytes removed, which may be 0.
+  byte take(RING* const r, byte *bp, int bMax) {
+    byte n = copy(r, bp, bMax);
+    r->tail = (r->tail + n) & RING_MASK;
+    return n;
+  }
+
+  // Add up to n bytes from *bp to the ring buffer. Return
+  // the number of bytes added, which may be 0.
+  byte putBytes(RING* const r, const byte *bp, int n) {
+    byte added = 0;
+    byte *span;
+    byte room;
+    while (added < n && (room = writeSpan(r, &span)) != 0) {
+      if (room > n - added) {
+        room = n - added;
+      }
+      memcpy(span, bp + added, room);
+      produce(r, room);
+      added += room;
+    }
+    return added;
   }
   
   // Return true if the ring buffer r is full.
@@ -122,7 +168,7 @@ namespace SerialPrivate {
       panic(PANIC_SERIAL_NUMBERED, 7);
     }
     r->body[r->head] = b;
-    r->head = (r->head + 1) % RING_BUF_SIZE;
+    r->head = (r->head + 1) & RING_MASK;
   }
 
   // === end of the "lower layer" (ring buffer implementation) ===
@@ -183,6 +229,18 @@ namespace SerialPrivate {
     return n < len(rcvBuf);   // XXX should be <= ?
   }
 
+  // Send up to n bytes from *bp without interpretation. Return
+  // the number sent, which is 0 if the transmit ring is full.
+  byte sendBytes(const byte *bp, int n) {
+    return putBytes(xmtBuf, bp, n);
+  }
+
+  // Receive up to n bytes to *bp. Return the number received,
+  // which is 0 if the receive ring is empty.
+  byte receiveBytes(byte *bp, int n) {
+    return take(rcvBuf, bp, n);
+  }
+
   // Send an ack for the byte b, which must be
   // a valid command byte
   // panic: b is not a command byte
@@ -202,6 +260,64 @@ namespace SerialPrivate {
     send(STERR_BADCMD);
   }
 
+  // === Verification policy ===
+
+  // The host chooses how downloaded data is verified for the session
+  // (see stExtVerify()). With VERIFY_FULL every write command's data is
+  // read back; with VERIFY_SAMPLED every VERIFY_SAMPLE_INTERVAL'th write
+  // command is. With VERIFY_DIGEST and VERIFY_NONE nothing is read back;
+  // under VERIFY_DIGEST, the host checks digests of the stores afterward
+  // (see stExtDigest()). Failures don't panic; they're counted, and the
+  // first is remembered, until the host collects them.
+  enum : byte {
+    VERIFY_FULL       = 0,
+    VERIFY_SAMPLED    = 1,
+    VERIFY_DIGEST     = 2,
+    VERIFY_NONE       = 3,
+    N_VERIFY_POLICIES = 4,
+    VERIFY_UNCHANGED  = 0xFF, // in the verify command
+  };
+
+  constexpr byte VERIFY_SAMPLE_INTERVAL = 8;
+
+  byte verifyPolicy = VERIFY_FULL;
+  byte verifyWrites;              // write commands, for sampling
+  byte verifyFailures;            // saturates at 255
+  byte verifyFailStore;           // of the first failure
+  unsigned short verifyFailAddr;  // of the first failure
+
+  // Return true if the data of the next write command should be read back.
+  bool verifyNextWrite() {
+    switch (verifyPolicy) {
+    case VERIFY_FULL:
+      return true;
+    case VERIFY_SAMPLED:
+      return (verifyWrites++ % VERIFY_SAMPLE_INTERVAL) == 0;
+    default:
+      return false;
+    }
+  }
+
+  // Record a verification failure. The address is the byte address for
+  // main memory and ALU RAM, and the opcode (high byte), slice (bits 7:6)
+  // and slot (bits 5:0) for the WCS.
+  void verifyFailed(byte store, unsigned short addr) {
+    if (verifyFailures == 0) {
+      verifyFailStore = store;
+      verifyFailAddr = addr;
+    }
+    if (verifyFailures < 0xFF) {
+      verifyFailures++;
+    }
+  }
+
+  // Start a new session with full verification.
+  void verifyReset() {
+    verifyPolicy = VERIFY_FULL;
+    verifyWrites = 0;
+    verifyFailures = 0;
+  }
+
   // === Poll buffer support ===
 
   // Command handlers interpret newly-arrived commands. They may
@@ -215,7 +331,8 @@ namespace SerialPrivate {
   // generate data for the host, allowing use of e.g. xnprintf().
   // It's 259 to allow for a command byte, a count byte, 255 data
   // bytes, an unneeded terminating nul should it be written by a
-  // library function, and a guard byte at the end.
+  // library function, and a guard byte at the end. It's allocated
+  // in the scratch arena (see small_tasks.h) only while in use.
   //
   // XXX - In fact, everything must be sent and received in 64-byte
   // XXX - "chunkies" to prevent overrun errors on the serial line.
@@ -236,47 +353,309 @@ namespace SerialPrivate {
   typedef struct pollBuffer {
     int remaining;
     int next;
-    bool inuse;
     byte cmd[MAX_CMD_SIZE];
     byte buf[POLL_BUF_SIZE];
   } PollBuffer;
 
-  PollBuffer uniquePollBuffer;
-  PollBuffer* const pb = &uniquePollBuffer;
+  static_assert(sizeof(PollBuffer) <= SCRATCH_COMMAND_BYTES, "poll buffer exceeds scratch budget");
 
-  // Allocate the poll buffer.
+  // Commands that don't use the YARC, and so may run beside the COST
+  // tests, take only the first part of the buffer, which fits next to
+  // the test data in the scratch arena (see small_tasks.h).
+  constexpr int POLL_BUF_HEADER = sizeof(PollBuffer) - POLL_BUF_SIZE;
+  constexpr int POLL_BUF_SHARED_SIZE = SCRATCH_SHARED_BYTES - POLL_BUF_HEADER;
+  constexpr int POLL_BUF_SHARED_MAX_DATA = POLL_BUF_SHARED_SIZE - 1;
+
+  PollBuffer* pb;     // valid only while pbInUse
+  bool pbInUse;
+  unsigned short pbMark;
+  int pbLast;         // the guard byte
+
+  // Allocate the poll buffer with size bytes of buf[]. If the COST test
+  // data is in the way, COST drops it.
   // panic: poll buffer in use.
-  void allocPollBuffer() {
-    if (pb->inuse) {
+  void allocPollBuffer(int size = POLL_BUF_SIZE) {
+    if (pbInUse) {
       panic(PANIC_SERIAL_NUMBERED, 0xD);
     }
-    pb->inuse = true;
+    if (POLL_BUF_HEADER + size > ScratchAvailable()) {
+      costDropTestData();
+    }
+    pbMark = ScratchMark(SCRATCH_COMMAND);
+    pb = (PollBuffer*) ScratchAlloc(SCRATCH_COMMAND, POLL_BUF_HEADER + size);
+    pbInUse = true;
+    pbLast = size - 1;
     pb->remaining = 0;
     pb->next = 0;
-    pb->buf[POLL_BUF_LAST] = GUARD_BYTE;
+    pb->buf[pbLast] = GUARD_BYTE;
   }
 
   // Free the poll buffer
   // panic: poll buffer is not in use
   // panic: the guard byte was overwritten.
   void freePollBuffer() {
-    if (!pb->inuse) {
+    if (!pbInUse) {
       panic(PANIC_SERIAL_NUMBERED, 0xE);
     }
-    if (pb->buf[POLL_BUF_LAST] != GUARD_BYTE) {
+    if (pb->buf[pbLast] != GUARD_BYTE) {
       panic(PANIC_SERIAL_NUMBERED, 0xA);
     }
     pb->next = 0;
     pb->remaining = 0;
-    pb->inuse = false;
+    pbInUse = false;
+    ScratchRelease(SCRATCH_COMMAND, pbMark);
+  }
+
+  // Receive as many of the remaining bytes of a transfer from the
+  // host into the poll buffer as have arrived.
+  void receiveToPollBuffer() {
+    byte n = receiveBytes(&pb->buf[pb->next], pb->remaining);
+    pb->next += n;
+    pb->remaining -= n;
+  }
+
+  // Send as many of the remaining bytes of a response in the poll
+  // buffer as there is room for.
+  void sendFromPollBuffer() {
+    byte n = sendBytes(&pb->buf[pb->next], pb->remaining);
+    pb->next += n;
+    pb->remaining -= n;
   }
 
   void internalSerialReset() {
     stProtoUnsync();
-    pb->inuse = false;
-    pb->remaining = 0;
-    pb->next = 0;
-    pb->buf[POLL_BUF_LAST] = GUARD_BYTE;
+    if (pbInUse) {
+      pbInUse = false;
+      ScratchRelease(SCRATCH_COMMAND, pbMark);
+    }
+  }
+
+  // === Framed mode ===
+
+  // In framed mode (see stExtFramed()), the bytes of the protocol are
+  // carried in frames between the rings and the serial line. A frame is
+  // a start byte, a control byte, a length, up to FRAME_MAX_DATA data
+  // bytes, and the CRC-16/XMODEM of the control, length and data bytes,
+  // MSB first. The control byte holds the frame type and, for data and
+  // ack frames, the sequence bit of the data frame. Each direction is
+  // stop and wait: the sender keeps its data frame until it's acked,
+  // and sends it again after a nak or FRAME_RESEND_MILLIS. We don't ack
+  // a data frame from the host until its bytes are in the receive ring,
+  // which is the flow control that allows the host to send more than 64
+  // bytes at a time. A resync frame resets both directions and puts the
+  // command layer in the UNSYNC state, so the host can recover from any
+  // error in a few milliseconds without resetting the Nano.
+  constexpr byte FRAME_START = 0x7E;
+  constexpr byte FRAME_MAX_DATA = 32;
+  constexpr byte FRAME_OVERHEAD = 5;
+  constexpr byte FRAME_RESEND_MILLIS = 50;
+  constexpr byte FRAME_RECEIVE_MILLIS = 10; // max gap within a frame
+
+  enum : byte {
+    FRAME_DATA   = 0x00,
+    FRAME_ACK    = 0x40,
+    FRAME_NAK    = 0x80,
+    FRAME_RESYNC = 0xC0,
+    FRAME_TYPE   = 0xC0, // mask
+    FRAME_SEQ    = 0x01, // mask
+  };
+
+  // States of the frame receiver
+  enum : byte {
+    RCV_START = 0, RCV_CONTROL, RCV_LENGTH, RCV_DATA, RCV_CRC_HI, RCV_CRC_LO,
+  };
+
+  // Framed mode is on in the last two states; see serialTask().
+  enum : byte {
+    FRAMED_OFF = 0, FRAMED_ENTERING, FRAMED_ON, FRAMED_LEAVING,
+  };
+
+  byte framed = FRAMED_OFF;
+
+  byte frameRcvState;
+  byte frameRcvControl;
+  byte frameRcvLength;
+  byte frameRcvCount;
+  unsigned short frameRcvCrc;
+  unsigned long frameRcvMillis;
+  byte frameRcvSeq;               // expected sequence bit of the next data frame
+  byte frameRcvNext;              // next byte of frameRcvData to deliver
+  byte frameRcvData[FRAME_MAX_DATA];
+  byte frameRcvHeld;              // bytes of frameRcvData not yet delivered
+  bool frameRcvStoring;           // this frame's data is going to frameRcvData
+  bool frameRcvAckDue;            // ack the last data frame when it's delivered
+
+  byte frameXmtSeq;
+  byte frameXmtLength;
+  bool frameXmtSent;              // sent and awaiting an ack
+  unsigned long frameXmtMillis;
+  byte frameXmtData[FRAME_MAX_DATA];
+  byte frameControlPending;       // ack, nak, or resync to send, or 0xFF
+  constexpr byte FRAME_NONE = 0xFF;
+
+  void frameReset() {
+    frameRcvState = RCV_START;
+    frameRcvSeq = 0;
+    frameRcvHeld = 0;
+    frameRcvAckDue = false;
+    frameXmtSeq = 0;
+    frameXmtLength = 0;
+    frameXmtSent = false;
+    frameControlPending = FRAME_NONE;
+  }
+
+  // Write a frame. The caller has checked there is room for it.
+  void frameWrite(byte control, byte *data, byte n) {
+    unsigned short crc = Crc16(Crc16(0, control), n);
+    for (byte i = 0; i < n; ++i) {
+      crc = Crc16(crc, data[i]);
+    }
+    Serial.write(FRAME_START);
+    Serial.write(control);
+    Serial.write(n);
+    Serial.write(data, n);
+    Serial.write(StoHB(crc));
+    Serial.write(StoLB(crc));
+  }
+
+  // A frame arrived with a good CRC.
+  void frameReceived() {
+    byte seq = frameRcvControl & FRAME_SEQ;
+    switch (frameRcvControl & FRAME_TYPE) {
+    case FRAME_DATA:
+      if (!frameRcvStoring || frameRcvAckDue) {
+        break; // a resend of the frame we're delivering; ack it when done
+      }
+      if (seq == frameRcvSeq) {
+        frameRcvSeq ^= FRAME_SEQ;
+        frameRcvHeld = frameRcvLength;
+        frameRcvNext = 0;
+        frameRcvAckDue = true;
+      } else {
+        frameControlPending = FRAME_ACK | seq; // our ack was lost
+      }
+      break;
+    case FRAME_ACK:
+      if (frameXmtSent && seq == frameXmtSeq) {
+        frameXmtSent = false;
+        frameXmtLength = 0;
+        frameXmtSeq ^= FRAME_SEQ;
+      }
+      break;
+    case FRAME_NAK:
+      if (frameXmtSent) {
+        frameXmtMillis = millis() - FRAME_RESEND_MILLIS; // resend now
+      }
+      break;
+    case FRAME_RESYNC:
+      internalSerialReset();
+      frameReset();
+      frameControlPending = FRAME_RESYNC;
+      framed = FRAMED_ON;
+      break;
+    }
+  }
+
+  // Run the frame receiver on the bytes available from the serial line.
+  // Data bytes are stored only if the previous data frame has been
+  // delivered; otherwise they're just checked.
+  void frameReceive() {
+    if (frameRcvState != RCV_START && millis() - frameRcvMillis > FRAME_RECEIVE_MILLIS) {
+      frameRcvState = RCV_START; // lost bytes; the sender will resend
+    }
+    while (Serial.available() && frameControlPending == FRAME_NONE) {
+      byte b = Serial.read();
+      frameRcvMillis = millis();
+      switch (frameRcvState) {
+      case RCV_START:
+        if (b == FRAME_START) {
+          frameRcvState = RCV_CONTROL;
+        }
+        break;
+      case RCV_CONTROL:
+        frameRcvControl = b;
+        frameRcvCrc = Crc16(0, b);
+        frameRcvState = RCV_LENGTH;
+        break;
+      case RCV_LENGTH:
+        if (b > FRAME_MAX_DATA || (b != 0 && (frameRcvControl & FRAME_TYPE) != FRAME_DATA)) {
+          frameRcvState = RCV_START;
+          break;
+        }
+        frameRcvLength = b;
+        frameRcvCount = 0;
+        frameRcvStoring = (frameRcvHeld == 0);
+        frameRcvCrc = Crc16(frameRcvCrc, b);
+        frameRcvState = (b == 0) ? RCV_CRC_HI : RCV_DATA;
+        break;
+      case RCV_DATA:
+        if (frameRcvStoring) {
+          frameRcvData[frameRcvCount] = b;
+        }
+        frameRcvCrc = Crc16(frameRcvCrc, b);
+        if (++frameRcvCount == frameRcvLength) {
+          frameRcvState = RCV_CRC_HI;
+        }
+        break;
+      case RCV_CRC_HI:
+        frameRcvCrc ^= (unsigned short)b << 8;
+        frameRcvState = RCV_CRC_LO;
+        break;
+      case RCV_CRC_LO:
+        frameRcvState = RCV_START;
+        if ((frameRcvCrc ^ b) != 0) {
+          frameControlPending = FRAME_NAK;
+        } else {
+          frameReceived();
+        }
+        break;
+      }
+    }
+
+    // Deliver the data of the last frame and ack it when it's all in.
+    byte n = putBytes(rcvBuf, &frameRcvData[frameRcvNext], frameRcvHeld);
+    frameRcvNext += n;
+    frameRcvHeld -= n;
+    if (frameRcvAckDue && frameRcvHeld == 0 && frameControlPending == FRAME_NONE) {
+      frameControlPending = FRAME_ACK | (frameRcvSeq ^ FRAME_SEQ);
+      frameRcvAckDue = false;
+    }
+  }
+
+  // Move bytes from the transmit ring into the data frame and send
+  // the frame when it's full or the ring has stopped filling. Send
+  // pending control frames first.
+  void frameTransmit() {
+    if (frameControlPending != FRAME_NONE) {
+      if (Serial.availableForWrite() < FRAME_OVERHEAD) {
+        return;
+      }
+      frameWrite(frameControlPending, 0, 0);
+      frameControlPending = FRAME_NONE;
+    }
+
+    if (frameXmtSent) {
+      if (millis() - frameXmtMillis >= FRAME_RESEND_MILLIS
+          && Serial.availableForWrite() >= frameXmtLength + FRAME_OVERHEAD) {
+        frameWrite(FRAME_DATA | frameXmtSeq, frameXmtData, frameXmtLength);
+        frameXmtMillis = millis();
+      }
+      return;
+    }
+
+    if (framed == FRAMED_LEAVING && frameXmtLength == 0 && len(xmtBuf) == 0) {
+      framed = FRAMED_OFF; // the host has the ack of the command
+      return;
+    }
+
+    byte added = take(xmtBuf, &frameXmtData[frameXmtLength], FRAME_MAX_DATA - frameXmtLength);
+    frameXmtLength += added;
+    if (frameXmtLength != 0 && (added == 0 || frameXmtLength == FRAME_MAX_DATA)
+        && Serial.availableForWrite() >= frameXmtLength + FRAME_OVERHEAD) {
+      frameWrite(FRAME_DATA | frameXmtSeq, frameXmtData, frameXmtLength);
+      frameXmtSent = true;
+      frameXmtMillis = millis();
+    }
   }
 
   // === end of the "middle layer" ===
@@ -306,6 +685,10 @@ namespace SerialPrivate {
       }
       sendNak(b);
       return STATE_DESYNCHRONIZING;
+    } else if (framed >= FRAMED_ON && len(xmtBuf) != 0) {
+      // In framed mode, the NAK goes out only when the frame layer
+      // takes it from the transmit ring. Don't clear it first.
+      return STATE_DESYNCHRONIZING;
     } else {
       // There's no need to consume() here either because this
       // will reset the ring buffer:
@@ -350,6 +733,7 @@ namespace SerialPrivate {
     r0 = BtoS(cmd[2], cmd[3]);
     r1 = BtoS(cmd[4], cmd[5]);
     r2 = BtoS(cmd[6], cmd[7]);
+    PortInvalidateImage(STORE_MEM); // the program may store to memory
     RunYARC(r0, r1, r2);
     SetClockControl(clkCtrl);
     sendAck(b);
@@ -457,11 +841,7 @@ namespace SerialPrivate {
   // as much of the poll buffer as possible. If finished,
   // free the buffer and clear the inProgress handler.
   State pollResponseInProgress() {
-    while (canSend(1) && pb->remaining > 0) {
-      send(pb->buf[pb->next]);
-      pb->remaining--;
-      pb->next++;
-    }
+    sendFromPollBuffer();
     if (pb->remaining == 0) {
       freePollBuffer();
       inProgress = 0;              
@@ -479,8 +859,8 @@ namespace SerialPrivate {
       return state;
     }
 
-    allocPollBuffer();
-    pb->remaining = logGetPending((char *)pb->buf, POLL_BUF_MAX_DATA);
+    allocPollBuffer(POLL_BUF_SHARED_SIZE);
+    pb->remaining = logGetPending((char *)pb->buf, POLL_BUF_SHARED_MAX_DATA);
     send(pb->remaining); // byte count follows ack back to host
     pb->next = 0;
     inProgress = pollResponseInProgress;
@@ -504,6 +884,7 @@ namespace SerialPrivate {
   // Sync command - just ack it and set the display register
   State stSync(RING* const r, byte b) {
     consume(r, 1);
+    verifyReset();
     sendAck(b);
     SetDisplay(0xC2);
     return STATE_READY;
@@ -528,6 +909,8 @@ namespace SerialPrivate {
   State stOneClk(RING* const r, byte b) {
     consume(r, 1);
     SingleClock();
+    TraceCycle();
+    CountClocks(1);
     sendAck(b);
     send(GetBIR());
     return state;
@@ -543,14 +926,18 @@ namespace SerialPrivate {
   // Collect a buffer of words to write and then write them. Only one value
   // is allowed for the count, CHUNK_SIZE == 64 bytes.
   State wrMemInProgress() {
-    while (canReceive(1) && pb->remaining > 0) {
-      pb->buf[pb->next] = peek(rcvBuf);
-      consume(rcvBuf, 1);
-      pb->next++;
-      pb->remaining--;
-    }
+    receiveToPollBuffer();
     if (pb->remaining == 0) {
-      WriteMem16(BtoS(pb->cmd[1], pb->cmd[2]), (unsigned short*) pb->buf, CHUNK_SIZE/2);
+      unsigned short addr = BtoS(pb->cmd[1], pb->cmd[2]);
+      unsigned short *data = (unsigned short*) pb->buf;
+      if (verifyNextWrite()) {
+        int bad = WriteCheckMem16(addr, data, CHUNK_SIZE/2);
+        if (bad != CHUNK_SIZE/2) {
+          verifyFailed(STORE_MEM, addr + 2 * bad);
+        }
+      } else {
+        WriteMem16(addr, data, CHUNK_SIZE/2);
+      }
       freePollBuffer();
       inProgress = 0;              
     }
@@ -570,6 +957,7 @@ namespace SerialPrivate {
     pb->cmd[2] &= ~(CHUNK_SIZE-1);
     pb->remaining = pb->cmd[3];
     pb->next = 0;
+    PortInvalidateImage(STORE_MEM);
     inProgress = wrMemInProgress;
     sendAck(b);
     return wrMemInProgress();
@@ -577,11 +965,7 @@ namespace SerialPrivate {
   
   // We have read a buffer of words from memory. Send them to the host.
   State rdMemInProgress() {
-    while (canSend(1) && pb->remaining > 0) {
-      send(pb->buf[pb->next]);
-      pb->next++;
-      pb->remaining--;
-    }
+    sendFromPollBuffer();
     if (pb->remaining == 0) {
       freePollBuffer();
       inProgress = 0;              
@@ -611,17 +995,19 @@ namespace SerialPrivate {
   }
 
   // Collect the bytes to write in the poll buffer to minimize the
-  // number of calls to WriteSlice(), which is slow. WriteSlice()
-  // panics if the write doesn't verify correctly.
+  // number of calls to WriteSlice(), which is slow. The write is
+  // verified according to the verification policy.
   State writeSliceInProgress() {
-    while (canReceive(1) && pb->remaining > 0) {
-      pb->buf[pb->next] = peek(rcvBuf);
-      consume(rcvBuf, 1);
-      pb->next++;
-      pb->remaining--;
-    }
+    receiveToPollBuffer();
     if (pb->remaining == 0) {
-      WriteSlice(pb->cmd[1], pb->cmd[2], pb->buf, pb->cmd[3], true);
+      if (verifyNextWrite()) {
+        int bad = WriteSlice(pb->cmd[1], pb->cmd[2], pb->buf, pb->cmd[3], false);
+        if (bad != pb->cmd[3]) {
+          verifyFailed(STORE_WCS, BtoS(pb->cmd[1], (pb->cmd[2] << 6) | bad));
+        }
+      } else {
+        WriteSliceFast(pb->cmd[1], pb->cmd[2], pb->buf, pb->cmd[3]);
+      }
       freePollBuffer();
       inProgress = 0;              
     }
@@ -641,6 +1027,7 @@ namespace SerialPrivate {
     }
     pb->remaining = pb->cmd[3];
     pb->next = 0;
+    PortInvalidateImage(STORE_WCS);
     inProgress = writeSliceInProgress;
     sendAck(b);
     return writeSliceInProgress();
@@ -648,11 +1035,7 @@ namespace SerialPrivate {
 
   // Send the bytes from the poll buffer
   State readSliceInProgress() {
-    while (canSend(1) && pb->remaining > 0) {
-      send(pb->buf[pb->next]);
-      pb->next++;
-      pb->remaining--;
-    }
+    sendFromPollBuffer();
     if (pb->remaining == 0) {
       freePollBuffer();
       inProgress = 0;              
@@ -680,17 +1063,21 @@ namespace SerialPrivate {
   }
 
   State writeAluInProgress() {
-    while (canReceive(1) && pb->remaining > 0) {
-      pb->buf[pb->next] = peek(rcvBuf);
-      consume(rcvBuf, 1);
-      pb->next++;
-      pb->remaining--;
-    }
+    receiveToPollBuffer();
     if (pb->remaining == 0) {
       // IMPORTANT: as of 5/19/2023, this calls the combined write/verify
       // function, and the downloader no longer needs to separately read
-      // back each of the three RAMs. WriteCheckALU() panics on failure.
-      WriteCheckALU(BtoS(pb->cmd[1], pb->cmd[2]), pb->buf, pb->cmd[3]);
+      // back each of the three RAMs. Failures are recorded according to
+      // the verification policy.
+      unsigned short addr = BtoS(pb->cmd[1], pb->cmd[2]);
+      if (verifyNextWrite()) {
+        int bad = WriteCheckALU(addr, pb->buf, pb->cmd[3], false);
+        if (bad != pb->cmd[3]) {
+          verifyFailed(STORE_ALU, addr + bad);
+        }
+      } else {
+        WriteALUFast(addr, pb->buf, pb->cmd[3]);
+      }
       freePollBuffer();
       inProgress = 0;              
     }
@@ -714,17 +1101,14 @@ namespace SerialPrivate {
     } 
     pb->remaining = pb->cmd[3];
     pb->next = 0;
+    PortInvalidateImage(STORE_ALU);
     inProgress = writeAluInProgress;
     sendAck(b);
     return writeAluInProgress();
   }
 
   State readAluInProgress() {
-    while (canSend(1) && pb->remaining > 0) {
-      send(pb->buf[pb->next]);
-      pb->next++;
-      pb->remaining--;
-    }
+    sendFromPollBuffer();
     if (pb->remaining == 0) {
       freePollBuffer();
       inProgress = 0;              
@@ -782,51 +1166,896 @@ namespace SerialPrivate {
   typedef struct commandData {
     CommandHandler handler;     // handler function
     byte length;                // length of fixed part of command, 1 or more
+    bool usesYarc;              // preempts COST (see costPreempt())
   } CommandData;
 
+  // === Extended commands ===
+  // The one-byte command space is nearly exhausted, so newer commands are
+  // subcommands of STCMD_EXT. The subcommand byte follows the command byte
+  // and indexes a second jump table. The length in that table includes the
+  // STCMD_EXT and subcommand bytes. Extended command handlers are passed
+  // STCMD_EXT as their command byte so sendAck() works as usual, and they
+  // are responsible for consuming the subcommand byte.
+
+  // Return the COST results table (see costGetResults() in cost_task.h)
+  // as a counted response.
+  State stExtCostResults(RING* const r, byte b) {
+    allocPollBuffer(POLL_BUF_SHARED_SIZE);
+    copy(r, pb->cmd, 2);
+    consume(r, 2);
+    sendAck(b);
+    pb->remaining = costGetResults(pb->buf, POLL_BUF_SHARED_MAX_DATA);
+    pb->next = 0;
+    inProgress = pollResponseInProgress;
+    send(pb->remaining);
+    return pollResponseInProgress();
+  }
+
+  // Collect the microcode for an opcode in the poll buffer. Unframed, the
+  // data is limited to one 64-byte chunk like every other transfer, since
+  // the serial driver's 64-byte receive buffer is all that holds bytes
+  // that arrive while other tasks run; framed, it may be a whole opcode,
+  // because the frame layer paces the host. The write is verified according
+  // to the verification policy.
+  State wrOpcodeInProgress() {
+    receiveToPollBuffer();
+    if (pb->remaining == 0) {
+      byte opcode = pb->cmd[2];
+      byte first = pb->cmd[3];
+      byte nWords = pb->cmd[4];
+      if (verifyNextWrite()) {
+        // The index of a bad byte is slot-major; see WriteOpcode().
+        int bad = WriteOpcode(opcode, first, pb->buf, nWords, false, false);
+        if (bad != 4 * nWords) {
+          verifyFailed(STORE_WCS, BtoS(opcode, ((bad & 3) << 6) | (first + (bad >> 2))));
+        }
+      } else {
+        WriteOpcodeFast(opcode, first, pb->buf, nWords, false);
+      }
+      freePollBuffer();
+      inProgress = 0;              
+    }
+    return state;
+  }
+
+  // Write and verify all four slices of an opcode. The arguments after
+  // the subcommand are the opcode, the first slot (0 to 63), and the number
+  // of 32-bit microcode words (1 to 16, or 1 to 64 in framed mode). Four
+  // bytes per word follow, slot by slot, K0 first, as in the microcode
+  // section of the download file.
+  State stExtWrOpcode(RING* const r, byte b) {
+    allocPollBuffer();
+    copy(r, pb->cmd, 5);
+    consume(r, 5);
+    byte maxWords = (framed == FRAMED_ON) ? CHUNK_SIZE : CHUNK_SIZE / 4;
+    if (pb->cmd[2] < 0x80 || pb->cmd[4] == 0 || pb->cmd[4] > maxWords
+        || pb->cmd[3] + pb->cmd[4] > CHUNK_SIZE) {
+      freePollBuffer();
+      return stBadCmd(r, b);
+    }
+    pb->remaining = 4 * pb->cmd[4];
+    pb->next = 0;
+    PortInvalidateImage(STORE_WCS);
+    inProgress = wrOpcodeInProgress;
+    sendAck(b);
+    return wrOpcodeInProgress();
+  }
+
+  // Fill an entire store with a constant. The arguments after the
+  // subcommand are the store (0 = WCS, 1 = main memory, 2 = ALU RAM), the
+  // value (big-endian; only the low byte is used for the WCS and ALU RAM),
+  // and a sampling interval for verification, 0 for none or N to verify
+  // every Nth opcode, word, or byte. The result byte is 0 for success or
+  // 1 if verification failed. This can take a couple of seconds.
+  State stExtFill(RING* const r, byte b) {
+    byte cmd[6];
+    copy(r, cmd, 6);
+    consume(r, 6);
+    byte store = cmd[2];
+    unsigned short value = BtoS(cmd[3], cmd[4]);
+    byte verifyEvery = cmd[5];
+
+    bool ok;
+    switch (store) {
+    case STORE_WCS:
+      ok = FillWCS(StoLB(value), verifyEvery) == 128;
+      break;
+    case STORE_MEM:
+      ok = FillMem16(0, value, END_MEM / 2, verifyEvery) == END_MEM / 2;
+      break;
+    case STORE_ALU:
+      ok = FillALU(0, StoLB(value), END_ALU_MEM, verifyEvery) == END_ALU_MEM;
+      break;
+    default:
+      return stBadCmd(r, b);
+    }
+    PortInvalidateImage(store);
+    MakeSafe();
+    sendAck(b);
+    send(ok ? 0 : 1);
+    return state;
+  }
+
+  // Return the background initialization status bits (see port_decls.h)
+  // as the result byte. The host waits for all of them before starting
+  // a download.
+  State stExtInitStatus(RING* const r, byte b) {
+    consume(r, 2);
+    sendAck(b);
+    send(PortInitStatus());
+    return state;
+  }
+
+  // Digest a few chunks of the store per call, so the other tasks run
+  // while the whole store is digested. pb->next is the next chunk and the
+  // digest so far is in the first two bytes of the buffer. The COST stays
+  // suspended until we're done, since it may write the store.
+  constexpr byte SAVE_IMAGE_CHUNKS_PER_CALL = 4;
+
+  State saveImageInProgress() {
+    costPreempt();
+    const byte store = pb->cmd[2];
+    const unsigned short nChunks = StoreChunks(store);
+    unsigned short crc = BtoS(pb->buf[0], pb->buf[1]);
+    for (byte i = 0; i < SAVE_IMAGE_CHUNKS_PER_CALL && pb->next < nChunks; ++i) {
+      crc = DigestChunk(store, pb->next++, crc);
+    }
+    MakeSafe();
+    pb->buf[0] = StoHB(crc);
+    pb->buf[1] = StoLB(crc);
+    if (pb->next < nChunks || !canSend(1)) {
+      return state;
+    }
+
+    PortSaveImage(store, BtoS(pb->cmd[3], pb->cmd[4]), crc);
+    freePollBuffer();
+    inProgress = 0;
+    send(0);
+    return state;
+  }
+
+  // Record that a store was loaded from a download file section. The
+  // arguments after the subcommand are the store (as for fill) and the
+  // host's digest of the file section, big-endian. The Nano saves this
+  // with a digest of the store's content in EEPROM, so the host can skip
+  // the download after a warm reset (see port_task.h). The result byte
+  // is always 0; it follows the ack when the digest is done, which can
+  // take a couple of seconds.
+  State stExtSaveImage(RING* const r, byte b) {
+    if (!canSend(2)) {
+      return state; // come back when the response fits
+    }
+    allocPollBuffer(3); // the digest so far and the guard
+    copy(r, pb->cmd, 5);
+    consume(r, 5);
+    if (pb->cmd[2] >= N_STORES) {
+      freePollBuffer();
+      return stBadCmd(r, b);
+    }
+    pb->buf[0] = pb->buf[1] = 0;
+    pb->next = 0;
+    inProgress = saveImageInProgress;
+    sendAck(b);
+    return saveImageInProgress();
+  }
+
+  // Return the file digest recorded for the store given after the
+  // subcommand as a counted response of 2 bytes, big-endian. The digest
+  // is 0 if the store doesn't hold the recorded image.
+  State stExtGetImage(RING* const r, byte b) {
+    if (!canSend(4)) {
+      return state; // come back when the response fits
+    }
+    byte cmd[3];
+    copy(r, cmd, 3);
+    consume(r, 3);
+    if (cmd[2] >= N_STORES) {
+      return stBadCmd(r, b);
+    }
+    unsigned short digest = PortGetImage(cmd[2]);
+    sendAck(b);
+    send(2);
+    send(StoHB(digest));
+    send(StoLB(digest));
+    return state;
+  }
+
+  // Collect the 16 ALU function descriptors, then generate the tables.
+  // GenerateALU() writes all 8k bytes of ALU RAM and reads bytes back from
+  // all three RAMs according to the verification policy: every byte, or a
+  // sample. This can take a couple of seconds.
+  State genAluInProgress() {
+    receiveToPollBuffer();
+    if (pb->remaining == 0) {
+      unsigned short verifyEvery = 0;
+      if (verifyPolicy == VERIFY_FULL) {
+        verifyEvery = 1;
+      } else if (verifyPolicy == VERIFY_SAMPLED) {
+        verifyEvery = VERIFY_SAMPLE_INTERVAL;
+      }
+      int bad = GenerateALU(pb->buf, verifyEvery);
+      if (bad != END_ALU_MEM) {
+        verifyFailed(STORE_ALU, bad);
+      }
+      MakeSafe();
+      freePollBuffer();
+      inProgress = 0;
+    }
+    return state;
+  }
+
+  // Generate the ALU RAM tables on the Nano (see GenerateALU() in
+  // yarc_utils.h). The argument after the subcommand is a count, which
+  // must be 16; the count is followed by one descriptor byte for each of
+  // the 16 ALU operations. Operations with descriptor ALU_FN_NONE (0) are
+  // left unchanged, so the host can download them in the usual way.
+  State stExtGenALU(RING* const r, byte b) {
+    allocPollBuffer();
+    copy(r, pb->cmd, 3);
+    consume(r, 3);
+    if (pb->cmd[2] != 16) {
+      freePollBuffer();
+      return stBadCmd(r, b);
+    }
+    pb->remaining = pb->cmd[2];
+    pb->next = 0;
+    PortInvalidateImage(STORE_ALU);
+    inProgress = genAluInProgress;
+    sendAck(b);
+    return genAluInProgress();
+  }
+
+  // Read all three ALU RAMs in one pass. The arguments after the
+  // subcommand are the address high, address low, and count, which
+  // must be 64 at an address aligned on a 64-byte boundary as for
+  // stRdALU(). The response is counted: 192 bytes, three per address
+  // in RAM order (see ReadALU3() in yarc_utils.h).
+  State stExtRdALU3(RING* const r, byte b) {
+    allocPollBuffer();
+    copy(r, pb->cmd, 5);
+    consume(r, 5);
+    unsigned int addr = BtoS(pb->cmd[2], pb->cmd[3]);
+    unsigned int n = pb->cmd[4];
+    if (addr > 0x1FFF || n != CHUNK_SIZE || (addr&0x3F) || addr + n > 0x2000) {
+      freePollBuffer();
+      return stBadCmd(r, b);
+    }
+    ReadALU3(addr, pb->buf, n);
+    pb->remaining = 3 * n;
+    pb->next = 0;
+    inProgress = readAluInProgress;
+    sendAck(b);
+    send(pb->remaining);
+    return readAluInProgress();
+  }
+
+  // Set the verification policy for the rest of the session and collect
+  // the verification failures. The argument after the subcommand is the
+  // policy, or VERIFY_UNCHANGED. The response is counted: 4 bytes, which
+  // are the number of failures since the last verify command (saturating
+  // at 255), and the store and address (big-endian) of the first failure.
+  // The failures are cleared.
+  State stExtVerify(RING* const r, byte b) {
+    if (!canSend(6)) {
+      return state; // come back when the response fits
+    }
+    byte cmd[3];
+    copy(r, cmd, 3);
+    consume(r, 3);
+    byte policy = cmd[2];
+    if (policy >= N_VERIFY_POLICIES && policy != VERIFY_UNCHANGED) {
+      return stBadCmd(r, b);
+    }
+    sendAck(b);
+    send(4);
+    send(verifyFailures);
+    send(verifyFailures ? verifyFailStore : 0);
+    send(verifyFailures ? StoHB(verifyFailAddr) : 0);
+    send(verifyFailures ? StoLB(verifyFailAddr) : 0);
+    verifyFailures = 0;
+    if (policy != VERIFY_UNCHANGED) {
+      verifyPolicy = policy;
+      verifyWrites = 0;
+    }
+    return state;
+  }
+
+  // Return the digest of a run of chunks of a store (see DigestChunk() in
+  // yarc_utils.h) as a counted response of 2 bytes, big-endian. The
+  // arguments after the subcommand are the store, the first chunk, and the
+  // number of chunks, 1 to 64; both are big-endian. The host compares the
+  // digest with one computed from its file to verify a download.
+  State stExtDigest(RING* const r, byte b) {
+    if (!canSend(4)) {
+      return state; // come back when the response fits
+    }
+    byte cmd[7];
+    copy(r, cmd, 7);
+    consume(r, 7);
+    byte store = cmd[2];
+    unsigned short first = BtoS(cmd[3], cmd[4]);
+    unsigned short n = BtoS(cmd[5], cmd[6]);
+    if (store >= N_STORES || n == 0 || n > 64 || first + n > StoreChunks(store)) {
+      return stBadCmd(r, b);
+    }
+    unsigned short crc = 0;
+    for (unsigned short chunk = first; chunk < first + n; ++chunk) {
+      crc = DigestChunk(store, chunk, crc);
+    }
+    MakeSafe();
+    sendAck(b);
+    send(2);
+    send(StoHB(crc));
+    send(StoLB(crc));
+    return state;
+  }
+
+  // Return a table of the digests of individual chunks of a store, so
+  // the host can download only the chunks that differ from its file. The
+  // arguments after the subcommand are the store, the first chunk (big-
+  // endian), and the number of chunks, 1 to 64. The response is counted:
+  // two bytes per chunk, big-endian. Each chunk's digest is computed from
+  // 0 (see DigestChunk() in yarc_utils.h); the scratch opcode slices of
+  // the WCS and the chunks of scratch memory have digest 0.
+  State stExtChunkDigests(RING* const r, byte b) {
+    allocPollBuffer();
+    copy(r, pb->cmd, 6);
+    consume(r, 6);
+    byte store = pb->cmd[2];
+    unsigned short first = BtoS(pb->cmd[3], pb->cmd[4]);
+    byte n = pb->cmd[5];
+    if (store >= N_STORES || n == 0 || n > 64 || first + n > StoreChunks(store)) {
+      freePollBuffer();
+      return stBadCmd(r, b);
+    }
+    for (byte i = 0; i < n; ++i) {
+      unsigned short crc = DigestChunk(store, first + i, 0);
+      pb->buf[2 * i] = StoHB(crc);
+      pb->buf[2 * i + 1] = StoLB(crc);
+    }
+    MakeSafe();
+    pb->remaining = 2 * n;
+    pb->next = 0;
+    inProgress = pollResponseInProgress;
+    sendAck(b);
+    send(pb->remaining);
+    return pollResponseInProgress();
+  }
+
+  // Start a burst of an exact number of clocks (see StartClockBurst()).
+  // The arguments after the subcommand are the count, 4 bytes, and the
+  // period in microseconds, 2 bytes, both big-endian. A period of 0 is
+  // as fast as possible and a count of 0 cancels a burst. The runtime
+  // task delivers the clocks after we return; the host polls the burst
+  // status to learn when it's done.
+  State stExtClockBurst(RING* const r, byte b) {
+    byte cmd[8];
+    copy(r, cmd, 8);
+    consume(r, 8);
+    unsigned long count = ((unsigned long)BtoS(cmd[2], cmd[3]) << 16) | BtoS(cmd[4], cmd[5]);
+    StartClockBurst(count, BtoS(cmd[6], cmd[7]));
+    sendAck(b);
+    return state;
+  }
+
+  // Return the number of clocks remaining in the current burst as a
+  // counted response of 4 bytes, big-endian. The burst is done when
+  // the count is 0.
+  State stExtBurstStatus(RING* const r, byte b) {
+    if (!canSend(6)) {
+      return state; // come back when the response fits
+    }
+    consume(r, 2);
+    unsigned long remaining = ClockBurstRemaining();
+    sendAck(b);
+    send(4);
+    send(StoHB(remaining >> 16));
+    send(StoLB(remaining >> 16));
+    send(StoHB(remaining));
+    send(StoLB(remaining));
+    return state;
+  }
+
+  // Clock the YARC until a stop condition holds (see StartRunUntil()).
+  // The arguments after the subcommand are the stop conditions, the BIR
+  // value and mask, and the clock budget. The budget is 3 bytes, big-
+  // endian, so the command fits in MAX_CMD_SIZE. The host polls the run
+  // result to learn when and why the run stopped.
+  State stExtRunUntil(RING* const r, byte b) {
+    byte cmd[8];
+    copy(r, cmd, 8);
+    consume(r, 8);
+    unsigned long budget = ((unsigned long)cmd[5] << 16) | BtoS(cmd[6], cmd[7]);
+    StartRunUntil(cmd[2], cmd[3], cmd[4], budget);
+    sendAck(b);
+    return state;
+  }
+
+  // Return the result of the most recent burst or run-until as a counted
+  // response of 7 bytes: the stop reason (RUN_STOP_NONE while the clocks
+  // are running), the number of clocks delivered (4 bytes, big-endian),
+  // and the BIR and MCR at the stop.
+  State stExtRunResult(RING* const r, byte b) {
+    if (!canSend(9)) {
+      return state; // come back when the response fits
+    }
+    consume(r, 2);
+    unsigned long clocks;
+    byte bir, mcr;
+    byte reason = GetRunResult(&clocks, &bir, &mcr);
+    sendAck(b);
+    send(7);
+    send(reason);
+    send(StoHB(clocks >> 16));
+    send(StoLB(clocks >> 16));
+    send(StoHB(clocks));
+    send(StoLB(clocks));
+    send(bir);
+    send(mcr);
+    return state;
+  }
+
+  // Turn the bus trace on (1, which clears it) or off (0), or leave it
+  // unchanged (TRACE_UNCHANGED). The response is counted: 4 bytes, the
+  // number of entries waiting to be read and the number of entries lost,
+  // both big-endian.
+  constexpr byte TRACE_UNCHANGED = 0xFF;
+
+  State stExtTraceCtl(RING* const r, byte b) {
+    if (!canSend(6)) {
+      return state; // come back when the response fits
+    }
+    byte cmd[3];
+    copy(r, cmd, 3);
+    consume(r, 3);
+    if (cmd[2] > 1 && cmd[2] != TRACE_UNCHANGED) {
+      return stBadCmd(r, b);
+    }
+    if (cmd[2] != TRACE_UNCHANGED) {
+      TraceControl(cmd[2] == 1);
+    }
+    unsigned short pending = TracePending();
+    unsigned short lost = TraceLost();
+    sendAck(b);
+    send(4);
+    send(StoHB(pending));
+    send(StoLB(pending));
+    send(StoHB(lost));
+    send(StoLB(lost));
+    return state;
+  }
+
+  // Send up to the requested number of the oldest trace entries (1 to
+  // 64) as a counted response, two bytes (BIR, MCR) per entry, and
+  // remove them from the trace. The count may be 0; see TraceRead().
+  State stExtTraceRead(RING* const r, byte b) {
+    allocPollBuffer();
+    copy(r, pb->cmd, 3);
+    consume(r, 3);
+    byte n = pb->cmd[2];
+    if (n == 0 || n > 64) {
+      freePollBuffer();
+      return stBadCmd(r, b);
+    }
+    pb->remaining = 2 * TraceRead(pb->buf, n);
+    pb->next = 0;
+    inProgress = pollResponseInProgress;
+    sendAck(b);
+    send(pb->remaining);
+    return pollResponseInProgress();
+  }
+
+  // Big-endian store of a 32-bit value, for responses.
+  byte *putLong(byte *bp, unsigned long v) {
+    *bp++ = StoHB(v >> 16);
+    *bp++ = StoLB(v >> 16);
+    *bp++ = StoHB(v);
+    *bp++ = StoLB(v);
+    return bp;
+  }
+
+  byte *putShort(byte *bp, unsigned short v) {
+    *bp++ = StoHB(v);
+    *bp++ = StoLB(v);
+    return bp;
+  }
+
+  // Return the execution counters (see GetCounters()) as a counted
+  // response of 14 bytes, all big-endian: clocks (4), run milliseconds
+  // (4), fast clock milliseconds (4) and service requests (2). If the
+  // argument after the subcommand is 1, the counters are then cleared.
+  State stExtCounters(RING* const r, byte b) {
+    allocPollBuffer(POLL_BUF_SHARED_SIZE);
+    copy(r, pb->cmd, 3);
+    consume(r, 3);
+    if (pb->cmd[2] > 1) {
+      freePollBuffer();
+      return stBadCmd(r, b);
+    }
+    ExecCounters c;
+    GetCounters(&c);
+    if (pb->cmd[2] == 1) {
+      ClearCounters();
+    }
+    byte *bp = pb->buf;
+    bp = putLong(bp, c.clocks);
+    bp = putLong(bp, c.runMillis);
+    bp = putLong(bp, c.fastMillis);
+    bp = putShort(bp, c.serviceRequests);
+    pb->remaining = bp - pb->buf;
+    pb->next = 0;
+    inProgress = pollResponseInProgress;
+    sendAck(b);
+    send(pb->remaining);
+    return pollResponseInProgress();
+  }
+
+  // Scatter-gather memory read. The ranges arrive as counted bytes, three
+  // per range: address (big-endian) and length. Once they're all here we
+  // read each range and send the bytes in order as a counted response.
+  // The total can't exceed the poll buffer. An invalid range list gets
+  // a response count of 0, since the command has already been ack'd.
+  constexpr byte SCATTER_MAX_RANGES = 16;
+
+  State rdScatterInProgress() {
+    receiveToPollBuffer();
+    if (pb->remaining > 0 || !canSend(1)) {
+      return state;
+    }
+
+    byte ranges[3 * SCATTER_MAX_RANGES];
+    byte nRanges = pb->cmd[2] / 3;
+    memcpy(ranges, pb->buf, 3 * nRanges);
+
+    int total = 0;
+    for (byte i = 0; i < nRanges; ++i) {
+      unsigned short addr = BtoS(ranges[3 * i], ranges[3 * i + 1]);
+      byte len = ranges[3 * i + 2];
+      if (len == 0 || addr >= END_MEM || END_MEM - addr < len) {
+        total = -1;
+        break;
+      }
+      total += len;
+    }
+    if (total < 0 || total > POLL_BUF_MAX_DATA) {
+      total = 0;
+    } else {
+      byte *bp = pb->buf;
+      for (byte i = 0; i < nRanges; ++i) {
+        byte len = ranges[3 * i + 2];
+        ReadMem8(BtoS(ranges[3 * i], ranges[3 * i + 1]), bp, len);
+        bp += len;
+      }
+    }
+
+    pb->remaining = total;
+    pb->next = 0;
+    inProgress = pollResponseInProgress;
+    send(pb->remaining);
+    return pollResponseInProgress();
+  }
+
+  // The argument after the subcommand is the count of range bytes that
+  // follow, three per range, 1 to 16 ranges.
+  State stExtRdScatter(RING* const r, byte b) {
+    allocPollBuffer();
+    copy(r, pb->cmd, 3);
+    consume(r, 3);
+    byte count = pb->cmd[2];
+    if (count == 0 || count % 3 != 0 || count > 3 * SCATTER_MAX_RANGES) {
+      freePollBuffer();
+      return stBadCmd(r, b);
+    }
+    pb->remaining = count;
+    pb->next = 0;
+    inProgress = rdScatterInProgress;
+    sendAck(b);
+    return rdScatterInProgress();
+  }
+
+  // Memory search. The parameters arrive as 9 counted bytes: flags (bit 0
+  // for words), start, end, value and mask, all big-endian. The response
+  // is counted: the addresses of up to 32 matches, big-endian (see
+  // SearchMem() in yarc_utils.h). If there are 32, the host searches
+  // again from the address after the last one.
+  constexpr byte SEARCH_PARAM_SIZE = 9;
+  constexpr byte SEARCH_MAX_FOUND = 32;
+  constexpr byte SEARCH_WORDS = 0x01;
+
+  State memSearchInProgress() {
+    receiveToPollBuffer();
+    if (pb->remaining > 0 || !canSend(1)) {
+      return state;
+    }
+
+    byte *p = pb->buf;
+    bool words = (p[0] & SEARCH_WORDS) != 0;
+    unsigned short start = BtoS(p[1], p[2]);
+    unsigned short end = BtoS(p[3], p[4]);
+    unsigned short value = BtoS(p[5], p[6]);
+    unsigned short mask = BtoS(p[7], p[8]);
+    int n = 0;
+    if (start <= end && end <= END_MEM) {
+      unsigned short *found = (unsigned short *)pb->buf;
+      n = SearchMem(start, end, value, mask, words, found, SEARCH_MAX_FOUND);
+      for (int i = 0; i < n; ++i) {
+        unsigned short addr = found[i];
+        pb->buf[2 * i] = StoHB(addr);
+        pb->buf[2 * i + 1] = StoLB(addr);
+      }
+    }
+
+    pb->remaining = 2 * n;
+    pb->next = 0;
+    inProgress = pollResponseInProgress;
+    send(pb->remaining);
+    return pollResponseInProgress();
+  }
+
+  // The argument after the subcommand is the count of parameter bytes,
+  // which must be 9. An invalid range gets a response count of 0.
+  State stExtMemSearch(RING* const r, byte b) {
+    allocPollBuffer();
+    copy(r, pb->cmd, 3);
+    consume(r, 3);
+    if (pb->cmd[2] != SEARCH_PARAM_SIZE) {
+      freePollBuffer();
+      return stBadCmd(r, b);
+    }
+    pb->remaining = SEARCH_PARAM_SIZE;
+    pb->next = 0;
+    inProgress = memSearchInProgress;
+    sendAck(b);
+    return memSearchInProgress();
+  }
+
+  // Memory compare. The arguments after the subcommand are the addresses
+  // of two ranges and their length, all big-endian. The response is
+  // counted: the number of mismatched bytes (saturating at 0xFFFF)
+  // followed by the offsets of up to 8 of the first mismatches, all
+  // big-endian (see CompareMem() in yarc_utils.h).
+  constexpr byte COMPARE_MAX_DIFFS = 8;
+
+  State stExtMemCompare(RING* const r, byte b) {
+    allocPollBuffer();
+    copy(r, pb->cmd, 8);
+    consume(r, 8);
+    unsigned short a = BtoS(pb->cmd[2], pb->cmd[3]);
+    unsigned short bb = BtoS(pb->cmd[4], pb->cmd[5]);
+    unsigned short n = BtoS(pb->cmd[6], pb->cmd[7]);
+    if (a > END_MEM || bb > END_MEM || END_MEM - a < n || END_MEM - bb < n) {
+      freePollBuffer();
+      return stBadCmd(r, b);
+    }
+    unsigned short diffs[COMPARE_MAX_DIFFS];
+    unsigned short nDiffs = CompareMem(a, bb, n, diffs, COMPARE_MAX_DIFFS);
+    byte nStored = (nDiffs < COMPARE_MAX_DIFFS) ? nDiffs : COMPARE_MAX_DIFFS;
+    pb->buf[0] = StoHB(nDiffs);
+    pb->buf[1] = StoLB(nDiffs);
+    for (byte i = 0; i < nStored; ++i) {
+      pb->buf[2 + 2 * i] = StoHB(diffs[i]);
+      pb->buf[3 + 2 * i] = StoLB(diffs[i]);
+    }
+    pb->remaining = 2 + 2 * nStored;
+    pb->next = 0;
+    inProgress = pollResponseInProgress;
+    sendAck(b);
+    send(pb->remaining);
+    return pollResponseInProgress();
+  }
+
+  // Enter (1) or leave (0) framed mode. The ack is sent in the old mode.
+  // When entering, the frame layer takes over after the ack is written;
+  // when leaving, after the host acks the frame carrying the ack.
+  State stExtFramed(RING* const r, byte b) {
+    byte cmd[3];
+    copy(r, cmd, 3);
+    consume(r, 3);
+    if (cmd[2] > 1) {
+      return stBadCmd(r, b);
+    }
+    sendAck(b);
+    if (cmd[2] == 1 && framed == FRAMED_OFF) {
+      framed = FRAMED_ENTERING;
+    } else if (cmd[2] == 0 && framed == FRAMED_ON) {
+      framed = FRAMED_LEAVING;
+    }
+    return state;
+  }
+
+  // Collect the bytes to write in the poll buffer and write them. The
+  // write is verified according to the verification policy.
+  State wrMemBytesInProgress() {
+    receiveToPollBuffer();
+    if (pb->remaining == 0) {
+      unsigned short addr = BtoS(pb->cmd[2], pb->cmd[3]);
+      byte n = pb->cmd[4];
+      if (verifyNextWrite()) {
+        int bad = WriteCheckMem8(addr, pb->buf, n);
+        if (bad != n) {
+          verifyFailed(STORE_MEM, addr + bad);
+        }
+      } else {
+        WriteMem8(addr, pb->buf, n);
+      }
+      freePollBuffer();
+      inProgress = 0;
+    }
+    return state;
+  }
+
+  // Write 1 to 64 bytes of main memory at any address. The arguments
+  // after the subcommand are the address, big-endian, and the count.
+  // Unlike stWrMem, neither the address nor the count need be aligned.
+  State stExtWrMemBytes(RING* const r, byte b) {
+    allocPollBuffer();
+    copy(r, pb->cmd, 5);
+    consume(r, 5);
+    unsigned short addr = BtoS(pb->cmd[2], pb->cmd[3]);
+    byte n = pb->cmd[4];
+    if (n == 0 || n > CHUNK_SIZE || addr > END_MEM - n) {
+      freePollBuffer();
+      return stBadCmd(r, b);
+    }
+    pb->remaining = n;
+    pb->next = 0;
+    PortInvalidateImage(STORE_MEM);
+    inProgress = wrMemBytesInProgress;
+    sendAck(b);
+    return wrMemBytesInProgress();
+  }
+
+  // Run a script of bus operations (see RunScript() in yarc_utils.h). The
+  // script arrives as counted bytes and is kept at the end of the poll
+  // buffer, before the guard byte. The results are stored at the start of
+  // the poll buffer, after a 3-byte header of the status, the offset where
+  // the script stopped, and the code from SCRIPT_FAIL. The header and the
+  // results are sent as a counted response.
+  constexpr byte SCRIPT_MAX_SIZE = 128;
+  constexpr byte SCRIPT_HEADER_SIZE = 3;
+  constexpr byte SCRIPT_MAX_RESULTS = POLL_BUF_LAST - SCRIPT_MAX_SIZE - SCRIPT_HEADER_SIZE;
+
+  State runScriptInProgress() {
+    receiveToPollBuffer();
+    if (pb->remaining > 0 || !canSend(1)) {
+      return state;
+    }
+
+    byte len = pb->cmd[2];
+    ScriptResult sr;
+    RunScript(&pb->buf[POLL_BUF_LAST - len], len, &pb->buf[SCRIPT_HEADER_SIZE],
+              SCRIPT_MAX_RESULTS, &sr);
+    // The script may have changed any of the stores
+    for (byte store = 0; store < N_STORES; ++store) {
+      PortInvalidateImage(store);
+    }
+    pb->buf[0] = sr.status;
+    pb->buf[1] = sr.pc;
+    pb->buf[2] = sr.code;
+
+    pb->remaining = SCRIPT_HEADER_SIZE + sr.nResults;
+    pb->next = 0;
+    inProgress = pollResponseInProgress;
+    send(pb->remaining);
+    return pollResponseInProgress();
+  }
+
+  // The argument after the subcommand is the length of the script that
+  // follows, 1 to 128 bytes.
+  State stExtRunScript(RING* const r, byte b) {
+    allocPollBuffer();
+    copy(r, pb->cmd, 3);
+    consume(r, 3);
+    byte len = pb->cmd[2];
+    if (len == 0 || len > SCRIPT_MAX_SIZE) {
+      freePollBuffer();
+      return stBadCmd(r, b);
+    }
+    pb->remaining = len;
+    pb->next = POLL_BUF_LAST - len;
+    inProgress = runScriptInProgress;
+    sendAck(b);
+    return runScriptInProgress();
+  }
+
+  const PROGMEM CommandData extHandlers[] = {
+    { stBadCmd,           2, false }, // subcommand 0 is reserved
+    { stExtCostResults,   2, false }, // cmd, subcommand
+    { stExtWrOpcode,      5, true  }, // cmd, subcommand, opcode, first slot, word count
+    { stExtFill,          6, true  }, // cmd, subcommand, store, value hi, lo, verify
+    { stExtInitStatus,    2, false }, // cmd, subcommand
+    { stExtSaveImage,     5, true  }, // cmd, subcommand, store, digest hi, lo
+    { stExtGetImage,      3, false }, // cmd, subcommand, store
+    { stExtGenALU,        3, true  }, // cmd, subcommand, count (16)
+    { stExtRdALU3,        5, true  }, // cmd, subcommand, addr hi, addr lo, count
+    { stExtVerify,        3, false }, // cmd, subcommand, policy
+    { stExtDigest,        7, true  }, // cmd, subcommand, store, first hi, lo, count hi, lo
+    { stExtChunkDigests,  6, true  }, // cmd, subcommand, store, first hi, lo, count
+    { stExtClockBurst,    8, true  }, // cmd, subcommand, count (4), period hi, lo
+    { stExtBurstStatus,   2, false }, // cmd, subcommand
+    { stExtRunUntil,      8, true  }, // cmd, subcommand, conditions, value, mask, budget (3)
+    { stExtRunResult,     2, false }, // cmd, subcommand
+    { stExtTraceCtl,      3, false }, // cmd, subcommand, on/off
+    { stExtTraceRead,     3, true  }, // cmd, subcommand, max entries
+    { stExtCounters,      3, false }, // cmd, subcommand, clear
+    { stExtRdScatter,     3, true  }, // cmd, subcommand, count
+    { stExtMemSearch,     3, true  }, // cmd, subcommand, count (9)
+    { stExtMemCompare,    8, true  }, // cmd, subcommand, a hi, lo, b hi, lo, length hi, lo
+    { stExtFramed,        3, false }, // cmd, subcommand, on/off
+    { stExtWrMemBytes,    5, true  }, // cmd, subcommand, addr hi, addr lo, count
+    { stExtRunScript,     3, true  }, // cmd, subcommand, count
+  };
+
+  constexpr byte N_EXT_HANDLERS = (sizeof(extHandlers) / sizeof(CommandData));
+
+  // The top-level process() has guaranteed that the command and
+  // subcommand bytes are present and there is room for the fixed
+  // response. Here we wait for the rest of the fixed part.
+  State stExt(RING* const r, byte b) {
+    byte cmd[2];
+    copy(r, cmd, 2);
+    byte sub = cmd[1];
+    if (sub >= N_EXT_HANDLERS) {
+      return stBadCmd(r, b);
+    }
+
+    byte cmdLen = pgm_read_byte_near(&extHandlers[sub].length);
+    if (len(r) < cmdLen) {
+      return state; // come back after more bytes arrive
+    }
+    if (pgm_read_byte_near(&extHandlers[sub].usesYarc)) {
+      if (!PortIsReady()) {
+        return state; // defer until background initialization is done
+      }
+      costPreempt();
+    }
+    CommandHandler handler = pgm_read_ptr_near(&extHandlers[sub].handler);
+    return (*handler)(r, b);
+  }
+
   // Jump table for protocol command handlers. The table is stored in
   // PROGMEM (ROM) so requires special access, below.
   
   const PROGMEM CommandData handlers[] = {
-    { stBadCmd,     1 },
-    { stGetMcr,     1 },
-    { stRunCost,    1 },
-    { stStopCost,   1 },
-
-    { stClockCtl,   2 },
-    { stWrMem,      4 }, // cmd, addr hi, addr lo, count
-    { stRdMem,      4 }, // cmd, addr hi, addr lo, count
-    { stRun,        8 }, // cmd, clock_ctrl, r0 msb, lsb, r1 msb, lsb, r2 msb, lsb
-
-    { stStop,       1 },
-    { stPoll,       1 },
-    { stResp,       2 },
-    { stDebug,      8 }, // cmd, 7 uncommitted
-
-    { stUndef,      1 },
-    { stUndef,      1 },
-    { stGetVer,     1 },
-    { stSync,       1 },
+    { stBadCmd,     1, false },
+    { stGetMcr,     1, false },
+    { stRunCost,    1, false },
+    { stStopCost,   1, false },
+
+    { stClockCtl,   2, true  },
+    { stWrMem,      4, true  }, // cmd, addr hi, addr lo, count
+    { stRdMem,      4, true  }, // cmd, addr hi, addr lo, count
+    { stRun,        8, true  }, // cmd, clock_ctrl, r0 msb, lsb, r1 msb, lsb, r2 msb, lsb
+
+    { stStop,       1, true  },
+    { stPoll,       1, false },
+    { stResp,       2, false },
+    { stDebug,      8, true  }, // cmd, 7 uncommitted
+
+    { stExt,        2, false }, // cmd, subcommand, fixed length from extHandlers
+    { stUndef,      1, false },
+    { stGetVer,     1, false },
+    { stSync,       1, false },
   
-    { stSetAH,      2 },
-    { stSetAL,      2 },
-    { stSetDH,      2 },
-    { stSetDL,      2 },
-
-    { stOneClk,     1 },
-    { stGetBir,     1 },
-    { stWrSlice,    4 },
-    { stRdSlice,    4 },
-
-    { stUndef,      1 },
-    { stUndef,      1 },
-    { stUndef,      1 },
-    { stSetK,       5 },
+    { stSetAH,      2, true  },
+    { stSetAL,      2, true  },
+    { stSetDH,      2, true  },
+    { stSetDL,      2, true  },
+
+    { stOneClk,     1, true  },
+    { stGetBir,     1, true  },
+    { stWrSlice,    4, true  },
+    { stRdSlice,    4, true  },
+
+    { stUndef,      1, false },
+    { stUndef,      1, false },
+    { stUndef,      1, false },
+    { stSetK,       5, true  },
     
-    { stSetMCR,     2 },
-    { stWrALU,      4 },
-    { stRdALU,      5 },
-    { stBadCmd,     1 },
+    { stSetMCR,     2, true  },
+    { stWrALU,      4, true  },
+    { stRdALU,      5, true  },
+    { stBadCmd,     1, false },
   };
 
   // The maximum fixed response currently specified by the protocol is 1
@@ -856,6 +2085,15 @@ namespace SerialPrivate {
       // available and there is space for the fixed part of the response.
       return state;
     }
+    if (pgm_read_byte_near(&handlers[b - STCMD_BASE].usesYarc)) {
+      if (!PortIsReady()) {
+        // Defer the command until background initialization is
+        // done (see port_task.h). This normally takes a second or
+        // two after a reset, much less than the host's timeout.
+        return state;
+      }
+      costPreempt(); // we're between COST test steps here
+    }
     handler = pgm_read_ptr_near(&handlers[b - STCMD_BASE].handler);
     return (*handler)(r, b);
   }
@@ -867,17 +2105,43 @@ namespace SerialPrivate {
   // buffer is not empty, invoke process() to handle a new
   // command. Note that process() may do nothing, waiting
   // for more bytes to either come in or go out.
+  //
+  // In framed mode, the frame layer moves the bytes between the
+  // rings and the serial line instead. It may leave framed mode when
+  // transmitting, so we check again before receiving.
   
   int serialTask() {
-    while (len(xmtBuf) > 0 && Serial.availableForWrite() != 0) {
-      if (Serial.write(peek(xmtBuf)) != 1) {
-        panic(PANIC_SERIAL_NUMBERED, 9);
-      }
-      consume(xmtBuf, 1);
+    if (framed >= FRAMED_ON) {
+      frameTransmit();
     }
 
-    while (!isFull(rcvBuf) && Serial.available()) {
-      put(rcvBuf, Serial.read());
+    if (framed >= FRAMED_ON) {
+      frameReceive();
+    } else {
+      byte *span;
+      byte n;
+      while ((n = readSpan(xmtBuf, &span)) != 0 && Serial.availableForWrite() != 0) {
+        int room = Serial.availableForWrite();
+        if (n > room) {
+          n = room;
+        }
+        if (Serial.write(span, n) != n) {
+          panic(PANIC_SERIAL_NUMBERED, 9);
+        }
+        consume(xmtBuf, n);
+      }
+      if (framed == FRAMED_ENTERING && len(xmtBuf) == 0) {
+        frameReset();
+        framed = FRAMED_ON;
+      }
+
+      while ((n = writeSpan(rcvBuf, &span)) != 0 && Serial.available()) {
+        int ready = Serial.available();
+        if (n > ready) {
+          n = ready;
+        }
+        produce(rcvBuf, Serial.readBytes(span, n));
+      }
     }
 
     if (inProgress) {
@@ -912,6 +2176,10 @@ void SerialReset() {
   SerialPrivate::internalSerialReset();
 }
 
+bool SerialIsConnected() {
+  return SerialPrivate::state == SerialPrivate::STATE_READY;
+}
+
 void serialTaskInit() {
   SetDisplay(TRACE_BEFORE_SERIAL_INIT);
   SerialPrivate::stProtoUnsync();
@@ -48,6 +48,91 @@ byte logQueueCallback(logCallback callback);
 // next queued callback is called from this function.
 int logGetPending(char *next, int maxCount);
 
+// Scratch arena (see small_tasks.h). Each scope is a stack: take a mark,
+// allocate, and release to the mark when done. The budgets are the worst
+// case of each scope, rounded up. The arena holds the whole command budget
+// or the test budget plus the shared budget, the most a command that runs
+// beside the tests may use (the COST results table is the largest).
+
+enum : byte {
+  SCRATCH_COMMAND     = 0, // the poll buffer (serial_task.h)
+  SCRATCH_TEST        = 1, // the COST test data (cost_task.h)
+};
+
+constexpr unsigned short SCRATCH_COMMAND_BYTES = 280;
+constexpr unsigned short SCRATCH_SHARED_BYTES = 168;
+constexpr unsigned short SCRATCH_TEST_BYTES = 144;
+constexpr unsigned short SCRATCH_BYTES =
+  (SCRATCH_COMMAND_BYTES > SCRATCH_SHARED_BYTES + SCRATCH_TEST_BYTES)
+  ? SCRATCH_COMMAND_BYTES : SCRATCH_SHARED_BYTES + SCRATCH_TEST_BYTES;
+
+void *ScratchAlloc(byte scope, unsigned short n);
+unsigned short ScratchMark(byte scope);
+void ScratchRelease(byte scope, unsigned short mark);
+unsigned short ScratchAvailable(void);
+unsigned short ScratchHighWater(void);
+
+// Bus trace (see small_tasks.h). Each entry is two bytes, the BIR and
+// the MCR after a clock. TraceControl(true) clears the trace.
+
+void TraceControl(bool enable);
+bool TraceIsOn(void);
+bool TraceIsFull(void);
+void TraceRecord(byte bir, byte mcr);
+void TraceCycle(void);
+unsigned short TracePending(void);
+unsigned short TraceLost(void);
+byte TraceRead(byte *buf, byte maxEntries);
+
 // Clock control API (consumed by runtime task)
 
-void SetClockControl(byte b);
\ No newline at end of file
+void SetClockControl(byte b);
+byte GetClockControl(void);
+
+// Deliver exactly count clocks, as fast as possible if period is 0 or
+// one every period microseconds otherwise. The burst is carried out by
+// the runtime task over as many calls as it takes, and a message is
+// logged when it's done. Setting the clock control cancels the burst.
+void StartClockBurst(unsigned long count, unsigned short period);
+unsigned long ClockBurstRemaining(void);
+
+// Run until: deliver clocks at full speed, sampling the bus input
+// register (BIR) and the MCR after each one, until one of the stop
+// conditions holds or the budget of clocks is spent. GetRunResult()
+// returns the reason the most recent burst stopped, or RUN_STOP_NONE
+// while it's running, along with the number of clocks delivered and
+// the BIR and MCR at the stop.
+
+enum : byte { // stop conditions
+  RUN_UNTIL_BIR       = 0x01, // (BIR & mask) == value
+  RUN_UNTIL_SERVICE   = 0x02, // the YARC requests service
+};
+
+enum : byte { // stop reasons
+  RUN_STOP_NONE       = 0,
+  RUN_STOP_BIR        = 1,
+  RUN_STOP_SERVICE    = 2,
+  RUN_STOP_BUDGET     = 3,
+  RUN_STOP_CANCELLED  = 4,
+};
+
+void StartRunUntil(byte conditions, byte value, byte mask, unsigned long budget);
+byte GetRunResult(unsigned long *clocks, byte *bir, byte *mcr);
+
+// Execution counters, kept by the runtime task: the clocks delivered to
+// the YARC by the slow clock, bursts, run until and the single clock
+// command; the time the YARC has spent in run mode, and in run mode with
+// the fast clock; and the number of service requests. Times are in
+// milliseconds. RunYARC() and StopYARC() call UpdateCounters().
+
+typedef struct execCounters {
+  unsigned long clocks;
+  unsigned long runMillis;
+  unsigned long fastMillis;
+  unsigned short serviceRequests;
+} ExecCounters;
+
+void UpdateCounters(void);
+void CountClocks(unsigned long n);
+void GetCounters(ExecCounters *c);
+void ClearCounters(void);
\ No newline at end of file
@@ -46,8 +46,9 @@ namespace HeartbeatPrivate {
   
     // snprintf_P returns "...the number of characters that would have been written to s if there were enough space."
     // http://www.nongnu.org/avr-libc/user-manual/group__avr__stdio.html#ga53ff61856759709eeceae10aaa10a0a3
-    int result = snprintf_P(bp, bmax, PSTR("Up %02d:%02d:%02d:%02d.%03d, about %ld task/ms, max %dms"),
-               days, hours, minutes, seconds, ms, hbTaskIterations / elapsed, hbLongestTask);
+    int result = snprintf_P(bp, bmax, PSTR("Up %02d:%02d:%02d:%02d.%03d, about %ld task/ms, max %dms, scratch %u/%u"),
+               days, hours, minutes, seconds, ms, hbTaskIterations / elapsed, hbLongestTask,
+               ScratchHighWater(), SCRATCH_BYTES);
     if (result > bmax) result = bmax;
     hbTaskIterations = 0;
     hbLongestTask = 1;
@@ -226,6 +227,205 @@ int logGetPending(char *next, int maxCount) {
   return LogPrivate::internalLogGetPending(next, maxCount);
 }
 
+// Scratch arena. The large buffers that are live only while a command
+// or the COST tests are running share one static arena instead of each
+// having its own. Command buffers (the poll buffer) are allocated from
+// the bottom and COST test data from the top, so each scope is a stack
+// and neither can free the other's buffers. The arena doesn't hold the
+// largest allocation of both scopes at once. Commands that run beside
+// the tests (e.g. Poll) take a small poll buffer that fits next to the
+// test data; a command that needs the whole poll buffer has COST drop
+// its test data first (see costDropTestData()), and the current test
+// starts over. The budgets are in the decls and are checked at compile
+// time where the buffers are declared. The heartbeat reports the high
+// water mark.
+
+namespace ScratchPrivate {
+  byte arena[SCRATCH_BYTES];
+  unsigned short used[2];     // bytes in use by each scope
+  unsigned short highWater;
+}
+
+// public interface
+
+// Allocate n bytes in the scope.
+// panic: the arena is full
+void *ScratchAlloc(byte scope, unsigned short n) {
+  unsigned short *used = ScratchPrivate::used;
+  if (scope > SCRATCH_TEST || n > SCRATCH_BYTES - used[SCRATCH_COMMAND] - used[SCRATCH_TEST]) {
+    panic(PANIC_SCRATCH, 1);
+  }
+  byte *p = (scope == SCRATCH_COMMAND)
+    ? ScratchPrivate::arena + used[SCRATCH_COMMAND]
+    : ScratchPrivate::arena + SCRATCH_BYTES - used[SCRATCH_TEST] - n;
+  used[scope] += n;
+  if (used[SCRATCH_COMMAND] + used[SCRATCH_TEST] > ScratchPrivate::highWater) {
+    ScratchPrivate::highWater = used[SCRATCH_COMMAND] + used[SCRATCH_TEST];
+  }
+  return p;
+}
+
+unsigned short ScratchMark(byte scope) {
+  return ScratchPrivate::used[scope];
+}
+
+// Free everything allocated in the scope since the mark was taken.
+// panic: the mark is above the scope's allocations
+void ScratchRelease(byte scope, unsigned short mark) {
+  if (scope > SCRATCH_TEST || mark > ScratchPrivate::used[scope]) {
+    panic(PANIC_SCRATCH, 2);
+  }
+  ScratchPrivate::used[scope] = mark;
+}
+
+// Return the number of bytes that can be allocated in either scope.
+unsigned short ScratchAvailable() {
+  return SCRATCH_BYTES - ScratchPrivate::used[SCRATCH_COMMAND] - ScratchPrivate::used[SCRATCH_TEST];
+}
+
+unsigned short ScratchHighWater() {
+  return ScratchPrivate::highWater;
+}
+
+// Bus trace. While tracing is on, every clock delivered by the runtime
+// task (slow clock, bursts, run until) and by the single clock command
+// records the BIR and the MCR. The trace is a FIFO that the host drains
+// with the trace read command. The entries are kept in a small ring in
+// Nano RAM. When the ring fills and the YARC is stopped (so the Nano owns
+// the bus) the oldest entries move to a second ring in the upper half of
+// the scratch memory; the host always receives the older spilled entries
+// first. When both are full, the runtime task holds the clock until the
+// host makes room, so a traced burst or run loses no cycles. Only single
+// clocks from the host can be lost, and they're counted. The spill runs
+// between clocks, so it saves and restores the K register, bus registers
+// and MCR the host set up (PortSaveBus()); scratch memory isn't part of
+// the memory image, so spilling doesn't invalidate it.
+
+namespace TracePrivate {
+  constexpr byte TRACE_ENTRY_SIZE = 2;    // BIR, MCR
+  constexpr byte TRACE_RING_ENTRIES = 32;
+  constexpr byte TRACE_SPILL_ENTRIES = 64;
+  constexpr unsigned short TRACE_SPILL_ADDR = SCRATCH_MEM + 0x80;
+
+  static bool on = false;
+  static byte ring[TRACE_RING_ENTRIES][TRACE_ENTRY_SIZE];
+  static byte ringHead;   // oldest entry
+  static byte ringCount;
+  static byte spillHead;
+  static byte spillCount;
+  static unsigned short lost;
+
+  void clear() {
+    ringHead = ringCount = 0;
+    spillHead = spillCount = 0;
+    lost = 0;
+  }
+
+  inline unsigned short spillAddr(byte slot) {
+    return TRACE_SPILL_ADDR + TRACE_ENTRY_SIZE * (slot % TRACE_SPILL_ENTRIES);
+  }
+
+  // Move as many of the oldest ring entries to the spill area as fit,
+  // if the Nano owns the bus.
+  void spill() {
+    if (YarcIsRunning() || ringCount == 0 || spillCount == TRACE_SPILL_ENTRIES) {
+      return;
+    }
+    BusState saved;
+    PortSaveBus(&saved);
+    while (ringCount != 0 && spillCount != TRACE_SPILL_ENTRIES) {
+      WriteMem8(spillAddr(spillHead + spillCount), ring[ringHead], TRACE_ENTRY_SIZE);
+      spillCount++;
+      ringHead = (ringHead + 1) % TRACE_RING_ENTRIES;
+      ringCount--;
+    }
+    PortRestoreBus(&saved);
+  }
+
+  // Remove up to maxEntries of the oldest entries and place them at buf.
+  // Return the number of entries. Spilled entries can only be read while
+  // the YARC is stopped, and none are returned until then.
+  byte read(byte *buf, byte maxEntries) {
+    byte n = 0;
+    if (spillCount != 0) {
+      if (YarcIsRunning()) {
+        return 0;
+      }
+      BusState saved;
+      PortSaveBus(&saved);
+      for (; n < maxEntries && spillCount != 0; ++n) {
+        ReadMem8(spillAddr(spillHead), buf, TRACE_ENTRY_SIZE);
+        buf += TRACE_ENTRY_SIZE;
+        spillHead = (spillHead + 1) % TRACE_SPILL_ENTRIES;
+        spillCount--;
+      }
+      PortRestoreBus(&saved);
+    }
+    for (; n < maxEntries && ringCount != 0; ++n) {
+      buf[0] = ring[ringHead][0];
+      buf[1] = ring[ringHead][1];
+      buf += TRACE_ENTRY_SIZE;
+      ringHead = (ringHead + 1) % TRACE_RING_ENTRIES;
+      ringCount--;
+    }
+    return n;
+  }
+}
+
+void TraceControl(bool enable) {
+  if (enable) {
+    TracePrivate::clear();
+  }
+  TracePrivate::on = enable;
+}
+
+bool TraceIsOn() {
+  return TracePrivate::on;
+}
+
+// Return true if the trace has no room for another entry. The caller
+// should hold the clock.
+bool TraceIsFull() {
+  if (!TracePrivate::on || TracePrivate::ringCount < TracePrivate::TRACE_RING_ENTRIES) {
+    return false;
+  }
+  TracePrivate::spill();
+  return TracePrivate::ringCount == TracePrivate::TRACE_RING_ENTRIES;
+}
+
+void TraceRecord(byte bir, byte mcr) {
+  if (!TracePrivate::on) {
+    return;
+  }
+  if (TraceIsFull()) {
+    TracePrivate::lost++;
+    return;
+  }
+  byte *entry = TracePrivate::ring[(TracePrivate::ringHead + TracePrivate::ringCount)
+                                   % TracePrivate::TRACE_RING_ENTRIES];
+  entry[0] = bir;
+  entry[1] = mcr;
+  TracePrivate::ringCount++;
+}
+
+void TraceCycle() {
+  if (TracePrivate::on) {
+    TraceRecord(GetBIR(), GetMCR());
+  }
+}
+
+unsigned short TracePending() {
+  return TracePrivate::ringCount + TracePrivate::spillCount;
+}
+
+unsigned short TraceLost() {
+  return TracePrivate::lost;
+}
+
+byte TraceRead(byte *buf, byte maxEntries) {
+  return TracePrivate::read(buf, maxEntries);
+}
+
 // Clock control byte. If 0, clock is off. If less than
 // 0x80, the number of remaining slow clocks to generate.
 // If 0xFF, the fast clock is enabled. If 0xFE, the slow
@@ -243,6 +443,34 @@ namespace RuntimePrivate {
   static bool yarcRun = false;
   static bool yarcRequest = false;
 
+  // Execution counters (see GetCounters()). Run time is charged to the
+  // state in effect since the last update, so the counters are updated
+  // on every call to the runtime task and whenever RunYARC(), StopYARC()
+  // or the runtime task change the state. Clocks are those delivered to
+  // the YARC for the host: the slow clock, bursts, run until and single
+  // clock commands, but not those the Nano uses to access YARC resources.
+  static unsigned long countedClocks;
+  static unsigned long runMillis;
+  static unsigned long fastMillis;
+  static unsigned short serviceRequests;
+  static unsigned long lastUpdateMillis;
+  static bool countingRun;
+  static bool countingFast;
+
+  void updateCounters() {
+    unsigned long now = millis();
+    unsigned long elapsed = now - lastUpdateMillis;
+    if (countingRun) {
+      runMillis += elapsed;
+    }
+    if (countingFast) {
+      fastMillis += elapsed;
+    }
+    lastUpdateMillis = now;
+    countingRun = YarcIsRunning();
+    countingFast = countingRun && YarcIsFastClock();
+  }
+
   // We use stateless callbacks to avoid the problem of overwriting
   // the state variable (in this case yarcRun) between the time the
   // callback is queued and the time it is executed.
@@ -255,6 +483,140 @@ namespace RuntimePrivate {
     int n = snprintf_P(bp, bmax, PSTR("YARC request state changed"));
     return (n > bmax) ? bmax : n;
   }
+
+  // Clock burst state (see StartClockBurst()). The count is 32 bits so
+  // that a program can be run for an exact number of cycles. A period
+  // of 0 means as fast as possible; otherwise it's the time between
+  // clocks in microseconds. Each call to the runtime task delivers at
+  // most about a millisecond's worth of the burst so the other tasks
+  // (particularly the serial task) keep running.
+  //
+  // A run-until (see StartRunUntil()) is a burst at full speed with stop
+  // conditions, which are checked after every clock. The count is then
+  // the clock budget.
+  constexpr unsigned short BURST_SLICE_CLOCKS = 2000;
+  constexpr unsigned short BURST_SLICE_MICROS = 1000;
+  constexpr byte RUN_UNTIL_CHECK_CLOCKS = 32; // clocks between checks of the time
+
+  static unsigned long burstRemaining = 0;
+  static unsigned long burstCount;
+  static unsigned short burstPeriod;
+  static unsigned long burstStartMicros;
+  static unsigned long burstLastMicros;
+  static byte burstConditions;
+  static byte burstValue;
+  static byte burstMask;
+
+  // The result of the most recent burst. The reason is RUN_STOP_NONE
+  // while a burst is running.
+  static byte stopReason = RUN_STOP_NONE;
+  static unsigned long stopClocks;
+  static unsigned long stopMicros;
+  static byte stopBIR;
+  static byte stopMCR;
+
+  int runtimeBurstDoneCallback(char *bp, int bmax) {
+    int n = snprintf_P(bp, bmax, PSTR("clock burst: %lu clocks in %lu us, stop reason %u"),
+      stopClocks, stopMicros, stopReason);
+    return (n > bmax) ? bmax : n;
+  }
+
+  void stopBurst(byte reason, byte bir, byte mcr) {
+    stopClocks = burstCount - burstRemaining;
+    countedClocks += stopClocks;
+    stopMicros = micros() - burstStartMicros;
+    stopBIR = bir;
+    stopMCR = mcr;
+    stopReason = reason;
+    burstRemaining = 0;
+    logQueueCallback(runtimeBurstDoneCallback);
+  }
+
+  // Deliver clocks until a stop condition holds or the budget is spent.
+  // We sample the bus and the MCR after every clock, but look at the
+  // time only every few clocks because micros() is slow. This is also
+  // how we deliver a full speed burst while tracing.
+  void runUntil() {
+    unsigned long sliceStart = micros();
+    do {
+      for (byte i = 0; i < RUN_UNTIL_CHECK_CLOCKS && burstRemaining != 0; ++i) {
+        if (TraceIsFull()) {
+          return; // hold the clock until the host drains the trace
+        }
+        SingleClock();
+        burstRemaining--;
+        byte bir = GetBIR();
+        byte mcr = GetMCR();
+        TraceRecord(bir, mcr);
+        if ((burstConditions & RUN_UNTIL_BIR) && (bir & burstMask) == burstValue) {
+          stopBurst(RUN_STOP_BIR, bir, mcr);
+          return;
+        }
+        if ((burstConditions & RUN_UNTIL_SERVICE) && (mcr & MCR_BIT_SERVICE_STATUS)) {
+          stopBurst(RUN_STOP_SERVICE, bir, mcr);
+          return;
+        }
+      }
+    } while (burstRemaining != 0 && micros() - sliceStart < BURST_SLICE_MICROS);
+  }
+
+  void runBurst() {
+    if (burstConditions != 0 || TraceIsOn()) {
+      runUntil();
+    } else if (burstPeriod == 0) {
+      unsigned short n = (burstRemaining < BURST_SLICE_CLOCKS) ? burstRemaining : BURST_SLICE_CLOCKS;
+      ClockBurst(n);
+      burstRemaining -= n;
+    } else {
+      unsigned long sliceStart = micros();
+      while (burstRemaining != 0 && micros() - sliceStart < BURST_SLICE_MICROS) {
+        unsigned long now = micros();
+        if (now - burstLastMicros >= burstPeriod && !TraceIsFull()) {
+          // Keep the average rate, but don't try to catch up
+          // after the other tasks have held us off for a while.
+          if (now - burstLastMicros >= 2UL * burstPeriod) {
+            burstLastMicros = now;
+          } else {
+            burstLastMicros += burstPeriod;
+          }
+          SingleClock();
+          burstRemaining--;
+          TraceCycle();
+        }
+      }
+    }
+
+    if (burstRemaining == 0 && stopReason == RUN_STOP_NONE) {
+      stopBurst(RUN_STOP_BUDGET, GetBIR(), GetMCR());
+    }
+  }
+
+  // Record the result of a burst that was stopped by the host, if any.
+  void cancelBurst() {
+    if (burstRemaining != 0) {
+      stopClocks = burstCount - burstRemaining;
+      countedClocks += stopClocks;
+      stopMicros = micros() - burstStartMicros;
+      stopReason = RUN_STOP_CANCELLED;
+      burstRemaining = 0;
+    }
+  }
+
+  void startBurst(unsigned long count, unsigned short period, byte conditions) {
+    cancelBurst();
+    rtClockControl = 0;
+    SetMCR(McrDisableFastclock(GetMCR()));
+    if (count == 0) {
+      return;
+    }
+    burstRemaining = count;
+    burstCount = count;
+    burstPeriod = period;
+    burstConditions = conditions;
+    burstStartMicros = micros();
+    burstLastMicros = burstStartMicros - period;
+    stopReason = RUN_STOP_NONE;
+  }
 }
 
 void runtimeInit() {
@@ -263,6 +625,7 @@ void runtimeInit() {
 int runtimeTask() {
   bool newYarcRun = YarcIsRunning();
   bool newYarcRequest = YarcRequestsService();
+  RuntimePrivate::updateCounters();
 
   if (newYarcRun != RuntimePrivate::yarcRun) {
     logQueueCallback(RuntimePrivate::runtimeYarcRunStateCallback);
@@ -272,6 +635,9 @@ int runtimeTask() {
   if (newYarcRequest != RuntimePrivate::yarcRequest) {
     logQueueCallback(RuntimePrivate::runtimeYarcRequestStateCallback);
     // TODO request state change handling here
+    if (newYarcRequest) {
+      RuntimePrivate::serviceRequests++;
+    }
     RuntimePrivate::yarcRequest = newYarcRequest;
   }
 
@@ -282,15 +648,29 @@ int runtimeTask() {
   } else if (rtClockControl == 0xFF) {
     SetMCR(McrEnableFastclock(GetMCR()));
   } else if (rtClockControl == 0x80) {
-    SingleClock();
+    if (!TraceIsFull()) {
+      SingleClock();
+      TraceCycle();
+      RuntimePrivate::countedClocks++;
+    }
   } else if (rtClockControl < 0x80) {
-    rtClockControl--;
-    SingleClock();
+    if (!TraceIsFull()) {
+      rtClockControl--;
+      SingleClock();
+      TraceCycle();
+      RuntimePrivate::countedClocks++;
+    }
   } else {
     // undefined value
     rtClockControl = 0;
     SetMCR(McrDisableFastclock(GetMCR()));
   }
+  RuntimePrivate::updateCounters(); // the fast clock may have changed
+
+  if (RuntimePrivate::burstRemaining != 0) {
+    RuntimePrivate::runBurst();
+    return 0;
+  }
 
   if (RuntimePrivate::yarcRun) {
     return 0; // come back here soonest
@@ -303,4 +683,61 @@ void SetClockControl(byte b) {
     b = 0;
   }
   rtClockControl = b;
+  RuntimePrivate::cancelBurst();
+}
+
+byte GetClockControl() {
+  return rtClockControl;
+}
+
+void StartClockBurst(unsigned long count, unsigned short period) {
+  RuntimePrivate::startBurst(count, period, 0);
+}
+
+void StartRunUntil(byte conditions, byte value, byte mask, unsigned long budget) {
+  RuntimePrivate::burstValue = value & mask;
+  RuntimePrivate::burstMask = mask;
+  RuntimePrivate::startBurst(budget, 0, conditions);
+}
+
+byte GetRunResult(unsigned long *clocks, byte *bir, byte *mcr) {
+  *clocks = RuntimePrivate::stopClocks;
+  *bir = RuntimePrivate::stopBIR;
+  *mcr = RuntimePrivate::stopMCR;
+  return RuntimePrivate::stopReason;
+}
+
+void UpdateCounters() {
+  RuntimePrivate::updateCounters();
+}
+
+void CountClocks(unsigned long n) {
+  RuntimePrivate::countedClocks += n;
+}
+
+void GetCounters(ExecCounters *c) {
+  RuntimePrivate::updateCounters();
+  c->clocks = RuntimePrivate::countedClocks;
+  if (RuntimePrivate::burstRemaining != 0) {
+    c->clocks += RuntimePrivate::burstCount - RuntimePrivate::burstRemaining;
+  }
+  c->runMillis = RuntimePrivate::runMillis;
+  c->fastMillis = RuntimePrivate::fastMillis;
+  c->serviceRequests = RuntimePrivate::serviceRequests;
+}
+
+void ClearCounters() {
+  RuntimePrivate::updateCounters();
+  RuntimePrivate::countedClocks = 0;
+  if (RuntimePrivate::burstRemaining != 0) {
+    // charge only the rest of the burst in progress
+    RuntimePrivate::countedClocks -= RuntimePrivate::burstCount - RuntimePrivate::burstRemaining;
+  }
+  RuntimePrivate::runMillis = 0;
+  RuntimePrivate::fastMillis = 0;
+  RuntimePrivate::serviceRequests = 0;
+}
+
+unsigned long ClockBurstRemaining() {
+  return RuntimePrivate::burstRemaining;
 }
@@ -31,6 +31,7 @@ enum : byte { // including panic codes
   PANIC_ALIGNMENT             = 0xEC, // unaligned write request: subcode is code location
   PANIC_ARGUMENT              = 0xEB, // invalid argument: subcode is code location
   PANIC_MEM_VERIFY            = 0xEA, // memory write failure; subcode is value read back
+  PANIC_SCRATCH               = 0xE9, // scratch arena full or bad release: subcode is code location
 
   // 0xD0 through 0xDF are power-on self test (POST)
   // failures. Low order bits are defined in the POST
@@ -60,6 +61,12 @@ void panic(byte panicCode, byte subcode);
 // Similarly for the low byte
 #define StoLB(s) ((unsigned char)(s))
 
+// Update a CRC-16 (XMODEM: polynomial 0x1021, initial value 0) with one
+// byte. The host computes the same CRC (see downloader.go).
+inline unsigned short Crc16(unsigned short crc, byte b) {
+  return _crc_xmodem_update(crc, b);
+}
+
 constexpr unsigned short END_MEM = 0x7800;      // 30k of RAM, 2k of IO
 constexpr unsigned short END_ALU_MEM = 0x2000;  // 8k bytes of ALU RAM
 
@@ -74,6 +81,9 @@ constexpr int CHUNK_SIZE = 64;
 // Reset the serial protocol (software only). Called on any reset.
 void SerialReset(void);
 
+// Return true if a host session is in progress (the host is polling).
+bool SerialIsConnected(void);
+
 // I spent some time considering how to represent small chunks of microcode,
 // especially individual K-register values which are single microcode words.
 // I tried some "modern" ways, such as:
@@ -124,17 +134,156 @@ void SerialReset(void);
 #define RD_ALU_RAM_FROM_NANO(hi4)             0x0F, ((hi4<<4) | 0x01), 0xFF, 0xFF
 #define MICROCODE_IDLE                        0xFF, 0xFF, 0xFF, 0xFF
 
+// Microcode words can also be built from the named fields described in
+// doc/YARC_Microcode.md, starting from the idle word (all 1s, so every
+// field is inactive). For example, a 16-bit memory write from the Nano is
+// Microcode().memWrite().mem16(). A field value that doesn't fit makes a
+// constexpr word fail to compile. Each method sets one field; the methods
+// for the active-low enables take no argument.
+//
+// The Nano writes K through the slice bus, which is wired bit-reversed
+// (see port_task.h). A KWord holds the four bytes of a word already
+// reversed, so when it's a constexpr the reversal costs nothing at run
+// time and WriteK(KWord) loads the four bytes as immediates, just like
+// the macros above. The named words the firmware writes most often are
+// defined below as KWords; the macros that are still needed for arrays
+// of microcode or with run time arguments are checked against the
+// builder.
+
+enum : byte {
+  UCODE_BUS_GR   = 0, // general register drives the data bus
+  UCODE_BUS_IR   = 2, // instruction register
+  UCODE_BUS_F    = 3, // flags register
+  UCODE_BUS_MEM  = 4, // memory (memory read)
+  UCODE_BUS_NONE = 7, // no driver; the Nano may drive the bus
+};
+
+enum : byte { // src2 values 4..7 are small constants
+  UCODE_SRC2_P2  = 4, // +2
+  UCODE_SRC2_P1  = 5, // +1
+  UCODE_SRC2_N2  = 6, // -2
+  UCODE_SRC2_N1  = 7, // -1
+};
+
+enum : byte {
+  UCODE_ALU_PHI1 = 0,
+  UCODE_ALU_PHI2 = 1,
+  UCODE_ALU_IN   = 2, // src2 transceivers to the data bus
+  UCODE_ALU_NONE = 3,
+};
+
+// Not defined: calling it in a constant expression is a compile error.
+byte microcodeFieldTooLarge(void);
+
+class Microcode {
+public:
+  constexpr Microcode() : w(0xFFFFFFFFUL) {}
+
+  // K3, the register control word
+  constexpr Microcode src1(byte gr) const { return set(30, 2, gr); }
+  constexpr Microcode src2(byte r) const { return set(27, 3, r); }
+  constexpr Microcode dst(byte r) const { return set(24, 3, r); }
+  // K2, ALU controls
+  constexpr Microcode acn(byte op) const { return set(20, 4, op); }
+  constexpr Microcode aluCtl(byte ctl) const { return set(18, 2, ctl); }
+  constexpr Microcode loadHold() const { return set(17, 1, 0); }
+  constexpr Microcode loadFlags() const { return set(16, 1, 0); }
+  // K1, busses
+  constexpr Microcode sysdata(byte src) const { return set(13, 3, src); }
+  constexpr Microcode regFromAlu() const { return set(12, 1, 0); }
+  constexpr Microcode regWrite() const { return set(8, 1, 0); }
+  // K0, miscellaneous controls
+  constexpr Microcode memWrite() const { return set(7, 1, 0); }
+  constexpr Microcode mem16() const { return set(6, 1, 0); }
+  constexpr Microcode loadIR() const { return set(5, 1, 0); }
+  constexpr Microcode rcwFromIR() const { return set(4, 1, 0); }
+  constexpr Microcode noCarry() const { return set(3, 1, 0); }
+  constexpr Microcode flagsFromAlu() const { return set(2, 1, 0); }
+  constexpr Microcode acnFromIR() const { return set(1, 1, 0); }
+  constexpr Microcode ir0Low() const { return set(0, 1, 0); }
+
+  // Byte n (0 to 3) of the word, as it appears in microcode
+  constexpr byte k(byte n) const { return (byte)(w >> (8 * n)); }
+
+  constexpr bool is(byte k3, byte k2, byte k1, byte k0) const {
+    return k(3) == k3 && k(2) == k2 && k(1) == k1 && k(0) == k0;
+  }
+
+private:
+  constexpr explicit Microcode(unsigned long word) : w(word) {}
+
+  constexpr Microcode set(byte lsb, byte width, byte value) const {
+    return (value >> width) != 0
+      ? Microcode(microcodeFieldTooLarge())
+      : Microcode((w & ~(((1UL << width) - 1) << lsb)) | ((unsigned long)value << lsb));
+  }
+
+  unsigned long w;
+};
+
+// The four bytes of a word, K3 first, for arrays of microcode
+#define UCODE_WORD(u) (u).k(3), (u).k(2), (u).k(1), (u).k(0)
+
+constexpr byte Reverse8(byte b) {
+  return ((b & 0x01) << 7) | ((b & 0x02) << 5) | ((b & 0x04) << 3) | ((b & 0x08) << 1)
+       | ((b & 0x10) >> 1) | ((b & 0x20) >> 3) | ((b & 0x40) >> 5) | ((b & 0x80) >> 7);
+}
+
+typedef struct kWord {
+  byte r3, r2, r1, r0; // bit-reversed K3, K2, K1, K0
+} KWord;
+
+constexpr KWord ToKWord(Microcode u) {
+  return KWord{ Reverse8(u.k(3)), Reverse8(u.k(2)), Reverse8(u.k(1)), Reverse8(u.k(0)) };
+}
+
+constexpr KWord K_IDLE = ToKWord(Microcode());
+constexpr KWord K_WRMEM16_FROM_NANO = ToKWord(Microcode().memWrite().mem16());
+constexpr KWord K_WRMEM8_FROM_NANO = ToKWord(Microcode().memWrite());
+constexpr KWord K_RDMEM8_TO_NANO = ToKWord(Microcode().sysdata(UCODE_BUS_MEM));
+constexpr KWord K_RDMEM16_TO_NANO = ToKWord(Microcode().sysdata(UCODE_BUS_MEM).mem16());
+constexpr KWord K_RD_FLAGS_TO_NANO = ToKWord(Microcode().sysdata(UCODE_BUS_F));
+
+static_assert(Microcode().is(MICROCODE_IDLE), "MICROCODE_IDLE");
+static_assert(Microcode().memWrite().mem16().is(WRMEM16_FROM_NANO), "WRMEM16_FROM_NANO");
+static_assert(Microcode().memWrite().is(WRMEM8_FROM_NANO), "WRMEM8_FROM_NANO");
+static_assert(Microcode().sysdata(UCODE_BUS_MEM).is(RDMEM8_TO_NANO), "RDMEM8_TO_NANO");
+static_assert(Microcode().sysdata(UCODE_BUS_F).is(RD_FLAGS_TO_NANO), "RD_FLAGS_TO_NANO");
+static_assert(Microcode().sysdata(UCODE_BUS_MEM).loadFlags().is(LOAD_FLAGS_INDIRECT_R3),
+              "LOAD_FLAGS_INDIRECT_R3");
+static_assert(Microcode().dst(4).acn(0).regFromAlu().regWrite().is(CONDITIONAL_MOVE_ALU_R0),
+              "CONDITIONAL_MOVE_ALU_R0");
+static_assert(Microcode().dst(2).regWrite().memWrite().mem16().is(LOAD_REG_16_FROM_NANO(2)),
+              "LOAD_REG_16_FROM_NANO");
+static_assert(Microcode().src2(1).dst(7).sysdata(UCODE_BUS_GR).memWrite().mem16()
+              .is(STORE_REG_16_TO_MEMORY(1)), "STORE_REG_16_TO_MEMORY");
+static_assert(Microcode().src1(0).src2(1).acn(5).aluCtl(UCODE_ALU_PHI1).loadHold().memWrite()
+              .is(WR_ALU_RAM_FROM_NANO(5)), "WR_ALU_RAM_FROM_NANO");
+static_assert(Microcode().src1(0).src2(1).acn(5).aluCtl(UCODE_ALU_PHI1).loadHold()
+              .is(RD_ALU_RAM_FROM_NANO(5)), "RD_ALU_RAM_FROM_NANO");
+
 // For now, at least, the 12 unassigned opcodes from 0xF0 through 0xFB
 // are reserved for use by the Nano in test and initialization sequences.
+// F0 and F3 through FB hold resident helper microcode (see yarc_utils.h).
 #define SCRATCH_OPCODE_F0 ((unsigned byte)0xF0) // write flags
 #define SCRATCH_OPCODE_F1 ((unsigned byte)0xF1) // read value of register
 #define SCRATCH_OPCODE_F2 ((unsigned byte)0xF2) // conditional move indirect memory to register
+#define SCRATCH_OPCODE_F3 ((unsigned byte)0xF3) // COST ALU execution test (ACN 3)
+#define SCRATCH_OPCODE_F4 ((unsigned byte)0xF4) // halt (no-op microcode)
+#define SCRATCH_OPCODE_F5 ((unsigned byte)0xF5) // COST ALU execution test (ACN 5 through B)
+#define SCRATCH_OPCODE_F6 ((unsigned byte)0xF6)
+#define SCRATCH_OPCODE_F7 ((unsigned byte)0xF7)
+#define SCRATCH_OPCODE_F8 ((unsigned byte)0xF8)
+#define SCRATCH_OPCODE_F9 ((unsigned byte)0xF9)
+#define SCRATCH_OPCODE_FA ((unsigned byte)0xFA)
+#define SCRATCH_OPCODE_FB ((unsigned byte)0xFB) // last scratch opcode
 
 // For now, at least, the last 256 bytes of memory are reserved for scratch
 // use by the Nano. This region may also be used for the eventual buffer
 // holding YARC requests to the host (these are transmitted by the Nano).
 // Note this is not defined as a pointer: +2 is two bytes (byte addressing).
 #define SCRATCH_MEM ((unsigned short)0x7700)
+#define SCRATCH_MEM_SIZE ((unsigned short)256)
 
 
 
@@ -10,12 +10,31 @@
 void WriteIR(byte high, byte low);
 void WriteK(byte k3, byte k2, byte k1, byte k0);
 void WriteK(byte *k); // k3 at offset 0, k0 at offset 3
+void WriteK(KWord k);
+void UpdateK(byte *k, byte k3, byte k2, byte k1, byte k0);
 void ReadSlice(byte opcode, byte slice, byte *data, byte n);
 int WriteSlice(byte opcode, byte slice, byte *data, byte n, bool panicOnFail);
+void WriteSliceFast(byte opcode, byte slice, byte *data, byte n);
 void WriteMicrocode(byte opcode, byte *data, byte nWords);
+int WriteOpcode(byte opcode, byte first, byte *data, byte nWords, bool bigEndian, bool panicOnFail);
+void WriteOpcodeFast(byte opcode, byte first, byte *data, byte nWords, bool bigEndian);
+int FillSlice(byte opcode, byte slice, byte value, byte n, bool verify);
+int FillWCS(byte value, byte verifyEvery);
+int FillMem16(unsigned short addr, unsigned short value, int nWords, int verifyEvery);
+int SearchMem(unsigned short start, unsigned short end, unsigned short value,
+              unsigned short mask, bool words, unsigned short *found, int maxFound);
+unsigned short CompareMem(unsigned short a, unsigned short b, unsigned short n,
+                          unsigned short *diffs, int maxDiffs);
+int FillALU(unsigned short offset, byte value, unsigned short n, unsigned short verifyEvery);
+int GenerateALU(const byte *descriptors, unsigned short verifyEvery);
+int GenerateALURange(const byte *descriptors, unsigned short offset, unsigned short n,
+                     unsigned short verifyEvery);
+byte AluTableValue(byte descriptor, unsigned short addr);
 void WriteMem16(unsigned short addr, unsigned short *data, short nWords);
+int WriteCheckMem16(unsigned short addr, unsigned short *data, short nWords);
 void ReadMem16(unsigned short addr, unsigned short *data, short nWords);
 void WriteMem8(unsigned short addr, unsigned char *data, short nBytes);
+int WriteCheckMem8(unsigned short addr, unsigned char *data, short nBytes);
 void ReadMem8(unsigned short addr, unsigned char *data, short nBytes);
 byte WrMemFast(unsigned short addr, byte data);
 byte RdMemFast(unsigned short addr);
@@ -23,6 +42,92 @@ void WriteReg(unsigned char reg, unsigned short value);
 unsigned short ReadReg(unsigned char dataReg, unsigned short memAddr);
 void WriteFlags(unsigned char flags);
 byte ReadFlags();
+void InstallHelpers();
+void EnsureHelper(byte opcode);
+void HelperOverwritten(byte opcode);
 void WriteALU(unsigned short offset, byte *data, unsigned short n);
 void ReadALU(unsigned short offset, byte *data, unsigned short n, byte reg);
-void WriteCheckALU(unsigned short offset, byte *data, unsigned short n);
+void ReadALU3(unsigned short offset, byte *data, unsigned short n);
+int WriteCheckALU(unsigned short offset, byte *data, unsigned short n, bool panicOnFail);
+void WriteALUFast(unsigned short offset, byte *data, unsigned short n);
+
+// The three YARC stores that are loaded from the download file. These
+// values are used in the protocol (fill, digest commands).
+enum : byte {
+  STORE_WCS = 0,
+  STORE_MEM = 1,
+  STORE_ALU = 2,
+  N_STORES = 3
+};
+
+unsigned short StoreChunks(byte store);
+unsigned short DigestChunk(byte store, unsigned short chunk, unsigned short crc);
+
+// The standard ALU functions. The ALU RAM holds a table of results for
+// each of 16 operations, selected by address bits 12:9 (see YARC_ALU.md);
+// bit 8 is the carry in, bits 7:4 are the B operand and bits 3:0 are A.
+// The table for each operation is described by a descriptor byte: the
+// function in the low nybble and the carry handling in the high nybble.
+// Arithmetic functions set all four flags, logical functions set Z and N,
+// and PASS sets only Z, as in the assembler's tables. The host uses the
+// same definitions (see alu.go in the host package).
+enum : byte {
+  ALU_FN_NONE   = 0x00, // leave the table unchanged
+  ALU_FN_ADD    = 0x01, // A + B + C
+  ALU_FN_SUB    = 0x02, // A + ~B + C
+  ALU_FN_RSUB   = 0x03, // B + ~A + C
+  ALU_FN_NAND   = 0x04,
+  ALU_FN_OR     = 0x05,
+  ALU_FN_XOR    = 0x06,
+  ALU_FN_NOT    = 0x07, // ~A
+  ALU_FN_NEG    = 0x08, // ~A + C
+  ALU_FN_PASS   = 0x09, // B
+  ALU_FN_MASK   = 0x0F,
+
+  ALU_CARRY_IGNORE = 0x10, // treat the carry in as 0
+};
+
+// Bus-operation scripts. A script is a sequence of one-byte operations,
+// each followed by its argument bytes, that the host uploads and the Nano
+// runs with RunScript() as a single command. Branch offsets are signed and
+// relative to the operation after the branch. The host assembles scripts
+// from text (see script.go in the host package).
+enum : byte {
+  SCRIPT_END   = 0x00, // stop; running off the end of the script also stops
+  SCRIPT_AH    = 0x01, // value
+  SCRIPT_AL    = 0x02, // value
+  SCRIPT_DH    = 0x03, // value
+  SCRIPT_DL    = 0x04, // value
+  SCRIPT_ADHL  = 0x05, // ah, al, dh, dl
+  SCRIPT_MCR   = 0x06, // value
+  SCRIPT_ACR   = 0x07, // value
+  SCRIPT_K     = 0x08, // k3, k2, k1, k0
+  SCRIPT_CLOCK = 0x09, // count (0 means 256)
+  SCRIPT_READ  = 0x0A, // append the BIR to the results
+  SCRIPT_CMP   = 0x0B, // value, mask: compare the BIR under the mask
+  SCRIPT_BEQ   = 0x0C, // offset: branch if the last compare was equal
+  SCRIPT_BNE   = 0x0D, // offset: branch if it wasn't
+  SCRIPT_LOOP  = 0x0E, // count (0 means 256): run up to the matching NEXT
+  SCRIPT_NEXT  = 0x0F,
+  SCRIPT_FAIL  = 0x10, // code: stop with SCRIPT_FAILED
+  N_SCRIPT_OPS = 0x11
+};
+
+// The status of a script when it stops
+enum : byte {
+  SCRIPT_OK         = 0, // reached the end
+  SCRIPT_FAILED     = 1, // executed SCRIPT_FAIL
+  SCRIPT_BAD_OP     = 2, // invalid operation or truncated arguments
+  SCRIPT_BAD_BRANCH = 3, // branch out of the script, or NEXT without LOOP
+  SCRIPT_OVERFLOW   = 4, // too many results or nested loops
+  SCRIPT_TOO_LONG   = 5, // ran more than SCRIPT_MAX_STEPS operations
+};
+
+typedef struct scriptResult {
+  byte status;
+  byte pc;       // offset of the operation that stopped the script
+  byte code;     // argument of SCRIPT_FAIL, or 0
+  byte nResults;
+} ScriptResult;
+
+void RunScript(const byte *script, byte len, byte *results, byte maxResults, ScriptResult *sr);
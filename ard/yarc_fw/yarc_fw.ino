@@ -40,6 +40,9 @@
 // put the task table in ROM (see task_runner.h). We make similar use
 // of PROGMEM for data tables in several of the task modules.
 
+#include <EEPROM.h>
+#include <util/crc16.h>
+
 typedef unsigned short ushort;
 
 #include "task_decls.h"
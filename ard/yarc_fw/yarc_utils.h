@@ -25,6 +25,20 @@ void WriteK(byte k3, byte k2, byte k1, byte k0) {
   PortPrivate::internalWriteK(k3, k2, k1, k0);
 }
 
+// Write a K register word whose bytes were reversed when it was built,
+// typically a constexpr like K_WRMEM16_FROM_NANO (see task_decls.h).
+void WriteK(KWord k) {
+  PortPrivate::internalWriteKReversed(k.r3, k.r2, k.r1, k.r0);
+}
+
+// Write only the bytes of K that differ from the copy at *k (k3 at offset
+// 0) and update the copy. The copy must hold the current content of K,
+// e.g. because the caller wrote all of K with WriteK() and nothing else
+// has written K since. Like WriteK(), this alters external registers.
+void UpdateK(byte *k, byte k3, byte k2, byte k1, byte k0) {
+  PortPrivate::internalUpdateK(k, k3, k2, k1, k0);
+}
+
 // Read n bytes from the given slice of the given opcode.
 void ReadSlice(byte opcode, byte slice, byte *data, byte n) {
   PortPrivate::readBytesFromSlice(opcode | 0x80, slice, data, n);
@@ -38,17 +52,18 @@ void ReadSlice(byte opcode, byte slice, byte *data, byte n) {
 // the data array. Return n for success.
 int WriteSlice(byte opcode, byte slice, byte *data, byte n, bool panicOnFail) {
   PortPrivate::writeBytesToSlice(opcode | 0x80, slice, data, n);
-  byte written[64];
-  PortPrivate::readBytesFromSlice(opcode | 0x80, slice, written, n);
-  for (int i = 0; i < n; ++i) {
-    if (data[i] != written[i]) {
-      if (panicOnFail) {
-        panic(PANIC_UCODE_VERIFY, opcode);
-      }
-      return i;
-    }
+  byte bad = PortPrivate::verifyBytesInSlice(opcode | 0x80, slice, data, n, 1);
+  if (bad < n && panicOnFail) {
+    panic(PANIC_UCODE_VERIFY, opcode);
   }
-  return n;
+  return bad;
+}
+
+// Write the microcode RAM as WriteSlice() does, but don't verify it. The
+// download protocol uses this when the host has turned verification off
+// or will verify the whole store with a digest afterward.
+void WriteSliceFast(byte opcode, byte slice, byte *data, byte n) {
+  PortPrivate::writeBytesToSlice(opcode | 0x80, slice, data, n);
 }
 
 // This function is used by both ReadALU() and WriteALU(). We only need
@@ -81,68 +96,108 @@ void swizzleAddressToR1R0(unsigned short addr) {
     WriteReg(1, bits);
 }
 
-// Write and then validate up to n bytes of data to the ALU RAM at the given
-// address offset, where offset is a multiple of 64, n is exactly 64, and
-// offset + n <= END_ALU_MEM. There are three ALU RAMs that are written in
-// parallel but read separately, so we do four operations per byte. Doing
-// them together is faster than making a call to WriteALU() and then calling
-// ReadALU() three times, because here we only have to set up the addressing
-// once for each byte that is written and read - thanks to the alignment
-// restriction, none of the four high order address bits nor the carry bit
-// in the ACR will change during a single call.
-void WriteCheckALU(unsigned short offset, byte *data, unsigned short n) {
+// Load a register as WriteReg() does, but using the K copy at *k (see
+// UpdateK()) and without returning K to the idle word afterward. This
+// is for loops that write K again before the next clock; they must
+// write MICROCODE_IDLE to K when they finish.
+void loadRegister(byte *k, byte reg, unsigned short value) {
+  UpdateK(k, LOAD_REG_16_FROM_NANO(reg));
+  SetMCR(McrEnableRegisterWrite(MCR_SAFE));
+  SetADHL(0x7F, 0xFE, StoHB(value), StoLB(value));
+  SingleClock();
+  SetMCR(MCR_SAFE);
+}
+
+// Load the nybble of the ALU RAM address that comes from R0 (a, the low
+// nybble) or R1 (b, the high nybble), duplicated as swizzleAddressToR1R0()
+// describes. Walking the addresses in order, only R0 changes on most steps.
+inline void loadAluAddressNybble(byte *k, byte reg, byte nybble) {
+  loadRegister(k, reg, nybble | (nybble << 4));
+}
+
+// The implementation of WriteCheckALU() and WriteALUFast(), below.
+int writeAluChunk(unsigned short offset, byte *data, unsigned short n, bool verify, bool panicOnFail) {
   if ((offset&0x1FFC) != offset || n != 64) {
     panic(PANIC_ARGUMENT, 9);
   }
 
-  for (unsigned short addr = offset; addr < offset + n; ++addr, ++data) {
-    // Set the low order bits of the RAM address in R1 and R0
-    swizzleAddressToR1R0(addr);
+  byte k[4] = { MICROCODE_IDLE };
+  WriteK(K_IDLE);
+  PortInvalidateImage(STORE_ALU);
 
-    // Now the four high order address bits. These bits come from the
-    // microcode although they could probably come from the IR if I 
-    // changed the WR_ALU_FROM_NANO microcode word to select it. We
-    // only have to set this once because the write is aligned.
-    byte aluBits = (addr >> 9) & 0x000F;
-    WriteK(WR_ALU_RAM_FROM_NANO(aluBits));
+  byte aluBits = (offset >> 9) & 0x000F;
+  byte a8 = (offset & 0x100) ? 1 : 0;
+  byte writeAcr = AcrEnable(AcrSetA8(AcrSetOp(ACR_SAFE, ACR_WRITE), a8));
 
-    // Now set the ACR, including address bit :8 (the carry bit),
-    // to do a write. And then do the write.
-    byte acrBits = AcrSetOp(ACR_SAFE, ACR_WRITE);
-    acrBits = AcrSetA8(acrBits, (addr & 0x100) ? 1 : 0);
-    SetACR(AcrEnable(acrBits));
+  int bad = n;
+  for (unsigned short addr = offset; addr < offset + n; ++addr, ++data) {
+    if (addr == offset || (addr & 0x0F) == 0) {
+      loadAluAddressNybble(k, 1, (addr & 0xF0) >> 4);
+    }
+    loadAluAddressNybble(k, 0, addr & 0x0F);
 
+    UpdateK(k, WR_ALU_RAM_FROM_NANO(aluBits));
+    SetACR(writeAcr);
     SetMCR(McrEnableWcs(MCR_SAFE));
     SetADHL(0x7F, 0xFF, 0xBB, *data);
     SingleClock();
     SetACR(ACR_SAFE);
     SetMCR(MCR_SAFE);
+    if (!verify) {
+      continue;
+    }
 
-    // Now read back and check all 3 RAMs. Since the high order
-    // address bits won't change within a call, we only need to
-    // set them once, along with setting the control lines to read.
-    WriteK(RD_ALU_RAM_FROM_NANO(aluBits));
-
-    // The key optimization over calling WriteALU() and then three
-    // ReadALU() calls is here: we don't have to WriteK in the loop.
+    // Now read back and check all 3 RAMs. The ACR goes straight from
+    // one RAM to the next without passing through ACR_SAFE, which saves
+    // two ACR loads per byte. The ACR is a single register, so only one
+    // RAM has its outputs enabled at a time.
+    UpdateK(k, RD_ALU_RAM_FROM_NANO(aluBits));
     for (byte ram = 0; ram < 3; ++ram) {
-      byte acrBits = AcrSetOp(ACR_SAFE, ram);
-      acrBits = AcrSetA8(acrBits, (addr & 0x100) ? 1 : 0);
-      SetACR(AcrEnable(acrBits));
+      SetACR(AcrEnable(AcrSetA8(AcrSetOp(ACR_SAFE, ram), a8)));
       SetMCR(McrEnableWcs(MCR_SAFE));
       SetADHL(0xFF, 0xFF, 0xCC, 0xBB);
       SingleClock();
       bool ok = (GetBIR() == *data);
-      SetACR(ACR_SAFE);
       SetMCR(MCR_SAFE);
       if (!ok) {
-        // This panic can be confused with statically-allocated
-        // panic codes, but it's worth it to get some information.
-        panic(n, ram);
+        SetACR(ACR_SAFE);
+        if (panicOnFail) {
+          // This panic can be confused with statically-allocated
+          // panic codes, but it's worth it to get some information.
+          panic(n, ram);
+        }
+        if (bad == n) {
+          bad = addr - offset;
+        }
       }
     }
+    SetACR(ACR_SAFE);
   }
-  WriteK(MICROCODE_IDLE);
+  WriteK(K_IDLE);
+  return bad;
+}
+
+// Write and then validate up to n bytes of data to the ALU RAM at the given
+// address offset, where offset is a multiple of 64, n is exactly 64, and
+// offset + n <= END_ALU_MEM. There are three ALU RAMs that are written in
+// parallel but read separately, so we do four operations per byte. Thanks
+// to the alignment restriction, none of the four high order address bits
+// nor the carry bit in the ACR change during a single call, and walking the
+// addresses in order, R1 (the high nybble) changes only every 16 bytes.
+// So for most bytes the only register load is R0, and we keep a copy of K
+// so that only the bytes of K that change are written: switching from
+// the write word to the read word, for example, changes only K0. If the
+// panic argument is true and verification fails, panic with the count n
+// and subcode = the RAM. If it's false, return the index of the failed
+// byte. Return n for success.
+int WriteCheckALU(unsigned short offset, byte *data, unsigned short n, bool panicOnFail) {
+  return writeAluChunk(offset, data, n, true, panicOnFail);
+}
+
+// Write 64 bytes of ALU RAM at a 64-byte boundary as WriteCheckALU() does,
+// but don't read them back.
+void WriteALUFast(unsigned short offset, byte *data, unsigned short n) {
+  writeAluChunk(offset, data, n, false, false);
 }
 
 // Write up to "n" bytes of data to ALU RAM at the given offset. The values
@@ -153,6 +208,7 @@ void WriteALU(unsigned short offset, byte *data, unsigned short n) {
   if (offset >= END_ALU_MEM || n >= 256 || offset + n > END_ALU_MEM) {
     panic(PANIC_ARGUMENT, 10);
   }
+  PortInvalidateImage(STORE_ALU);
 
   for (unsigned short addr = offset; addr < offset + n; ++addr, ++data) {
     // Set the low order bits of the RAM address in R1 and R0
@@ -184,7 +240,7 @@ void WriteALU(unsigned short offset, byte *data, unsigned short n) {
     SetACR(ACR_SAFE);
     SetMCR(MCR_SAFE);
   }
-  WriteK(MICROCODE_IDLE);
+  WriteK(K_IDLE);
 }
 
 // Read "n" bytes of data from the address offset of the ALU RAM identified
@@ -231,35 +287,285 @@ void ReadALU(unsigned short offset, byte *data, unsigned short n, byte ramID) {
     SetACR(ACR_SAFE);
     SetMCR(MCR_SAFE);
   }
-  WriteK(MICROCODE_IDLE);
+  WriteK(K_IDLE);
 }
 
-// Write the bytes at *data to microcode memory. The length of the data array
-// must be 4 * nWords bytes, so this function can write as much as 256 bytes
-// of data.
-void WriteMicrocode(byte opcode, byte *data, byte nWords) {
-  constexpr byte SIZE = 64;
+// Read "n" addresses of all three ALU RAMs starting at offset into *data,
+// which must have room for 3 * n bytes. The bytes for each address are
+// interleaved in RAM order (low RAM, high nybble carry = 0 RAM, high
+// nybble carry = 1 RAM), so for a correctly loaded ALU each address gives
+// three equal bytes. The address setup is done once for the three reads,
+// and as in WriteCheckALU(), R1 is loaded only when the high nybble of the
+// low address byte changes and K only when the high address bits do. This
+// is about three times as fast as three calls to ReadALU().
+void ReadALU3(unsigned short offset, byte *data, unsigned short n) {
+  if (offset >= END_ALU_MEM || n > CHUNK_SIZE || offset + n > END_ALU_MEM) {
+    panic(PANIC_ARGUMENT, 21);
+  }
+
+  byte k[4] = { MICROCODE_IDLE };
+  WriteK(K_IDLE);
+
+  for (unsigned short addr = offset; addr < offset + n; ++addr) {
+    if (addr == offset || (addr & 0x0F) == 0) {
+      loadAluAddressNybble(k, 1, (addr & 0xF0) >> 4);
+    }
+    loadAluAddressNybble(k, 0, addr & 0x0F);
+
+    byte aluBits = (addr >> 9) & 0x000F;
+    byte a8 = (addr & 0x100) ? 1 : 0;
+    UpdateK(k, RD_ALU_RAM_FROM_NANO(aluBits));
+    for (byte ram = 0; ram < 3; ++ram) {
+      SetACR(AcrEnable(AcrSetA8(AcrSetOp(ACR_SAFE, ram), a8)));
+      SetMCR(McrEnableWcs(MCR_SAFE));
+      SetADHL(0xFF, 0xFF, 0xCC, 0xBB);
+      SingleClock();
+      *data++ = GetBIR();
+      SetMCR(MCR_SAFE);
+    }
+    SetACR(ACR_SAFE);
+  }
+  WriteK(K_IDLE);
+}
+
+// Most of the cost of an ALU RAM access is setting the low order address
+// byte, which takes register loads and K writes (see the function
+// swizzleAddressToR1R0()). So when the data for each address can be computed
+// rather than sent, instead of walking the addresses in order, we set up each
+// low order byte once and then write it in each of the 32 combinations of the
+// four high order bits (from K) and the carry bit (from the ACR) that are in
+// range. The value function returns the byte for an address, or -1 to leave
+// the address unchanged. Every verifyEvery'th address (counting from offset,
+// 0 for none) is read back from all three RAMs. Return the index of the first
+// byte that failed verification, or n for success. As in WriteCheckALU(),
+// R1 is loaded only when the high nybble changes and K is written through
+// a copy, so alternating between the write and read words is cheap.
+typedef int (*AluValueFunction)(unsigned short addr, const byte *arg);
+
+int writeComputedALU(unsigned short offset, unsigned short n, AluValueFunction valueAt,
+                     const byte *arg, unsigned short verifyEvery) {
+  if (offset >= END_ALU_MEM || offset + n > END_ALU_MEM) {
+    panic(PANIC_ARGUMENT, 15);
+  }
+  if (n == 0) {
+    return 0;
+  }
+
+  byte k[4] = { MICROCODE_IDLE };
+  WriteK(K_IDLE);
+  PortInvalidateImage(STORE_ALU);
+
+  unsigned short end = offset + n;
+  unsigned short bad = n;
+  byte highNybble = 0xFF; // nothing loaded in R1 yet
+  for (unsigned short low = 0; low < 0x100; ++low) {
+    bool haveAddress = false;
+    for (unsigned short addr = (offset & 0x1F00) | low; addr < end; addr += 0x100) {
+      int value = (addr < offset) ? -1 : (*valueAt)(addr, arg);
+      if (value < 0) {
+        continue;
+      }
+      if (!haveAddress) {
+        if ((low >> 4) != highNybble) {
+          highNybble = low >> 4;
+          loadAluAddressNybble(k, 1, highNybble);
+        }
+        loadAluAddressNybble(k, 0, low & 0x0F);
+        haveAddress = true;
+      }
+
+      byte aluBits = (addr >> 9) & 0x000F;
+      byte a8 = (addr & 0x100) ? 1 : 0;
+      UpdateK(k, WR_ALU_RAM_FROM_NANO(aluBits));
+      SetACR(AcrEnable(AcrSetA8(AcrSetOp(ACR_SAFE, ACR_WRITE), a8)));
+      SetMCR(McrEnableWcs(MCR_SAFE));
+      SetADHL(0x7F, 0xFF, 0xBB, value);
+      SingleClock();
+      SetACR(ACR_SAFE);
+      SetMCR(MCR_SAFE);
+
+      if (verifyEvery == 0 || ((addr - offset) % verifyEvery) != 0) {
+        continue;
+      }
+      UpdateK(k, RD_ALU_RAM_FROM_NANO(aluBits));
+      for (byte ram = 0; ram < 3; ++ram) {
+        SetACR(AcrEnable(AcrSetA8(AcrSetOp(ACR_SAFE, ram), a8)));
+        SetMCR(McrEnableWcs(MCR_SAFE));
+        SetADHL(0xFF, 0xFF, 0xCC, 0xBB);
+        SingleClock();
+        bool ok = (GetBIR() == value);
+        SetMCR(MCR_SAFE);
+        if (!ok && addr - offset < bad) {
+          bad = addr - offset;
+        }
+      }
+      SetACR(ACR_SAFE);
+    }
+  }
+  WriteK(K_IDLE);
+  return bad;
+}
+
+int fillValue(unsigned short addr, const byte *value) {
+  return *value;
+}
+
+// Fill n bytes of ALU RAM at the given offset with value. Every
+// verifyEvery'th address (counting from offset, 0 for none) is read
+// back from all three RAMs. Return the index of the first byte that
+// failed verification, or n for success.
+int FillALU(unsigned short offset, byte value, unsigned short n, unsigned short verifyEvery) {
+  return writeComputedALU(offset, n, fillValue, &value, verifyEvery);
+}
+
+// Return the table entry for the ALU RAM address under the descriptor.
+byte AluTableValue(byte descriptor, unsigned short addr) {
+  byte c = ((descriptor & ALU_CARRY_IGNORE) == 0) ? (addr >> 8) & 1 : 0;
+  byte b = (addr >> 4) & 0x0F;
+  byte a = addr & 0x0F;
+  byte x = a;        // the operands of an arithmetic function, for V
+  byte y = b;
+  byte result;
+  bool arithmetic = true;
+
+  switch (descriptor & ALU_FN_MASK) {
+  case ALU_FN_ADD:  result = a + b + c; break;
+  case ALU_FN_SUB:  y = ~b & 0x0F; result = a + y + c; break;
+  case ALU_FN_RSUB: x = b; y = ~a & 0x0F; result = x + y + c; break;
+  case ALU_FN_NEG:  x = ~a & 0x0F; y = 0; result = x + c; break;
+  case ALU_FN_NAND: result = ~(a & b) & 0x0F; arithmetic = false; break;
+  case ALU_FN_OR:   result = a | b; arithmetic = false; break;
+  case ALU_FN_XOR:  result = a ^ b; arithmetic = false; break;
+  case ALU_FN_NOT:  result = ~a & 0x0F; arithmetic = false; break;
+  case ALU_FN_PASS:
+    return (b == 0) ? 0x20 : b;
+  default:
+    return 0;
+  }
+
+  // The carry, if any, is already in place as bit 4 (0x10).
+  if ((result & 0x0F) == 0) result |= 0x20;
+  if (result & 0x08) result |= 0x40;
+  if (arithmetic && (x & 0x08) == (y & 0x08) && (result & 0x08) != (x & 0x08)) result |= 0x80;
+  return result;
+}
+
+int tableValue(unsigned short addr, const byte *descriptors) {
+  byte descriptor = descriptors[addr >> 9];
+  if ((descriptor & ALU_FN_MASK) == ALU_FN_NONE) {
+    return -1;
+  }
+  return AluTableValue(descriptor, addr);
+}
+
+// Generate the ALU RAM tables for the 16 operations from an array of 16
+// descriptors and write them, verifying every verifyEvery'th address (0
+// for none) in all three RAMs. This replaces downloading up to 8k bytes
+// from the host. Return the index of the first byte that failed
+// verification, or END_ALU_MEM for success.
+int GenerateALU(const byte *descriptors, unsigned short verifyEvery) {
+  return writeComputedALU(0, END_ALU_MEM, tableValue, descriptors, verifyEvery);
+}
+
+// Generate n bytes of the tables at offset, as GenerateALU() does, so
+// the tables can be written a piece at a time. Return the index (from
+// offset) of the first byte that failed verification, or n for success.
+int GenerateALURange(const byte *descriptors, unsigned short offset, unsigned short n,
+                     unsigned short verifyEvery) {
+  return writeComputedALU(offset, n, tableValue, descriptors, verifyEvery);
+}
+
+// Write nWords microcode words at *data to the slots of the opcode
+// [0x80..0xFF] starting at slot first, and verify them. The data is in slot
+// order, 4 bytes per slot. If bigEndian is true, the first byte of each slot is K3, as in
+// the microcode #defines in the firmware; otherwise it's K0, as in the
+// assembler's output and the download protocol. All four slices are
+// written and then all four are verified, directly from the interleaved
+// data, so there is no transpose buffer. If the panic argument is true and
+// verification fails, panic with UCODE_VERIFY and subcode = the opcode.
+// If the panic argument is false and verification fails, return the offset
+// of the failed byte within the data array. Return 4 * nWords for success.
+int WriteOpcode(byte opcode, byte first, byte *data, byte nWords, bool bigEndian, bool panicOnFail) {
+  constexpr byte nSlices = 4;
+
+  WriteOpcodeFast(opcode, first, data, nWords, bigEndian);
+  for (byte i = 0; i < nSlices; ++i) {
+    byte slice = bigEndian ? (nSlices - 1) - i : i;
+    byte bad = PortPrivate::verifyBytesInSlice(opcode | 0x80, slice, data + i, nWords, nSlices, first);
+    if (bad < nWords) {
+      if (panicOnFail) {
+        panic(PANIC_UCODE_VERIFY, opcode);
+      }
+      return nSlices * bad + i;
+    }
+  }
+  return nSlices * nWords;
+}
+
+// Write the slots of an opcode as WriteOpcode() does, but don't verify them.
+void WriteOpcodeFast(byte opcode, byte first, byte *data, byte nWords, bool bigEndian) {
   constexpr byte nSlices = 4;
-  byte sliceBuffer[SIZE];
 
-  if (nWords > SIZE) {
+  if (first + nWords > 64) {
     panic(PANIC_ARGUMENT, 5);
   }
 
-  unsigned short nBytes = nSlices * nWords;
-  byte bytesPerSlice = nWords;
-  byte packed;
+  for (byte i = 0; i < nSlices; ++i) {
+    byte slice = bigEndian ? (nSlices - 1) - i : i;
+    PortPrivate::writeBytesToSlice(opcode | 0x80, slice, data + i, nWords, nSlices, first);
+  }
+}
+
+// Write the bytes at *data to microcode memory. The length of the data array
+// must be 4 * nWords bytes, so this function can write as much as 256 bytes
+// of data. The microcode is big-endian (K3 first) and the write is verified.
+void WriteMicrocode(byte opcode, byte *data, byte nWords) {
+  WriteOpcode(opcode, 0, data, nWords, true, true);
+}
+
+// Fill the first n slots [usefully, 1 to 64] of slice s [0..3] of opcode
+// [0x80..0xFF] with value. The data register is loaded once, so this is
+// much faster than WriteSlice() with a buffer of identical bytes. If verify
+// is true, the slice is read back and the index of the first bad slot is
+// returned. Return n for success. This function does not panic.
+int FillSlice(byte opcode, byte slice, byte value, byte n, bool verify) {
+  if (n > 64) {
+    panic(PANIC_ARGUMENT, 13);
+  }
+  PortPrivate::fillBytesInSlice(opcode | 0x80, slice, value, n);
+  if (!verify) {
+    return n;
+  }
+  return PortPrivate::verifyBytesInSlice(opcode | 0x80, slice, &value, n, 0);
+}
 
-  for (byte slice = 0; slice < nSlices; ++slice) {
-    packed = 0;
-    for (unsigned short i = 0; i < nBytes; i += nSlices) {
-      sliceBuffer[packed] = data[slice + i];
-      packed++;
+// Fill all 64 slots of all four slices of every opcode 0x80..0xFF with
+// value. Readback of microcode RAM is sequential, so verification can't
+// skip slots; instead every verifyEvery'th opcode (starting with 0x80) is
+// verified in full, and verifyEvery == 0 means no verification. Return
+// the number of opcodes filled before the first one that failed
+// verification, i.e. 128 for success.
+int FillWCS(byte value, byte verifyEvery) {
+  int n;
+  for (n = 0; n < 128; ++n) {
+    byte op = 0x80 + n;
+    bool verify = verifyEvery != 0 && (n % verifyEvery) == 0;
+    for (byte slice = 0; slice < 4; ++slice) {
+      if (FillSlice(op, slice, value, 64, verify) != 64) {
+        return n;
+      }
     }
+  }
+  return n;
+}
 
-    // Here is the implementation of the big-endian microcode: the slice
-    // number we pass goes 3, 2, 1, 0 as the variable slice goes 0, 1, 2, 3.
-    WriteSlice(opcode, (nSlices - 1) - slice, sliceBuffer, bytesPerSlice, true);
+// Invalidate the memory image unless the write of nBytes at addr falls
+// entirely within scratch memory, which isn't part of the image (see
+// DigestChunk()).
+void invalidateMemImage(unsigned short addr, unsigned short nBytes) {
+  unsigned short offset = addr - SCRATCH_MEM; // wraps if addr < SCRATCH_MEM
+  if (offset >= SCRATCH_MEM_SIZE || nBytes > SCRATCH_MEM_SIZE - offset) {
+    PortInvalidateImage(STORE_MEM);
   }
 }
 
@@ -273,7 +579,8 @@ void WriteMem16(unsigned short addr, unsigned short *data, short nWords) {
   if (nWords < 0) {
     panic(PANIC_ARGUMENT, 1);
   }
-  WriteK(WRMEM16_FROM_NANO);
+  invalidateMemImage(addr, 2 * nWords);
+  WriteK(K_WRMEM16_FROM_NANO);
   SetMCR(MCR_SAFE);
   for (short i = 0; i < nWords; ++i) {
     SetADHL(StoHB(addr & 0x7F00), StoLB(addr), StoHB(*data), StoLB(*data));
@@ -284,6 +591,38 @@ void WriteMem16(unsigned short addr, unsigned short *data, short nWords) {
   SetMCR(MCR_SAFE);
 }
 
+// Compare nBytes at contiguous addresses starting at addr with the bytes
+// at *data. The Nano reads a byte per cycle anyway, so each byte is
+// compared as it's read and no buffer is needed. Return the index of the
+// first byte that differs, or nBytes if they are all the same. All Nano
+// machine state and the K register are altered.
+int verifyMem8(unsigned short addr, const unsigned char *data, short nBytes) {
+  WriteK(K_RDMEM8_TO_NANO);
+  SetMCR(McrEnableSysbus(MCR_SAFE));
+
+  short i;
+  for (i = 0; i < nBytes; ++i, ++addr) {
+    SetADHL(StoHB(addr | 0x8000), StoLB(addr), 0xAA, 0x55);
+    SingleClock();
+    if (GetBIR() != data[i]) {
+      break;
+    }
+  }
+  SetMCR(MCR_SAFE);
+  return i;
+}
+
+// Write nWords (at most 32) 16-bit words as WriteMem16() does and verify
+// them in place. Return the index of the first word that doesn't match,
+// or nWords for success.
+int WriteCheckMem16(unsigned short addr, unsigned short *data, short nWords) {
+  if (nWords > CHUNK_SIZE / 2) {
+    panic(PANIC_ARGUMENT, 22);
+  }
+  WriteMem16(addr, data, nWords);
+  return verifyMem8(addr, (unsigned char *)data, 2 * nWords) / 2;
+}
+
 // Read nWords 16-bit words into *data from contiguous addresses starting
 // at addr. All Nano machine state and the K register are altered.
 void ReadMem16(unsigned short addr, unsigned short *data, short nWords) {
@@ -293,7 +632,7 @@ void ReadMem16(unsigned short addr, unsigned short *data, short nWords) {
   if (nWords < 0) {
     panic(PANIC_ARGUMENT, 2);
   }
-  WriteK(RDMEM8_TO_NANO);
+  WriteK(K_RDMEM8_TO_NANO);
   SetMCR(McrEnableSysbus(MCR_SAFE));
 
   // The Nano can only read bytes (not words) from the data bus
@@ -308,14 +647,9 @@ void ReadMem16(unsigned short addr, unsigned short *data, short nWords) {
   SetMCR(MCR_SAFE);
 }
 
-// Write nBytes from *data at contiguous addresses starting at addr. All
-// Nano machine state and the K register are altered.
-void WriteMem8(unsigned short addr, unsigned char *data, short nBytes) {
-  if (nBytes < 0) {
-    panic(PANIC_ARGUMENT, 3);
-  }
-  WriteK(WRMEM8_FROM_NANO);
-  SetMCR(MCR_SAFE);
+// Write nBytes from *data at contiguous addresses starting at addr with
+// one byte cycle for each. The K register must hold WRMEM8_FROM_NANO.
+void writeByteCycles(unsigned short addr, unsigned char *data, short nBytes) {
   for (int i = 0; i < nBytes; ++i) {
     // The high data byte is a noise value that is not supposed to matter.
     SetADHL(StoHB(addr & 0x7F00), StoLB(addr), 0x99, StoLB(*data));
@@ -323,16 +657,62 @@ void WriteMem8(unsigned short addr, unsigned char *data, short nBytes) {
     addr++;
     data++;
   }  
+}
+
+// Runs shorter than this aren't worth the extra K register writes.
+constexpr short WRITE_COMBINE_MIN = 8;
+
+// Write nBytes from *data at contiguous addresses starting at addr. The
+// address need not be aligned. For runs of at least WRITE_COMBINE_MIN
+// bytes, each aligned pair of bytes is written in one 16-bit cycle (memory
+// words are little-endian) and byte cycles are used only for an unaligned
+// first or last byte, so this takes about half the bus cycles of writing
+// byte by byte. All Nano machine state and the K register are altered.
+void WriteMem8(unsigned short addr, unsigned char *data, short nBytes) {
+  if (nBytes < 0) {
+    panic(PANIC_ARGUMENT, 3);
+  }
+  invalidateMemImage(addr, nBytes);
+  SetMCR(MCR_SAFE);
+  if (nBytes >= WRITE_COMBINE_MIN) {
+    if (addr & 1) {
+      WriteK(K_WRMEM8_FROM_NANO);
+      writeByteCycles(addr, data, 1);
+      addr++; data++; nBytes--;
+    }
+    WriteK(K_WRMEM16_FROM_NANO);
+    for ( ; nBytes >= 2; nBytes -= 2) {
+      SetADHL(StoHB(addr & 0x7F00), StoLB(addr), data[1], data[0]);
+      SingleClock();
+      addr += 2;
+      data += 2;
+    }
+  }
+  if (nBytes > 0) {
+    WriteK(K_WRMEM8_FROM_NANO);
+    writeByteCycles(addr, data, nBytes);
+  }
   SetMCR(MCR_SAFE);
 }
 
+// Write nBytes (at most 64) as WriteMem8() does and verify them in place.
+// Return the index of the first byte that doesn't match, or nBytes for
+// success.
+int WriteCheckMem8(unsigned short addr, unsigned char *data, short nBytes) {
+  if (nBytes > CHUNK_SIZE) {
+    panic(PANIC_ARGUMENT, 27);
+  }
+  WriteMem8(addr, data, nBytes);
+  return verifyMem8(addr, data, nBytes);
+}
+
 // Read nBytes into *data from contiguous addresses starting at addr.
 // All Nano machine state and the K register are altered.
 void ReadMem8(unsigned short addr, unsigned char *data, short nBytes) {
   if (nBytes < 0) {
     panic(PANIC_ARGUMENT, 4);
   }
-  WriteK(RDMEM8_TO_NANO); // read memory byte
+  WriteK(K_RDMEM8_TO_NANO); // read memory byte
   SetMCR(McrEnableSysbus(MCR_SAFE));
 
   for (int i = 0; i < nBytes; ++i) {
@@ -345,6 +725,124 @@ void ReadMem8(unsigned short addr, unsigned char *data, short nBytes) {
   SetMCR(MCR_SAFE);
 }
 
+// Fill nWords 16-bit words at contiguous addresses starting at addr with
+// value. Addr must be aligned (even). The K register and the data registers
+// are set once, so each word costs only an address and a clock. Every
+// verifyEvery'th word (starting with the first) is then read back, and
+// verifyEvery == 0 means no verification. Return the index of the first
+// word that failed verification, or nWords for success.
+int FillMem16(unsigned short addr, unsigned short value, int nWords, int verifyEvery) {
+  if (addr & 1) {
+    panic(PANIC_ALIGNMENT, 3);
+  }
+  if (nWords < 0 || verifyEvery < 0) {
+    panic(PANIC_ARGUMENT, 14);
+  }
+  invalidateMemImage(addr, 2 * nWords);
+  WriteK(K_WRMEM16_FROM_NANO);
+  SetMCR(MCR_SAFE);
+  SetDH(StoHB(value));
+  SetDL(StoLB(value));
+  unsigned short a = addr;
+  SetAH(StoHB(a & 0x7F00));
+  for (int i = 0; i < nWords; ++i, a += 2) {
+    if (StoLB(a) == 0) {
+      SetAH(StoHB(a & 0x7F00));
+    }
+    SetAL(StoLB(a));
+    SingleClock();
+  }
+  SetMCR(MCR_SAFE);
+
+  if (verifyEvery == 0) {
+    return nWords;
+  }
+  WriteK(K_RDMEM8_TO_NANO);
+  SetMCR(McrEnableSysbus(MCR_SAFE));
+  int i;
+  for (i = 0; i < nWords; i += verifyEvery) {
+    a = addr + 2 * i;
+    // The data values are noise that's not supposed to matter
+    SetADHL(StoHB(a | 0x8000), StoLB(a), 0xAA, 0x55);
+    SingleClock();
+    byte lo = GetBIR();
+    SetADHL(StoHB(a | 0x8000), StoLB(a + 1), 0xAA, 0x55);
+    SingleClock();
+    if (BtoS(GetBIR(), lo) != value) {
+      break;
+    }
+  }
+  SetMCR(MCR_SAFE);
+  return (i < nWords) ? i : nWords;
+}
+
+// Memory search and compare run on the Nano so the host doesn't have to
+// read all of memory. Memory is read in blocks of this many bytes.
+constexpr byte SCAN_BLOCK = 32;
+
+// Search memory from start up to (not including) end for bytes or, if
+// words is true, aligned little-endian words that equal value in the bits
+// of mask. Store the addresses of up to maxFound matches at found and
+// return the number stored. The range must be within main memory.
+int SearchMem(unsigned short start, unsigned short end, unsigned short value,
+              unsigned short mask, bool words, unsigned short *found, int maxFound) {
+  if (start > end || end > END_MEM || maxFound < 0) {
+    panic(PANIC_ARGUMENT, 23);
+  }
+  if (words) {
+    start = (start + 1) & ~1;
+  } else {
+    value &= 0xFF;
+    mask &= 0xFF;
+  }
+  value &= mask;
+
+  byte block[SCAN_BLOCK];
+  int nFound = 0;
+  for (unsigned short addr = start; addr < end && nFound < maxFound; addr += SCAN_BLOCK) {
+    byte n = (end - addr < SCAN_BLOCK) ? end - addr : SCAN_BLOCK;
+    ReadMem8(addr, block, n);
+    byte step = words ? 2 : 1;
+    for (byte i = 0; i + step <= n && nFound < maxFound; i += step) {
+      unsigned short v = words ? BtoS(block[i + 1], block[i]) : block[i];
+      if ((v & mask) == value) {
+        found[nFound++] = addr + i;
+      }
+    }
+  }
+  return nFound;
+}
+
+// Compare the n bytes of memory at a with the n bytes at b. Store the
+// offsets of up to maxDiffs of the first mismatches at diffs. Return the
+// number of mismatches, saturating at 0xFFFF. The ranges must be within
+// main memory.
+unsigned short CompareMem(unsigned short a, unsigned short b, unsigned short n,
+                          unsigned short *diffs, int maxDiffs) {
+  if (a > END_MEM || b > END_MEM || END_MEM - a < n || END_MEM - b < n || maxDiffs < 0) {
+    panic(PANIC_ARGUMENT, 24);
+  }
+  byte blockA[SCAN_BLOCK];
+  byte blockB[SCAN_BLOCK];
+  unsigned short nDiffs = 0;
+  for (unsigned short off = 0; off < n; off += SCAN_BLOCK) {
+    byte len = (n - off < SCAN_BLOCK) ? n - off : SCAN_BLOCK;
+    ReadMem8(a + off, blockA, len);
+    ReadMem8(b + off, blockB, len);
+    for (byte i = 0; i < len; ++i) {
+      if (blockA[i] != blockB[i]) {
+        if (nDiffs < maxDiffs) {
+          diffs[nDiffs] = off + i;
+        }
+        if (nDiffs != 0xFFFF) {
+          nDiffs++;
+        }
+      }
+    }
+  }
+  return nDiffs;
+}
+
 // Write the argument value into general register reg, 0..3
 // This does not require running the YARC; the Nano can do it.
 void WriteReg(unsigned char reg, unsigned short value) {
@@ -364,7 +862,7 @@ void WriteReg(unsigned char reg, unsigned short value) {
   // bit in the MCR. But as soon as we enable YARC, the next
   // clock will write garbage into the target register unless
   // we put the current microcode word back to inactivity.
-  WriteK(0xFF, 0xFF, 0xFF, 0xFF);
+  WriteK(K_IDLE);
 }
 
 // Read the value of given general register. This function moves the register contents
@@ -374,6 +872,7 @@ void WriteReg(unsigned char reg, unsigned short value) {
 // general registers supply the data, and the YARC thinks it's doing a write cycle;
 // the memory controller "listens" to the YARC's signals and does the write.
 unsigned short ReadReg(unsigned char reg, unsigned short memAddr) {
+  invalidateMemImage(memAddr, 2);
   WriteK(STORE_REG_16_TO_MEMORY(reg));
   SetMCR(McrEnableSysbus(MCR_SAFE));
   SetADHL(0x80 | StoHB(memAddr), StoLB(memAddr), 0xAA, 0x55);
@@ -384,21 +883,152 @@ unsigned short ReadReg(unsigned char reg, unsigned short memAddr) {
   // byte of whatever was transferred to memory, i.e. the low byte of the register.
   byte low = GetBIR();
   // Similarly to WriteReg, we should put the microcode word back to inactivity now.
-  WriteK(0xFF, 0xFF, 0xFF, 0xFF);
+  WriteK(K_IDLE);
   byte high;
   ReadMem8(memAddr + 1, &high, 1);
   return BtoS(high, low);
 }
 
+// The Nano runs a few micro-programs of its own on the YARC, in the scratch
+// opcodes F0..FB, for things it can't do from the bus. They are installed
+// into the WCS once, after initialization, and again only if something
+// overwrites them, so using one costs just a write to the IR and clocks.
+// Every write to the WCS goes through the slice writers in port_task.h,
+// which call HelperOverwritten(); the resident bit for each scratch opcode
+// is set only after its helper has been written and verified. A helper
+// with no microcode is nWords idle (no-op) words.
+namespace HelperPrivate {
+  typedef struct helper {
+    byte opcode;
+    byte nWords;
+    const byte *microcode; // PROGMEM, big-endian (K3 first), or 0
+  } Helper;
+
+  const PROGMEM byte flagsMicrocode[] = {
+    LOAD_FLAGS_INDIRECT_R3,
+    MICROCODE_IDLE,
+  };
+
+  // The instructions of the COST aluexec test (see cost_task.h): R0 op
+  // the immediate at (R3), with the carry in from the C flag, into R2;
+  // store R2 and the flags at (R1), advance R1 by 4, R0 by 1 and R3 past
+  // the immediate, then fetch and decode. The RCW always comes from the
+  // microcode. The ACN of the operation comes from the IR (the low nybble
+  // of the opcode), so the same microcode at F3 and F5 through FB does
+  // eight operations. The increments, fetch and decode use ACN 0 (ADD)
+  // from the microcode with the carry in forced low.
+  constexpr Microcode axPhi1 = Microcode().acn(0).aluCtl(UCODE_ALU_PHI1).noCarry();
+  constexpr Microcode axPhi2 = Microcode().acn(0).aluCtl(UCODE_ALU_PHI2).regFromAlu().regWrite();
+  constexpr Microcode axOpPhi1 = Microcode().aluCtl(UCODE_ALU_PHI1).acnFromIR();
+  constexpr Microcode axOpPhi2 = Microcode().aluCtl(UCODE_ALU_PHI2).acnFromIR().regFromAlu().regWrite();
+  constexpr Microcode axIncrement = axPhi1.loadHold();
+  constexpr Microcode axNext = axIncrement.src1(3).src2(UCODE_SRC2_P2).sysdata(UCODE_BUS_MEM).mem16();
+
+  const PROGMEM byte aluExecMicrocode[] = {
+    // (R3) => port 2 holding register
+    UCODE_WORD(Microcode().src1(3).src2(0).aluCtl(UCODE_ALU_IN).loadHold().sysdata(UCODE_BUS_MEM).mem16()),
+    UCODE_WORD(axOpPhi1.src1(0)),                                   // phi1 of R0 op hold
+    UCODE_WORD(axOpPhi2.dst(2).loadFlags().flagsFromAlu()),         // phi2 => R2, flags
+    UCODE_WORD(Microcode().src1(1).src2(2).sysdata(UCODE_BUS_GR).memWrite().mem16()), // R2 => (R1)
+    UCODE_WORD(axIncrement.src1(1).src2(UCODE_SRC2_P2)),            // phi1 of R1 + 2
+    UCODE_WORD(axPhi2.dst(1)),                                      // phi2 => R1
+    UCODE_WORD(Microcode().src1(1).sysdata(UCODE_BUS_F).memWrite().mem16()), // F => (R1)
+    UCODE_WORD(axIncrement.src1(1).src2(UCODE_SRC2_P2)),            // phi1 of R1 + 2
+    UCODE_WORD(axPhi2.dst(1)),                                      // phi2 => R1
+    UCODE_WORD(axIncrement.src1(0).src2(UCODE_SRC2_P1)),            // phi1 of R0 + 1
+    UCODE_WORD(axPhi2.dst(0)),                                      // phi2 => R0
+    UCODE_WORD(axNext),                                             // phi1 of R3 + 2
+    UCODE_WORD(axPhi2.dst(3)),                                      // phi2 => R3
+    UCODE_WORD(axNext.loadIR()),                                    // fetch
+    UCODE_WORD(axPhi2.dst(3)),                                      // decode
+  };
+
+  const PROGMEM Helper helpers[] = {
+    { SCRATCH_OPCODE_F0, sizeof(flagsMicrocode) / 4, flagsMicrocode },
+    { SCRATCH_OPCODE_F3, sizeof(aluExecMicrocode) / 4, aluExecMicrocode },
+    { SCRATCH_OPCODE_F4, 64, 0 },
+    { SCRATCH_OPCODE_F5, sizeof(aluExecMicrocode) / 4, aluExecMicrocode },
+    { SCRATCH_OPCODE_F6, sizeof(aluExecMicrocode) / 4, aluExecMicrocode },
+    { SCRATCH_OPCODE_F7, sizeof(aluExecMicrocode) / 4, aluExecMicrocode },
+    { SCRATCH_OPCODE_F8, sizeof(aluExecMicrocode) / 4, aluExecMicrocode },
+    { SCRATCH_OPCODE_F9, sizeof(aluExecMicrocode) / 4, aluExecMicrocode },
+    { SCRATCH_OPCODE_FA, sizeof(aluExecMicrocode) / 4, aluExecMicrocode },
+    { SCRATCH_OPCODE_FB, sizeof(aluExecMicrocode) / 4, aluExecMicrocode },
+  };
+  constexpr byte N_HELPERS = sizeof(helpers) / sizeof(Helper);
+  constexpr byte MAX_HELPER_WORDS = 16;
+
+  unsigned short resident; // bit n for opcode 0xF0 + n
+
+  void install(byte h) {
+    byte opcode = pgm_read_byte_near(&helpers[h].opcode);
+    byte nWords = pgm_read_byte_near(&helpers[h].nWords);
+    const byte *microcode = (const byte *)pgm_read_ptr_near(&helpers[h].microcode);
+
+    if (microcode == 0) {
+      for (byte slice = 0; slice < 4; ++slice) {
+        if (FillSlice(opcode, slice, 0xFF, nWords, true) != nWords) {
+          panic(PANIC_UCODE_VERIFY, opcode);
+        }
+      }
+    } else {
+      // A slice at a time, so the buffer is one byte per word
+      byte data[MAX_HELPER_WORDS];
+      if (nWords > MAX_HELPER_WORDS) {
+        panic(PANIC_ARGUMENT, 25);
+      }
+      for (byte slice = 0; slice < 4; ++slice) {
+        for (byte k = 0; k < nWords; ++k) {
+          data[k] = pgm_read_byte_near(&microcode[4 * k + 3 - slice]);
+        }
+        WriteSlice(opcode, slice, data, nWords, true);
+      }
+    }
+    resident |= 1 << (opcode - SCRATCH_OPCODE_F0);
+  }
+}
+
+// Install all the helpers that aren't resident.
+void InstallHelpers() {
+  for (byte h = 0; h < HelperPrivate::N_HELPERS; ++h) {
+    byte opcode = pgm_read_byte_near(&HelperPrivate::helpers[h].opcode);
+    if ((HelperPrivate::resident & (1 << (opcode - SCRATCH_OPCODE_F0))) == 0) {
+      HelperPrivate::install(h);
+    }
+  }
+}
+
+// Make sure the helper for the scratch opcode is in the WCS, installing
+// it if it was overwritten. Panics if there is no helper for the opcode.
+void EnsureHelper(byte opcode) {
+  for (byte h = 0; h < HelperPrivate::N_HELPERS; ++h) {
+    if (pgm_read_byte_near(&HelperPrivate::helpers[h].opcode) == opcode) {
+      if ((HelperPrivate::resident & (1 << (opcode - SCRATCH_OPCODE_F0))) == 0) {
+        HelperPrivate::install(h);
+      }
+      return;
+    }
+  }
+  panic(PANIC_ARGUMENT, 26);
+}
+
+// Called for every write to the WCS. The opcode may have the high bit set.
+void HelperOverwritten(byte opcode) {
+  opcode |= 0x80;
+  if (opcode >= SCRATCH_OPCODE_F0 && opcode <= SCRATCH_OPCODE_FB) {
+    HelperPrivate::resident &= ~(1 << (opcode - SCRATCH_OPCODE_F0));
+  }
+}
+
 // The Nano doesn't have a write enable bit for the flags register the way it does
 // for the instruction register and the general registers, so it can't write directly
 // to the flags. (If we turn on the enable bit in the microcode and have the Nano try
 // to write, the value will be corrupted when we try to write to the microcode register
 // in order to turn the enable bit back off!) So instead, we have the YARC do it - we
 // store the flags value at the scratch location in main memory, set R3 to point at it,
-// write some microcode into microcode memory, set the instruction register to refer to
-// that, and then enable the YARC and give it a couple of clocks. (This function was the
-// first time the YARC ever "did anything" under microcode control.)
+// set the instruction register to refer to the resident flags helper microcode, and
+// then enable the YARC and give it a couple of clocks. (This function was the first
+// time the YARC ever "did anything" under microcode control.)
 void WriteFlags(byte flags) {
   WriteMem8(SCRATCH_MEM, &flags, 1);
   byte validFlags;
@@ -407,12 +1037,7 @@ void WriteFlags(byte flags) {
     panic(PANIC_MEM_VERIFY, validFlags); // I guess they're "invalid flags" now ;-)    
   }
   WriteReg(3, SCRATCH_MEM);
-
-  byte microcode[] = {
-    LOAD_FLAGS_INDIRECT_R3,
-    MICROCODE_IDLE,
-  };
-  WriteMicrocode(SCRATCH_OPCODE_F0, microcode, 2);
+  EnsureHelper(SCRATCH_OPCODE_F0);
 
   // Finally run the YARC to clock the value into F
   WriteIR(SCRATCH_OPCODE_F0, 0x00);
@@ -424,11 +1049,185 @@ void WriteFlags(byte flags) {
 
 // Read the flags register
 byte ReadFlags() {
-  WriteK(RD_FLAGS_TO_NANO); // read flags byte
+  WriteK(K_RD_FLAGS_TO_NANO); // read flags byte
   SetMCR(McrEnableSysbus(MCR_SAFE));
   SingleClock();
   SetMCR(MCR_SAFE);
   return GetBIR();
 }
 
+// Digests of the stores allow the firmware to detect whether the content
+// of the YARC's RAMs survived a reset of the Nano (see port_task.h). A
+// digest is a CRC-16 of the store's content, taken in chunks of 64 bytes
+// (64 addresses of ALU RAM) so it can be computed a little at a time in
+// the background. The host also uses digests of runs of chunks to verify
+// downloads (see stExtDigest()). Main memory and ALU RAM are taken in
+// address order. The WCS is taken a slice at a time, opcode by opcode,
+// and the scratch opcodes F0 through FB and scratch memory (see
+// SCRATCH_MEM) are not included because the Nano alters them in normal
+// operation. The three ALU RAMs are interleaved, three bytes per address
+// (see ReadALU3()).
+
+// Return the number of chunks in a store.
+unsigned short StoreChunks(byte store) {
+  switch (store) {
+  case STORE_WCS: return 128 * 4;
+  case STORE_MEM: return END_MEM / 64;
+  case STORE_ALU: return END_ALU_MEM / 64;
+  }
+  panic(PANIC_ARGUMENT, 16);
+  return 0;
+}
+
+// Update the digest crc with one chunk of a store and return it.
+unsigned short DigestChunk(byte store, unsigned short chunk, unsigned short crc) {
+  byte data[64];
+
+  switch (store) {
+  case STORE_WCS: {
+    byte opcode = 0x80 | (chunk >> 2);
+    if (opcode >= 0xF0 && opcode <= 0xFB) { // scratch opcodes
+      return crc;
+    }
+    ReadSlice(opcode, chunk & 3, data, sizeof(data));
+    break;
+  }
+  case STORE_MEM:
+    if (chunk * sizeof(data) >= SCRATCH_MEM) { // scratch memory
+      return crc;
+    }
+    ReadMem8(chunk * sizeof(data), data, sizeof(data));
+    break;
+  case STORE_ALU:
+    // All three RAMs, 16 addresses (48 bytes) at a time.
+    for (byte i = 0; i < 4; ++i) {
+      ReadALU3(chunk * sizeof(data) + 16 * i, data, 16);
+      for (byte j = 0; j < 48; ++j) {
+        crc = Crc16(crc, data[j]);
+      }
+    }
+    return crc;
+  default:
+    panic(PANIC_ARGUMENT, 17);
+  }
+
+  for (byte i = 0; i < sizeof(data); ++i) {
+    crc = Crc16(crc, data[i]);
+  }
+  return crc;
+}
+
+// Scripts let the host run a hardware test or bring-up sequence of port
+// operations as one command, without reflashing the firmware (see the
+// SCRIPT_ operations in yarc_decls.h). The script can do anything the
+// Nano can do to the bus, so the Nano is made safe when it stops. The
+// number of operations is limited so a script can't hang the Nano.
+constexpr unsigned short SCRIPT_MAX_STEPS = 20000;
+constexpr byte SCRIPT_MAX_LOOPS = 4;
+
+namespace ScriptPrivate {
+  // The number of argument bytes of each operation
+  const PROGMEM byte argCounts[N_SCRIPT_OPS] = {
+    0, 1, 1, 1, 1, 4, 1, 1, 4, 1, 0, 2, 1, 1, 1, 0, 1
+  };
+}
+
+void RunScript(const byte *script, byte len, byte *results, byte maxResults, ScriptResult *sr) {
+  struct {
+    byte start;
+    unsigned short remaining;
+  } loops[SCRIPT_MAX_LOOPS];
+  byte nLoops = 0;
+  bool equal = false;
+  byte pc = 0;
+
+  sr->status = SCRIPT_OK;
+  sr->code = 0;
+  sr->nResults = 0;
+  for (unsigned short steps = 0; pc < len; ++steps) {
+    sr->pc = pc;
+    byte op = script[pc];
+    if (steps == SCRIPT_MAX_STEPS) {
+      sr->status = SCRIPT_TOO_LONG;
+      break;
+    }
+    if (op >= N_SCRIPT_OPS || len - pc - 1 < pgm_read_byte_near(&ScriptPrivate::argCounts[op])) {
+      sr->status = SCRIPT_BAD_OP;
+      break;
+    }
+    const byte *arg = &script[pc + 1];
+    pc += 1 + pgm_read_byte_near(&ScriptPrivate::argCounts[op]);
 
+    if (op == SCRIPT_END) {
+      pc = sr->pc;
+      break;
+    }
+    switch (op) {
+    case SCRIPT_AH:    SetAH(arg[0]); break;
+    case SCRIPT_AL:    SetAL(arg[0]); break;
+    case SCRIPT_DH:    SetDH(arg[0]); break;
+    case SCRIPT_DL:    SetDL(arg[0]); break;
+    case SCRIPT_ADHL:  SetADHL(arg[0], arg[1], arg[2], arg[3]); break;
+    case SCRIPT_MCR:   SetMCR(arg[0]); break;
+    case SCRIPT_ACR:   SetACR(arg[0]); break;
+    case SCRIPT_K:     WriteK(arg[0], arg[1], arg[2], arg[3]); break;
+    case SCRIPT_CLOCK: {
+      byte n = arg[0];
+      do {
+        SingleClock();
+      } while (--n != 0);
+      break;
+    }
+    case SCRIPT_READ:
+      if (sr->nResults == maxResults) {
+        sr->status = SCRIPT_OVERFLOW;
+      } else {
+        results[sr->nResults++] = GetBIR();
+      }
+      break;
+    case SCRIPT_CMP:
+      equal = (GetBIR() & arg[1]) == arg[0];
+      break;
+    case SCRIPT_BEQ:
+    case SCRIPT_BNE:
+      if (equal == (op == SCRIPT_BEQ)) {
+        int target = pc + (signed char)arg[0];
+        if (target < 0 || target > len) {
+          sr->status = SCRIPT_BAD_BRANCH;
+        } else {
+          pc = target;
+        }
+      }
+      break;
+    case SCRIPT_LOOP:
+      if (nLoops == SCRIPT_MAX_LOOPS) {
+        sr->status = SCRIPT_OVERFLOW;
+      } else {
+        loops[nLoops].start = pc;
+        loops[nLoops].remaining = (arg[0] == 0) ? 256 : arg[0];
+        nLoops++;
+      }
+      break;
+    case SCRIPT_NEXT:
+      if (nLoops == 0) {
+        sr->status = SCRIPT_BAD_BRANCH;
+      } else if (--loops[nLoops - 1].remaining != 0) {
+        pc = loops[nLoops - 1].start;
+      } else {
+        nLoops--;
+      }
+      break;
+    case SCRIPT_FAIL:
+      sr->status = SCRIPT_FAILED;
+      sr->code = arg[0];
+      break;
+    }
+    if (sr->status != SCRIPT_OK) {
+      break;
+    }
+  }
+  if (sr->status == SCRIPT_OK) {
+    sr->pc = pc;
+  }
+  MakeSafe();
+}
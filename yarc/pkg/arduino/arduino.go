@@ -27,7 +27,8 @@
 // had appeared. It offers a read timeout. So it's no longer the case that
 // all reads must block indefinitely. I ripped out the Goroutines and changed
 // this code to do everything from the main thread (Goroutine). The struct
-// arduino remains, holding just a single field (it used to have more).
+// arduino remains, holding the port and, in framed mode (see frame.go),
+// the state of the link.
 
 package arduino
 
@@ -53,6 +54,7 @@ const resetDelay time.Duration = 4 * time.Second
 
 type Arduino struct {
 	port serial.Port
+	link *link // nil unless in framed mode
 }
 
 type NoResponseError time.Duration
@@ -83,11 +85,17 @@ func New(deviceName string, baudRate int) (*Arduino, error) {
 
 // Read the Nano until a byte is received or a timeout occurs
 func (arduino *Arduino) ReadFor(timeout time.Duration) (byte, error) {
+	if arduino.link != nil {
+		return arduino.readFramed(timeout)
+	}
 	return arduino.readByte(timeout)
 }
 
 // Write bytes to the Arduino.
 func (arduino *Arduino) Write(b []byte) error {
+	if arduino.link != nil {
+		return arduino.writeFramed(b)
+	}
 	return arduino.writeBytes(b)
 }
 
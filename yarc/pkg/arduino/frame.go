@@ -0,0 +1,266 @@
+// Copyright (c) Jeff Berkowitz 2021, 2023. All rights reserved.
+
+package arduino
+
+// Framed mode.
+//
+// In framed mode, the bytes of the protocol are carried in frames: a start
+// byte, a control byte, a length, up to frameMaxData data bytes, and the
+// CRC-16/XMODEM of the control, length and data bytes, MSB first. The
+// control byte holds the frame type and, for data and ack frames, the
+// sequence bit of the data frame. Each direction is stop and wait. Write()
+// sends a data frame and waits for its ack, sending it again after a nak
+// or frameResendDelay. ReadFor() acks the data frames from the Nano and
+// returns their bytes. The Nano doesn't ack our data until it has room for
+// it, so we can safely send more than 64 bytes at a time. After any error,
+// Resync() resets the link and the Nano's command layer in a few
+// milliseconds; the caller must then send a Sync command.
+//
+// The framing is described in the protocol spec and must match the
+// firmware (serial_task.h).
+
+import (
+	"errors"
+	"fmt"
+	"time"
+)
+
+const (
+	frameStart   = 0x7E
+	frameMaxData = 32
+
+	frameData   = 0x00
+	frameAck    = 0x40
+	frameNak    = 0x80
+	frameResync = 0xC0
+	frameType   = 0xC0 // mask
+	frameSeq    = 0x01 // mask
+
+	frameResendDelay = 50 * time.Millisecond
+	frameByteDelay   = 10 * time.Millisecond // max gap within a frame
+	frameAckDelay    = 5 * time.Second       // the Nano may defer commands this long
+	resyncTries      = 5
+)
+
+// State of the link in framed mode
+type link struct {
+	xmtSeq   byte
+	rcvSeq   byte
+	received []byte // from data frames, not yet read
+}
+
+type frame struct {
+	control byte
+	data    []byte
+}
+
+var errBadFrame = errors.New("bad frame")
+
+// Turn framed mode on or off. The caller has told the Nano.
+func (arduino *Arduino) SetFramed(on bool) {
+	if on {
+		arduino.link = &link{}
+	} else {
+		arduino.link = nil
+	}
+}
+
+// Return true if the connection is in framed mode.
+func (arduino *Arduino) Framed() bool {
+	return arduino.link != nil
+}
+
+// Reset both directions of the link and the Nano's command layer, which
+// is left unsynchronized. Discard everything received until then.
+func (arduino *Arduino) Resync() error {
+	if arduino.link == nil {
+		return fmt.Errorf("resync: not in framed mode")
+	}
+	for i := 0; i < resyncTries; i++ {
+		if err := arduino.writeFrame(frameResync, nil); err != nil {
+			return err
+		}
+		deadline := time.Now().Add(frameResendDelay)
+		for time.Now().Before(deadline) {
+			f, err := arduino.readFrame(time.Until(deadline))
+			if err == nil && f.control == frameResync {
+				*arduino.link = link{}
+				return nil
+			}
+			if _, timedOut := err.(NoResponseError); err != nil && err != errBadFrame && !timedOut {
+				return err
+			}
+		}
+	}
+	return fmt.Errorf("resync: no response after %d tries", resyncTries)
+}
+
+// Read a byte from the data frames.
+func (arduino *Arduino) readFramed(timeout time.Duration) (byte, error) {
+	link := arduino.link
+	deadline := time.Now().Add(timeout)
+	for len(link.received) == 0 {
+		if !time.Now().Before(deadline) {
+			return 0, NoResponseError(timeout)
+		}
+		if _, err := arduino.receive(time.Until(deadline)); err != nil {
+			if _, timedOut := err.(NoResponseError); !timedOut {
+				return 0, err
+			}
+		}
+	}
+	b := link.received[0]
+	link.received = link.received[1:]
+	return b, nil
+}
+
+// Write bytes in data frames, waiting for the ack of each.
+func (arduino *Arduino) writeFramed(toWrite []byte) error {
+	for len(toWrite) > 0 {
+		n := len(toWrite)
+		if n > frameMaxData {
+			n = frameMaxData
+		}
+		if err := arduino.sendData(toWrite[:n]); err != nil {
+			return err
+		}
+		toWrite = toWrite[n:]
+	}
+	return nil
+}
+
+func (arduino *Arduino) sendData(data []byte) error {
+	link := arduino.link
+	control := byte(frameData) | link.xmtSeq
+	deadline := time.Now().Add(frameAckDelay)
+	for time.Now().Before(deadline) {
+		if err := arduino.writeFrame(control, data); err != nil {
+			return err
+		}
+		resend := time.Now().Add(frameResendDelay)
+		for time.Now().Before(resend) {
+			f, err := arduino.receive(time.Until(resend))
+			if err != nil {
+				if _, timedOut := err.(NoResponseError); timedOut {
+					break
+				}
+				return err
+			}
+			if f == nil {
+				continue
+			}
+			if f.control == frameAck|link.xmtSeq {
+				link.xmtSeq ^= frameSeq
+				return nil
+			}
+			if f.control == frameNak {
+				break
+			}
+		}
+	}
+	return fmt.Errorf("write to Arduino: no ack after %v", frameAckDelay)
+}
+
+// Receive a frame, ack or nak it as required, and keep its data if
+// it's new. Return the frame, or nil if it was bad.
+func (arduino *Arduino) receive(timeout time.Duration) (*frame, error) {
+	link := arduino.link
+	f, err := arduino.readFrame(timeout)
+	if err == errBadFrame {
+		return nil, arduino.writeFrame(frameNak, nil)
+	}
+	if err != nil {
+		return nil, err
+	}
+	if f.control&frameType == frameData {
+		seq := f.control & frameSeq
+		if seq == link.rcvSeq {
+			link.received = append(link.received, f.data...)
+			link.rcvSeq ^= frameSeq
+		}
+		// If the seq is old, our ack was lost
+		if err := arduino.writeFrame(frameAck|seq, nil); err != nil {
+			return nil, err
+		}
+	}
+	return f, nil
+}
+
+// Read a frame. Bytes before the start byte are discarded. Return
+// errBadFrame if the frame is malformed, truncated, or fails the CRC.
+func (arduino *Arduino) readFrame(timeout time.Duration) (*frame, error) {
+	deadline := time.Now().Add(timeout)
+	for {
+		remaining := time.Until(deadline)
+		if remaining <= 0 {
+			return nil, NoResponseError(timeout)
+		}
+		b, err := arduino.readByte(remaining)
+		if err != nil {
+			return nil, err
+		}
+		if b == frameStart {
+			break
+		}
+	}
+
+	var header [2]byte
+	for i := range header {
+		b, err := arduino.readFrameByte()
+		if err != nil {
+			return nil, err
+		}
+		header[i] = b
+	}
+	control, n := header[0], int(header[1])
+	if n > frameMaxData || (n != 0 && control&frameType != frameData) {
+		return nil, errBadFrame
+	}
+	body := make([]byte, n+2)
+	for i := range body {
+		b, err := arduino.readFrameByte()
+		if err != nil {
+			return nil, err
+		}
+		body[i] = b
+	}
+	crc := Crc16Update(Crc16Update(0, header[:]), body[:n])
+	if crc != uint16(body[n])<<8|uint16(body[n+1]) {
+		return nil, errBadFrame
+	}
+	return &frame{control, body[:n]}, nil
+}
+
+// Read a byte within a frame. A timeout means the frame was truncated.
+func (arduino *Arduino) readFrameByte() (byte, error) {
+	b, err := arduino.readByte(frameByteDelay)
+	if _, timedOut := err.(NoResponseError); timedOut {
+		return 0, errBadFrame
+	}
+	return b, err
+}
+
+func (arduino *Arduino) writeFrame(control byte, data []byte) error {
+	f := make([]byte, 0, len(data)+5)
+	f = append(f, frameStart, control, byte(len(data)))
+	f = append(f, data...)
+	crc := Crc16Update(0, f[1:])
+	f = append(f, byte(crc>>8), byte(crc))
+	return arduino.writeBytes(f)
+}
+
+// Return the CRC-16/XMODEM (polynomial 0x1021) crc updated with data.
+// The Nano uses the same CRC for frames and store digests.
+func Crc16Update(crc uint16, data []byte) uint16 {
+	for _, b := range data {
+		crc ^= uint16(b) << 8
+		for i := 0; i < 8; i++ {
+			if crc&0x8000 != 0 {
+				crc = crc<<1 ^ 0x1021
+			} else {
+				crc <<= 1
+			}
+		}
+	}
+	return crc
+}
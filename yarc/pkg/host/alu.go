@@ -0,0 +1,147 @@
+// Copyright (c) Jeff Berkowitz 2021, 2023. All rights reserved.
+
+package host
+
+// ALU table generation.
+//
+// The ALU section of the download file is 8k bytes, 512 bytes for each
+// of 16 operations. Most operations are standard functions of the A and
+// B operands and the carry, which the Nano can compute much faster than
+// we can send them over the serial line. We describe each operation's
+// table with a descriptor byte. The Nano generates the tables for all
+// operations that have a descriptor (see GenerateALU() in yarc_utils.h)
+// and we download the rest in the usual way. The definitions here must
+// match AluTableValue() in the firmware.
+
+import (
+	"bytes"
+
+	"github.com/gmofishsauce/yarc/pkg/arduino"
+	sp "github.com/gmofishsauce/yarc/pkg/proto"
+)
+
+const (
+	aluFnNone   = 0x00 // not generated; download the table
+	aluFnAdd    = 0x01 // A + B + C
+	aluFnSub    = 0x02 // A + ~B + C
+	aluFnRsub   = 0x03 // B + ~A + C
+	aluFnNand   = 0x04
+	aluFnOr     = 0x05
+	aluFnXor    = 0x06
+	aluFnNot    = 0x07 // ~A
+	aluFnNeg    = 0x08 // ~A + C
+	aluFnPass   = 0x09 // B
+	aluFnLast   = aluFnPass
+	aluFnMask   = 0x0F
+	aluCarryIgn = 0x10 // treat the carry in as 0
+
+	aluOps       = 16
+	aluTableSize = AluSectionSize / aluOps
+	carryFlag    = 0x10
+	zeroFlag     = 0x20
+	negativeFlag = 0x40
+	overflowFlag = 0x80
+)
+
+// Return the table entry for the ALU RAM address under the descriptor.
+func aluTableValue(descriptor byte, addr int) byte {
+	c := (addr >> 8) & 1
+	if descriptor&aluCarryIgn != 0 {
+		c = 0
+	}
+	b := (addr >> 4) & 0x0F
+	a := addr & 0x0F
+	x, y := a, b // the operands of an arithmetic function, for V
+	var result int
+	arithmetic := true
+
+	switch descriptor & aluFnMask {
+	case aluFnAdd:
+		result = a + b + c
+	case aluFnSub:
+		y = ^b & 0x0F
+		result = a + y + c
+	case aluFnRsub:
+		x, y = b, ^a&0x0F
+		result = x + y + c
+	case aluFnNeg:
+		x, y = ^a&0x0F, 0
+		result = x + c
+	case aluFnNand:
+		result = ^(a & b) & 0x0F
+		arithmetic = false
+	case aluFnOr:
+		result = a | b
+		arithmetic = false
+	case aluFnXor:
+		result = a ^ b
+		arithmetic = false
+	case aluFnNot:
+		result = ^a & 0x0F
+		arithmetic = false
+	case aluFnPass:
+		if b == 0 {
+			return zeroFlag
+		}
+		return byte(b)
+	default:
+		return 0
+	}
+
+	// The carry, if any, is already in place as bit 4 (carryFlag).
+	if result&0x0F == 0 {
+		result |= zeroFlag
+	}
+	if result&0x08 != 0 {
+		result |= negativeFlag
+	}
+	if arithmetic && x&0x08 == y&0x08 && result&0x08 != x&0x08 {
+		result |= overflowFlag
+	}
+	return byte(result)
+}
+
+// Return the descriptor that generates the table, or aluFnNone if
+// none of the standard functions does.
+func aluDescriptor(op int, table []byte) byte {
+	for fn := byte(aluFnAdd); fn <= aluFnLast; fn++ {
+		for _, carry := range []byte{0, aluCarryIgn} {
+			matched := true
+			for i, b := range table {
+				if aluTableValue(fn|carry, op*aluTableSize+i) != b {
+					matched = false
+					break
+				}
+			}
+			if matched {
+				return fn | carry
+			}
+		}
+	}
+	return aluFnNone
+}
+
+// Return a descriptor for each of the 16 ALU operation tables in the
+// ALU section. All-zero tables are unused and get aluFnNone, as they
+// are skipped by the download.
+func aluDescriptors(content []byte) []byte {
+	descriptors := make([]byte, aluOps)
+	zeroes := make([]byte, aluTableSize)
+	for op := 0; op < aluOps; op++ {
+		table := content[op*aluTableSize : (op+1)*aluTableSize]
+		if bytes.Equal(table, zeroes) {
+			continue
+		}
+		descriptors[op] = aluDescriptor(op, table)
+	}
+	return descriptors
+}
+
+// Have the Nano generate the tables that have descriptors. The Nano
+// verifies them as the verification policy directs and counts any
+// failures (see ExtVerify); callers collect them with
+// setVerify(nano, verifyUnchanged), as verifySection() does.
+func generateAlu(nano *arduino.Arduino, descriptors []byte) error {
+	return doCountedSend(nano, []byte{sp.CmdExt, sp.ExtGenAlu, byte(len(descriptors))},
+		descriptors)
+}
@@ -0,0 +1,203 @@
+// Copyright (c) Jeff Berkowitz 2021, 2023. All rights reserved.
+
+package host
+
+// Clock bursts.
+//
+// Since protocol v21, the Nano can deliver an exact number of clocks,
+// as fast as it can (about 2MHz) or one every so many microseconds.
+// The burst runs in the background on the Nano, so we start it and
+// then poll its status until no clocks remain.
+//
+// Since protocol v22, the Nano can also clock the YARC until a value
+// appears on the bus or the YARC requests service, checking after each
+// clock. This replaces stepping with DoCycle and GetResult, which costs
+// a round trip per clock.
+
+import (
+	"fmt"
+	"strconv"
+	"strings"
+	"time"
+
+	"github.com/gmofishsauce/yarc/pkg/arduino"
+	sp "github.com/gmofishsauce/yarc/pkg/proto"
+)
+
+const burstPollInterval = 10 * time.Millisecond
+
+// Run until stop conditions and reasons, as numbered in the protocol.
+const (
+	runUntilBir     = 0x01
+	runUntilService = 0x02
+
+	runStopNone      = 0
+	runStopBir       = 1
+	runStopService   = 2
+	runStopBudget    = 3
+	runStopCancelled = 4
+
+	maxRunBudget = 1<<24 - 1
+)
+
+var runStopReasons = map[byte]string{
+	runStopNone:      "running",
+	runStopBir:       "bus value",
+	runStopService:   "service request",
+	runStopBudget:    "budget spent",
+	runStopCancelled: "cancelled",
+}
+
+type runResult struct {
+	reason byte
+	clocks uint32
+	bir    byte
+	mcr    byte
+}
+
+// Start a burst of count clocks, one every period microseconds,
+// or as fast as possible if period is 0. A count of 0 cancels
+// any burst in progress.
+func startClockBurst(nano *arduino.Arduino, count uint32, period uint16) error {
+	_, err := doFixedCommand(nano, []byte{sp.CmdExt, sp.ExtClockBurst,
+		byte(count >> 24), byte(count >> 16), byte(count >> 8), byte(count),
+		byte(period >> 8), byte(period)}, 0)
+	return err
+}
+
+// Return the number of clocks remaining in the burst.
+func clockBurstRemaining(nano *arduino.Arduino) (uint32, error) {
+	b, err := doCountedReceive(nano, []byte{sp.CmdExt, sp.ExtBurstStatus})
+	if err != nil {
+		return 0, err
+	}
+	if len(b) != 4 {
+		return 0, fmt.Errorf("burst status: unexpected length %d", len(b))
+	}
+	return uint32(b[0])<<24 | uint32(b[1])<<16 | uint32(b[2])<<8 | uint32(b[3]), nil
+}
+
+// Deliver count clocks and wait for the burst to complete.
+func clockBurst(nano *arduino.Arduino, count uint32, period uint16) error {
+	if err := startClockBurst(nano, count, period); err != nil {
+		return err
+	}
+	for {
+		remaining, err := clockBurstRemaining(nano)
+		if err != nil {
+			return err
+		}
+		if remaining == 0 {
+			return nil
+		}
+		time.Sleep(burstPollInterval)
+	}
+}
+
+// Command handler: cb count [period]
+func doClockBurst(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	words := strings.Fields(line)
+	if len(words) < 2 || len(words) > 3 {
+		fmt.Println("usage: cb count [period-usec]")
+		return nostr, nil
+	}
+	count, err := strconv.ParseUint(words[1], 0, 32)
+	if err != nil {
+		fmt.Println("usage: cb count [period-usec]")
+		return nostr, nil
+	}
+	var period uint64
+	if len(words) == 3 {
+		if period, err = strconv.ParseUint(words[2], 0, 16); err != nil {
+			fmt.Println("usage: cb count [period-usec]")
+			return nostr, nil
+		}
+	}
+
+	start := time.Now()
+	if err := clockBurst(nano, uint32(count), uint16(period)); err != nil {
+		return nostr, err
+	}
+	fmt.Printf("%d clocks in %v\n", count, time.Since(start))
+	return nostr, nil
+}
+
+// Return the result of the most recent burst or run until.
+func getRunResult(nano *arduino.Arduino) (runResult, error) {
+	var result runResult
+	b, err := doCountedReceive(nano, []byte{sp.CmdExt, sp.ExtRunResult})
+	if err != nil {
+		return result, err
+	}
+	if len(b) != 7 {
+		return result, fmt.Errorf("run result: unexpected length %d", len(b))
+	}
+	result.reason = b[0]
+	result.clocks = uint32(b[1])<<24 | uint32(b[2])<<16 | uint32(b[3])<<8 | uint32(b[4])
+	result.bir = b[5]
+	result.mcr = b[6]
+	return result, nil
+}
+
+// Clock the YARC until a stop condition holds or the budget is spent
+// and return the result.
+func runUntil(nano *arduino.Arduino, conditions byte, value byte, mask byte,
+	budget uint32) (runResult, error) {
+	_, err := doFixedCommand(nano, []byte{sp.CmdExt, sp.ExtRunUntil, conditions, value, mask,
+		byte(budget >> 16), byte(budget >> 8), byte(budget)}, 0)
+	if err != nil {
+		return runResult{}, err
+	}
+	for {
+		result, err := getRunResult(nano)
+		if err != nil || result.reason != runStopNone {
+			return result, err
+		}
+		time.Sleep(burstPollInterval)
+	}
+}
+
+// Command handler: ru budget [svc] [value [mask]]
+func doRunUntil(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	const usage = "usage: ru budget [svc] [bus-value [mask]]"
+	words := strings.Fields(line)
+	if len(words) < 2 {
+		fmt.Println(usage)
+		return nostr, nil
+	}
+	budget, err := strconv.ParseUint(words[1], 0, 32)
+	if err != nil || budget == 0 || budget > maxRunBudget {
+		fmt.Println(usage)
+		return nostr, nil
+	}
+	var conditions byte
+	var values []byte
+	for _, w := range words[2:] {
+		if w == "svc" {
+			conditions |= runUntilService
+			continue
+		}
+		v, err := strconv.ParseUint(w, 0, 8)
+		if err != nil || len(values) == 2 {
+			fmt.Println(usage)
+			return nostr, nil
+		}
+		values = append(values, byte(v))
+	}
+	var value, mask byte = 0, 0xFF
+	if len(values) > 0 {
+		conditions |= runUntilBir
+		value = values[0]
+	}
+	if len(values) > 1 {
+		mask = values[1]
+	}
+
+	result, err := runUntil(nano, conditions, value, mask, uint32(budget))
+	if err != nil {
+		return nostr, err
+	}
+	fmt.Printf("stopped after %d clocks (%s): BIR 0x%02X MCR 0x%02X\n",
+		result.clocks, runStopReasons[result.reason], result.bir, result.mcr)
+	return nostr, nil
+}
@@ -0,0 +1,67 @@
+// Copyright (c) Jeff Berkowitz 2021, 2023. All rights reserved.
+
+package host
+
+// Execution counters.
+//
+// Since protocol v24, the Nano counts the clocks it delivers to the
+// YARC for us, the time the YARC spends in run mode (and how much of
+// it with the fast clock), and the YARC's service requests. We use
+// these to track the performance of YARC programs across firmware and
+// microcode changes. (Service latency was counted too until v31, but
+// nothing in the firmware resets a service request yet.)
+
+import (
+	"encoding/binary"
+	"fmt"
+	"strings"
+
+	"github.com/gmofishsauce/yarc/pkg/arduino"
+	sp "github.com/gmofishsauce/yarc/pkg/proto"
+)
+
+const execCountersSize = 14
+
+type execCounters struct {
+	clocks          uint32
+	runMillis       uint32
+	fastMillis      uint32
+	serviceRequests uint16
+}
+
+// Return the execution counters, and clear them if clear is true.
+func getCounters(nano *arduino.Arduino, clear bool) (execCounters, error) {
+	var c execCounters
+	var clr byte
+	if clear {
+		clr = 1
+	}
+	b, err := doCountedReceive(nano, []byte{sp.CmdExt, sp.ExtCounters, clr})
+	if err != nil {
+		return c, err
+	}
+	if len(b) != execCountersSize {
+		return c, fmt.Errorf("counters: unexpected length %d", len(b))
+	}
+	c.clocks = binary.BigEndian.Uint32(b[0:])
+	c.runMillis = binary.BigEndian.Uint32(b[4:])
+	c.fastMillis = binary.BigEndian.Uint32(b[8:])
+	c.serviceRequests = binary.BigEndian.Uint16(b[12:])
+	return c, nil
+}
+
+// Command handler: ec [clear]
+func doCounters(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	words := strings.Fields(line)
+	if len(words) > 2 || (len(words) == 2 && words[1] != "clear") {
+		fmt.Println("usage: ec [clear]")
+		return nostr, nil
+	}
+	c, err := getCounters(nano, len(words) == 2)
+	if err != nil {
+		return nostr, err
+	}
+	fmt.Printf("clocks %d, run %d ms, fast clock %d ms\n", c.clocks, c.runMillis, c.fastMillis)
+	fmt.Printf("service requests %d\n", c.serviceRequests)
+	return nostr, nil
+}
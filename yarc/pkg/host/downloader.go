@@ -12,6 +12,7 @@ import (
 
 	"bufio"
 	"bytes"
+	"encoding/binary"
 	"fmt"
 	"log"
 )
@@ -45,6 +46,14 @@ const AluSectionSize = 8 * 1024
 const BinaryFileSize = MemorySectionSize + MicrocodeSectionSize + AluSectionSize
 const chunkSize = 64
 
+// Write microcode with one write opcode command per opcode (protocol
+// v13) instead of four write slice commands. Set false for older Nanos.
+const wholeOpcodeWrites = true
+
+// Download only the chunks whose digests differ from the Nano's digests
+// of the same chunks (protocol v20). Set false to download everything.
+const incrementalDownload = true
+
 // Download the entire yarc.bin file (the "binary") to the Nano.
 func doDownload(binary *bufio.Reader, nano *arduino.Arduino) error {
 	log.Println("downloading...")
@@ -54,35 +63,140 @@ func doDownload(binary *bufio.Reader, nano *arduino.Arduino) error {
 	if content, err = ReadFile(binary); err != nil {
 		return err
 	}
-	if err := doPoll(nano); err != nil {
-		return fmt.Errorf("during download: doPoll(): %s", err)
+	if err := waitForNanoReady(nano); err != nil {
+		return err
 	}
-
-	if err := doMemorySection(content[0:MicrocodeSectionBase], nano); err != nil {
+	status, err := getInitStatus(nano)
+	if err != nil {
 		return err
 	}
 	if err := doPoll(nano); err != nil {
 		return fmt.Errorf("during download: doPoll(): %s", err)
 	}
+	if _, err := setVerify(nano, verifyPolicy); err != nil {
+		return err
+	}
 
-	if err := doMicrocodeSection(content[MicrocodeSectionBase:AluSectionBase], nano); err != nil {
+	if err := doSection("memory", storeMem, initMemImage, status,
+		content[0:MicrocodeSectionBase], doMemorySection, nano); err != nil {
 		return err
 	}
-	if err := doPoll(nano); err != nil {
-		return fmt.Errorf("during download: doPoll(): %s", err)
+	if err := doSection("microcode", storeWcs, initWcsImage, status,
+		content[MicrocodeSectionBase:AluSectionBase], doMicrocodeSection, nano); err != nil {
+		return err
+	}
+	if err := doSection("ALU", storeAlu, initAluImage, status,
+		content[AluSectionBase:BinaryFileSize], doALUSection, nano); err != nil {
+		return err
 	}
 
-	if err := doALUSection(content[AluSectionBase:BinaryFileSize], nano); err != nil {
+	log.Println("download complete")
+	return nil
+}
+
+// Download one section of the binary unless the Nano reports that the
+// store already holds it. The Nano records a digest of each section after
+// it's loaded and checks the store against it after a warm reset (one
+// that didn't reset the YARC), so reconnecting doesn't cost a download.
+// The load function returns the chunks it wrote, which are verified
+// according to the verification policy (see verify.go).
+func doSection(name string, store byte, imageBit byte, status byte, section []byte,
+	load func([]byte, *arduino.Arduino) ([]int, error), nano *arduino.Arduino) error {
+	digest := crc16(section)
+	if status&imageBit != 0 {
+		loaded, err := getImage(nano, store)
+		if err != nil {
+			return err
+		}
+		if loaded == digest {
+			log.Printf("%s section is already loaded (digest 0x%04X)\n", name, digest)
+			return nil
+		}
+	}
+	written, err := load(section, nano)
+	if err != nil {
+		return err
+	}
+	if err := verifySection(nano, name, store, section, written); err != nil {
+		return err
+	}
+	if err := saveImage(nano, store, digest); err != nil {
 		return err
 	}
 	if err := doPoll(nano); err != nil {
 		return fmt.Errorf("during download: doPoll(): %s", err)
 	}
-
-	log.Println("download complete")
 	return nil
 }
 
+// Stores, as numbered in the protocol.
+const (
+	storeWcs = 0
+	storeMem = 1
+	storeAlu = 2
+)
+
+// Return the CRC-16/XMODEM (polynomial 0x1021, initial value 0) of data.
+// The Nano uses the same CRC.
+func crc16(data []byte) uint16 {
+	return arduino.Crc16Update(0, data)
+}
+
+// Return the digest of the section loaded in the store, or 0 if the
+// store doesn't hold the recorded image.
+func getImage(nano *arduino.Arduino, store byte) (uint16, error) {
+	b, err := doCountedReceive(nano, []byte{sp.CmdExt, sp.ExtGetImage, store})
+	if err != nil {
+		return 0, err
+	}
+	if len(b) != 2 {
+		return 0, fmt.Errorf("get image: unexpected length %d", len(b))
+	}
+	return binary.BigEndian.Uint16(b), nil
+}
+
+// Tell the Nano that the store holds the section with the given digest.
+func saveImage(nano *arduino.Arduino, store byte, digest uint16) error {
+	_, err := doFixedCommand(nano, []byte{sp.CmdExt, sp.ExtSaveImage, store,
+		byte(digest >> 8), byte(digest)}, 1)
+	return err
+}
+
+// Return the set of chunks of the section that differ from the store.
+// The Nano digests the chunks of the store and we compare the digests
+// with digests of the section, so only 2 bytes per chunk cross the link.
+// If incremental download is off, all the chunks are returned.
+func changedChunks(nano *arduino.Arduino, store byte, section []byte, chunks []int) (map[int]bool, error) {
+	changed := make(map[int]bool)
+	for i := 0; i < len(chunks); {
+		j := i + 1
+		for j < len(chunks) && chunks[j] == chunks[j-1]+1 && j-i < maxDigestChunks(store) {
+			j++
+		}
+		var digests []byte
+		if incrementalDownload {
+			var err error
+			digests, err = doCountedReceive(nano, []byte{sp.CmdExt, sp.ExtChunkDigests,
+				store, byte(chunks[i] >> 8), byte(chunks[i]), byte(j - i)})
+			if err != nil {
+				return nil, err
+			}
+			if len(digests) != 2*(j-i) {
+				return nil, fmt.Errorf("chunk digests: unexpected length %d", len(digests))
+			}
+		}
+		for k, chunk := range chunks[i:j] {
+			// The Nano doesn't digest its scratch chunks.
+			if digests == nil || scratchChunk(store, chunk) ||
+				binary.BigEndian.Uint16(digests[2*k:]) != chunkDigest(store, section, chunk, 0) {
+				changed[chunk] = true
+			}
+		}
+		i = j
+	}
+	return changed, nil
+}
+
 func ReadFile(binary *bufio.Reader) ([]byte, error) {
 	var result []byte = make([]byte, BinaryFileSize, BinaryFileSize)
 	var err error
@@ -95,8 +209,9 @@ func ReadFile(binary *bufio.Reader) ([]byte, error) {
 	return result, nil
 }
 
-func doMemorySection(content []byte, nano *arduino.Arduino) error {
+func doMemorySection(content []byte, nano *arduino.Arduino) ([]int, error) {
 	var addr uint16
+	var written []int
 
 	// Optimization for main memory: we scan backwards from the end of the
 	// memory section in the file until we hit a nonzero value. We download
@@ -114,26 +229,34 @@ func doMemorySection(content []byte, nano *arduino.Arduino) error {
 
 	limit := addr + chunkSize
 
+	var chunks []int
+	for addr = 0; addr < limit; addr += chunkSize {
+		chunks = append(chunks, int(addr/chunkSize))
+	}
+	changed, err := changedChunks(nano, storeMem, content, chunks)
+	if err != nil {
+		return nil, err
+	}
+
+	// Since protocol v19, the Nano reads back the chunks itself as the
+	// verification policy directs, so there's no read back from here.
 	for addr = 0; addr < limit; addr += chunkSize {
+		if !changed[int(addr/chunkSize)] {
+			continue
+		}
 		toWrite := content[addr : addr+chunkSize]
 		if err := writeMemoryChunk(toWrite, nano, addr); err != nil {
-			return err
-		}
-		readBack, err := readMemoryChunk(nano, addr)
-		if err != nil {
-			return err
-		}
-		if bytes.Compare(toWrite, readBack) != 0 {
-			return fmt.Errorf("memory compare fail: wrote %v read %v\n", toWrite, readBack)
+			return nil, err
 		}
-		if addr & 0x1FF == 0 {
+		written = append(written, int(addr/chunkSize))
+		if len(written)&7 == 0 {
 			if err := doPoll(nano); err != nil {
-				return fmt.Errorf("during download (memory section): doPoll(): %s", err)
+				return nil, fmt.Errorf("during download (memory section): doPoll(): %s", err)
 			}
 		}
 	}
-	log.Printf("wrote %d bytes of main memory\n", limit)
-	return nil
+	log.Printf("wrote %d bytes of main memory\n", len(written)*chunkSize)
+	return written, nil
 }
 
 // The microcode RAM is 32 bits wide and 8k high. It's arranged as
@@ -141,8 +264,10 @@ func doMemorySection(content []byte, nano *arduino.Arduino) error {
 // has large overhead so we really want maximal (64 byte) writes, and
 // this lines up nicely with the 64-byte wire chunk size. We write
 // bytes 0, 4, 8, ... on the first of the four writes, bytes 1, 5, 9,
-// ... on the second of the four, etc.
-func doMicrocodeSection(content []byte, nano *arduino.Arduino) error {
+// ... on the second of the four, etc. Since protocol v13, the Nano can
+// do this transpose itself, so we send each opcode in a single write
+// opcode command: one round trip per opcode instead of four.
+func doMicrocodeSection(content []byte, nano *arduino.Arduino) ([]int, error) {
 	// There are 2^7 opcodes each with 2^8 bytes of microcode
 	// Each 2^8 is organized as 2^2 slices of 2^6 bytes each
 	// We leverage the fact that the chunk size is also 2^6
@@ -163,58 +288,129 @@ func doMicrocodeSection(content []byte, nano *arduino.Arduino) error {
 		panic("doMicrocodeSection(): invalid content length")
 	}
 
-	var allNoops []byte = bytes.Repeat([]byte{0xFF}, ucodePerOp)
 	var nWritten int
+	var written []int
+
+	// Every opcode is compared, including those that are all no-ops in
+	// the file: the WCS isn't cleared by a warm reset or by an earlier
+	// download, so an opcode removed from the image may still hold its
+	// old microcode.
+	chunks := make([]int, MicrocodeSectionSize/chunkSize)
+	for i := range chunks {
+		chunks[i] = i
+	}
+	changed, err := changedChunks(nano, storeWcs, content, chunks)
+	if err != nil {
+		return nil, err
+	}
 
 	for op := 0; op < MicrocodeSectionSize; op += ucodePerOp {
-		if bytes.Compare(content[op:op+ucodePerOp], allNoops) == 0 {
+		opChanged := false
+		for slice := 0; slice < slicesPerOp; slice++ {
+			opChanged = opChanged || changed[op/bytesPerSlicePerOp+slice]
+		}
+		if !opChanged {
 			continue
 		}
 		nWritten++
-		log.Printf("write microcode for opcode 0x%02X\n", ((op >> 8)|0x80) & 0xFF)
 		for slice := 0; slice < slicesPerOp; slice++ {
-			var i int = 0
-			for addr := op + slice; addr < op+ucodePerOp; addr += 4 {
-				body[i] = content[addr]
-				i++
+			written = append(written, op/bytesPerSlicePerOp+slice)
+		}
+		log.Printf("write microcode for opcode 0x%02X\n", ((op >> 8)|0x80) & 0xFF)
+		if wholeOpcodeWrites {
+			// The Nano transposes the slot-major content into slices.
+			if err := writeMicrocodeOpcode(((op >> 8)|0x80) & 0xFF, content[op:op+ucodePerOp], nano); err != nil {
+				return nil, err
 			}
-			if err := writeMicrocodeChunk(((op >> 8)|0x80) & 0xFF, slice, body, nano); err != nil {
-				return err
+		} else {
+			for slice := 0; slice < slicesPerOp; slice++ {
+				var i int = 0
+				for addr := op + slice; addr < op+ucodePerOp; addr += 4 {
+					body[i] = content[addr]
+					i++
+				}
+				if err := writeMicrocodeChunk(((op >> 8)|0x80) & 0xFF, slice, body, nano); err != nil {
+					return nil, err
+				}
 			}
 		}
 		if err := doPoll(nano); err != nil {
-			return fmt.Errorf("during download (microcode section): doPoll(): %s", err)
+			return nil, fmt.Errorf("during download (microcode section): doPoll(): %s", err)
 		}
 	}
 	log.Printf("wrote microcode for %d opcodes\n", nWritten)
-	return nil
+	return written, nil
 }
 
-// The ALU section is 8k. Writes are very slow. Any 64-byte chunkie
-// that is all zeroes is not written (an all-0 byte is impossible
-// because if the value is 0, the zero flag (0x20) should be set,
-// and otherwise the low order four bits are not zero).
-func doALUSection(content []byte, nano *arduino.Arduino) error {
+// The ALU section is 8k. Writes are very slow, so only the chunks
+// whose digests differ from the Nano's are written. Tables for
+// standard functions are generated by the Nano (see alu.go) instead.
+func doALUSection(content []byte, nano *arduino.Arduino) ([]int, error) {
 	var addr uint16
 	var nWritten int
+	var nGenerated int
+	var written []int
+
+	// Every chunk is compared, including those that are all zero in the
+	// file, for the same reason as in doMicrocodeSection().
+	chunks := make([]int, AluSectionSize/chunkSize)
+	for i := range chunks {
+		chunks[i] = i
+	}
+	changed, err := changedChunks(nano, storeAlu, content, chunks)
+	if err != nil {
+		return nil, err
+	}
+
+	// Generate only the tables that have changed chunks. The download
+	// loop below skips the unchanged chunks of the others.
+	descriptors := aluDescriptors(content)
+	for op := range descriptors {
+		opChanged := false
+		for c := 0; c < aluTableSize/chunkSize; c++ {
+			opChanged = opChanged || changed[op*aluTableSize/chunkSize+c]
+		}
+		if !opChanged {
+			descriptors[op] = aluFnNone
+		}
+	}
+	for op, d := range descriptors {
+		if d != aluFnNone {
+			nGenerated++
+			for c := 0; c < aluTableSize/chunkSize; c++ {
+				written = append(written, op*aluTableSize/chunkSize+c)
+			}
+		}
+	}
+	if nGenerated > 0 {
+		if err := generateAlu(nano, descriptors); err != nil {
+			return nil, err
+		}
+		log.Printf("generated %d ALU tables\n", nGenerated)
+	}
 
-	var zeroes []byte = bytes.Repeat([]byte{0}, chunkSize)
 	for addr = 0; addr < AluSectionSize; addr += chunkSize {
 		toWrite := content[addr : addr+chunkSize]
-		if bytes.Compare(toWrite, zeroes) == 0 {
+		if !changed[int(addr/chunkSize)] {
+			continue
+		}
+		if descriptors[addr/aluTableSize] != aluFnNone {
 			continue
 		}
 		nWritten++
 		if err := writeAluChunk(nano, toWrite, addr); err != nil {
-			return err
+			return nil, err
 		}
+		written = append(written, int(addr/chunkSize))
 
 		// As an optimization, I modified the Nano side of the
 		// writeAluChunk() call (the sp.CmdWrAlu protocol function)
 		// to write with verify (and panic the Nano if the verify
 		// fails). So it's no longer necessary to read all three
 		// RAMs separately for verification, although it works
-		// just fine to do so. 5/19/2023
+		// just fine to do so. 5/19/2023 (Since protocol v19, the
+		// Nano verifies as the verification policy directs and
+		// reports failures instead of panicking; see verify.go.)
 		//
 		// There are three identical ALU RAMs. They are written
 		// as a unit but must be verified separately.
@@ -231,12 +427,12 @@ func doALUSection(content []byte, nano *arduino.Arduino) error {
 
 		if nWritten&3 == 0 {
 			if err := doPoll(nano); err != nil {
-				return fmt.Errorf("during download (microcode section): doPoll(): %s", err)
+				return nil, fmt.Errorf("during download (microcode section): doPoll(): %s", err)
 			}
 		}
 	}
 	log.Printf("wrote %d bytes of ALU RAM\n", nWritten*chunkSize)
-	return nil
+	return written, nil
 }
 
 func writeAluChunk(nano *arduino.Arduino, body []byte, addr uint16) error {
@@ -258,6 +454,18 @@ func readAluChunk(nano *arduino.Arduino, addr uint16, ram byte) ([]byte, error)
 	return doCountedReceive(nano, cmdRdAlu)
 }
 
+// Read a 64-byte chunk of all three ALU RAMs in one command. The result
+// has three bytes per address, in RAM order.
+func readAlu3Chunk(nano *arduino.Arduino, addr uint16) ([]byte, error) {
+	cmdRdAlu3 := []byte{sp.CmdExt, sp.ExtRdAlu3, byte(addr >> 8), byte(addr & 0xFF),
+		byte(chunkSize)}
+	data, err := doCountedReceive(nano, cmdRdAlu3)
+	if err == nil && len(data) != 3*chunkSize {
+		err = fmt.Errorf("read ALU3: unexpected length %d", len(data))
+	}
+	return data, err
+}
+
 func writeMicrocodeChunk(op int, slice int, body []byte, nano *arduino.Arduino) error {
 	var cmdWrSlice []byte = make([]byte, 4, 4)
 	cmdWrSlice[0] = sp.CmdWrSlice
@@ -270,6 +478,28 @@ func writeMicrocodeChunk(op int, slice int, body []byte, nano *arduino.Arduino)
 	return nil
 }
 
+// Write all 64 slots (4 slices) of an opcode. The body is 256 bytes of
+// slot-major content from the microcode section. Unframed, each command
+// may carry only one 64-byte chunk, so the opcode takes four commands of
+// 16 words; framed, it takes one.
+func writeMicrocodeOpcode(op int, body []byte, nano *arduino.Arduino) error {
+	const slotsPerOp = 64
+	wordsPerCmd := 16
+	if nano.Framed() {
+		wordsPerCmd = slotsPerOp
+	}
+	for first := 0; first < slotsPerOp; first += wordsPerCmd {
+		cmdWrOpcode := []byte{sp.CmdExt, sp.ExtWrOpcode, byte(0x80 | op), byte(first), byte(wordsPerCmd)}
+		if _, err := doFixedCommand(nano, cmdWrOpcode, 0); err != nil {
+			return fmt.Errorf("microcode write failed: %s", err)
+		}
+		if err := nano.Write(body[4*first : 4*(first+wordsPerCmd)]); err != nil {
+			return fmt.Errorf("microcode write failed: %s", err)
+		}
+	}
+	return nil
+}
+
 func writeMemoryChunk(content []byte, nano *arduino.Arduino, addr uint16) error {
 	var wrMem []byte = make([]byte, 4, 4)
 
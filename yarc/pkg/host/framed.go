@@ -0,0 +1,64 @@
+// Copyright (c) Jeff Berkowitz 2021, 2023. All rights reserved.
+
+package host
+
+// Framed mode.
+//
+// Since protocol v27, the Nano can carry the protocol in CRC-checked
+// frames with a sequence bit (see arduino/frame.go). Corrupted and lost
+// frames are sent again, and after an error we resynchronize in a few
+// milliseconds instead of resetting the Nano and starting a new session.
+
+import (
+	"fmt"
+	"log"
+	"strings"
+	"time"
+
+	"github.com/gmofishsauce/yarc/pkg/arduino"
+	sp "github.com/gmofishsauce/yarc/pkg/proto"
+)
+
+// Long enough for the Nano to send a frame again if it missed our ack
+const framedLingerDelay = 200 * time.Millisecond
+
+// Turn framed mode on or off.
+func setFramed(nano *arduino.Arduino, on bool) error {
+	var arg byte
+	if on {
+		arg = 1
+	}
+	if _, err := doFixedCommand(nano, []byte{sp.CmdExt, sp.ExtFramed, arg}, 0); err != nil {
+		return err
+	}
+	if !on && nano.Framed() {
+		// The Nano leaves framed mode when we ack the frame holding its
+		// ack. If our ack is lost, it sends the frame again; ack that too.
+		nano.ReadFor(framedLingerDelay)
+	}
+	nano.SetFramed(on)
+	return nil
+}
+
+// Recover from an error in framed mode by resetting the link and the
+// Nano's command layer and synchronizing again.
+func resynchronize(nano *arduino.Arduino) error {
+	if err := nano.Resync(); err != nil {
+		return err
+	}
+	return doCommand(nano, sp.CmdSync)
+}
+
+// Command handler: fm on|off
+func doFramed(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	words := strings.Fields(line)
+	if len(words) != 2 || (words[1] != "on" && words[1] != "off") {
+		fmt.Println("usage: fm on|off")
+		return nostr, nil
+	}
+	if err := setFramed(nano, words[1] == "on"); err != nil {
+		return nostr, err
+	}
+	log.Printf("framed mode %s\n", words[1])
+	return nostr, nil
+}
@@ -30,6 +30,7 @@ import (
 
 	"bufio"
 	"bytes"
+	"encoding/binary"
 	"fmt"
 	"os"
 	"strconv"
@@ -64,11 +65,27 @@ var commands = []protocolCommand{
 	{sp.CmdGetMcr, "gm", "GetMcr", 0, false, getMcr},
 	{sp.CmdRunCost, "rc", "RunCost", 0, false, runCost},
 	{sp.CmdStopCost, "sc", "StopCost", 0, false, stopCost},
+	{sp.CmdExt, "cr", "CostResults", 0, true, costResults},
+	{sp.CmdExt, "fl", "Fill", 3, false, fill},
+	{sp.CmdExt, "is", "InitStatus", 0, false, initStatus},
+	{sp.CmdExt, "vp", "VerifyPolicy", 1, false, setVerifyPolicy},
 	{sp.CmdRunYarc, "rn", "Run", 0, false, runYarc},
 	{sp.CmdStopYarc, "st", "Stop", 0, false, stopYarc},
 	{sp.CmdClockCtl, "cc", "Clock", 1, false, clockCtl},
+	{sp.CmdExt, "cb", "ClockBurst", 1, false, doClockBurst},
+	{sp.CmdExt, "ru", "RunUntil", 1, false, doRunUntil},
+	{sp.CmdExt, "tr", "Trace", 1, true, doTrace},
+	{sp.CmdExt, "ec", "ExecCounters", 1, true, doCounters},
 	{sp.CmdRdMem, "rm", "ReadMem", 1, true, rdMem},
 	{sp.CmdWrMem, "wm", "WriteMem", 1, true, wrMem},
+	{sp.CmdExt, "wb", "WriteBytes", 1, true, doWriteBytes},
+	{sp.CmdExt, "ra", "ReadAlu", 1, true, rdAlu},
+	{sp.CmdExt, "rg", "ReadScatter", 1, true, doReadScatter},
+	{sp.CmdExt, "ms", "SearchMem", 1, true, doSearchMem},
+	{sp.CmdExt, "mc", "CompareMem", 6, false, doCompareMem},
+	{sp.CmdExt, "dm", "DiffMem", 0, false, doDiffMem},
+	{sp.CmdExt, "fm", "Framed", 1, false, doFramed},
+	{sp.CmdExt, "sx", "Script", 1, true, doScript},
 	{sp.CmdPoll, "pl", "Poll", 0, false, notImpl},
 	{sp.CmdSvcResponse, "sr", "SvcResponse", 1, true, notImpl},
 	{sp.CmdDebug, "db", "Debug", 7, true, doDebug},
@@ -150,6 +167,127 @@ func stopCost(cmd *protocolCommand, nano *arduino.Arduino, line string) (string,
 	return nostr, err
 }
 
+// Fetch and display the COST results table. The layout is described in
+// the protocol spec; all multibyte values are big-endian.
+func costResults(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	const headerSize = 6
+	table, err := doCountedReceive(nano, []byte{sp.CmdExt, sp.ExtCostResults})
+	if err != nil {
+		return nostr, err
+	}
+	if len(table) < headerSize {
+		return nostr, fmt.Errorf("COST results: short response (%d bytes)", len(table))
+	}
+	nTests, recSize := int(table[0]), int(table[1])
+	fmt.Printf("COST flags 0x%02x current test %d cycles %d\n",
+		table[2], table[3], binary.BigEndian.Uint16(table[4:]))
+	fmt.Printf("%-6s%-8s%-8s%-8s%-8s%-6s%s\n", "Test", "Pass", "Fail", "Millis", "Detail", "Code", "Bytes")
+	for t := 0; t < nTests && headerSize+(t+1)*recSize <= len(table); t++ {
+		rec := table[headerSize+t*recSize:]
+		fmt.Printf("%-6d%-8d%-8d%-8d0x%04X  0x%02X  %d\n", t,
+			binary.BigEndian.Uint16(rec[0:]), binary.BigEndian.Uint16(rec[2:]),
+			binary.BigEndian.Uint16(rec[4:]), binary.BigEndian.Uint16(rec[6:]),
+			rec[8], binary.BigEndian.Uint32(rec[9:]))
+	}
+	return nostr, nil
+}
+
+// Display the Nano's background initialization status.
+func initStatus(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	status, err := getInitStatus(nano)
+	if err != nil {
+		return nostr, err
+	}
+	fmt.Printf("init status 0x%02x self test %t POR clear %t WCS %t memory %t done %t\n", status,
+		status&initSelfTest != 0, status&initPorClear != 0,
+		status&initWcs != 0, status&initMem != 0, status&initDone != 0)
+	fmt.Printf("image loaded: WCS %t memory %t ALU %t\n",
+		status&initWcsImage != 0, status&initMemImage != 0, status&initAluImage != 0)
+	return nostr, nil
+}
+
+// Fill an entire store on the YARC with a constant value. The store is
+// one of "wcs", "mem", or "alu". The optional verify argument N causes
+// the Nano to check every Nth opcode, word, or byte; the default is 0 (no
+// verification).
+func fill(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	const usage = "usage: fl wcs|mem|alu value [verify]"
+	stores := map[string]byte{"wcs": 0, "mem": 1, "alu": 2}
+
+	words := strings.Fields(line)
+	if len(words) < 3 || len(words) > 4 {
+		fmt.Println(usage)
+		return nostr, nil
+	}
+	store, ok := stores[words[1]]
+	if !ok {
+		fmt.Println(usage)
+		return nostr, nil
+	}
+	value, err := strconv.ParseUint(words[2], 0, 16)
+	if err != nil {
+		fmt.Println(usage)
+		return nostr, nil
+	}
+	var verify uint64
+	if len(words) == 4 {
+		if verify, err = strconv.ParseUint(words[3], 0, 8); err != nil {
+			fmt.Println(usage)
+			return nostr, nil
+		}
+	}
+
+	nanoCmd := []byte{sp.CmdExt, sp.ExtFill, store, byte(value >> 8), byte(value), byte(verify)}
+	result, err := doFixedCommand(nano, nanoCmd, 1)
+	if err != nil {
+		return nostr, err
+	}
+	if result[0] != 0 {
+		fmt.Printf("fill %s: verification failed\n", words[1])
+	}
+	return nostr, nil
+}
+
+// Set the verification policy for downloads, one of "full", "sampled",
+// "digest", or "none" (see verify.go), and report the verification
+// failures the Nano has found since they were last collected. With no
+// argument, the policy is unchanged.
+func setVerifyPolicy(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	const usage = "usage: vp [full|sampled|digest|none]"
+
+	words := strings.Fields(line)
+	policy := byte(verifyUnchanged)
+	if len(words) == 2 {
+		p, ok := verifyPolicies[words[1]]
+		if !ok {
+			fmt.Println(usage)
+			return nostr, nil
+		}
+		policy = p
+	} else if len(words) != 1 {
+		fmt.Println(usage)
+		return nostr, nil
+	}
+
+	result, err := setVerify(nano, policy)
+	if err != nil {
+		return nostr, err
+	}
+	if policy != verifyUnchanged {
+		verifyPolicy = policy
+	}
+	for name, p := range verifyPolicies {
+		if p == verifyPolicy {
+			fmt.Printf("verify policy %s\n", name)
+		}
+	}
+	if result.failures != 0 {
+		fmt.Printf("%d verify failures, the first in store %d at 0x%04X\n",
+			result.failures, result.store, result.addr)
+	}
+	return nostr, nil
+}
+
 // Run the YARC. The first argument determines the clock setting as with clockCtl().
 // The second through fourth arguments are the initial values of r0, r1, and r2. All
 // the arguments are optional default to 0.
@@ -315,6 +453,41 @@ func rdMem(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, er
 	return nostr, nil
 }
 
+// By-hand rdAlu reads and displays the 64 addresses of ALU RAM at the
+// address given on the line. All three RAMs are read; addresses where they
+// disagree are marked with an asterisk.
+func rdAlu(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	words := strings.Fields(line)
+	if len(words) != 2 {
+		return nostr, fmt.Errorf("usage: rdAlu addr")
+	}
+	addr, err := strconv.ParseInt(words[1], 0, 16)
+	if err != nil {
+		return nostr, err
+	}
+	if (addr&0x1FC0) != addr {
+		return nostr, fmt.Errorf("rdAlu: address must be on a 64-byte boundary < 8K")
+	}
+	data, err := readAlu3Chunk(nano, uint16(addr))
+	if err != nil {
+		return nostr, err
+	}
+
+	for i := 0; i < chunkSize; i += 8 {
+		fmt.Printf("0x%04X:", int(addr)+i)
+		for j := i; j < i+8; j++ {
+			b := data[3*j : 3*j+3]
+			mark := ' '
+			if b[0] != b[1] || b[0] != b[2] {
+				mark = '*'
+			}
+			fmt.Printf(" %02X%02X%02X%c", b[0], b[1], b[2], mark)
+		}
+		fmt.Println()
+	}
+	return nostr, nil
+}
+
 func doCycle(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
 	var nanoCmd []byte = []byte{sp.CmdDoCycle}
 	result, err := doFixedCommand(nano, nanoCmd, 1)
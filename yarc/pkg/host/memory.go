@@ -0,0 +1,353 @@
+// Copyright (c) Jeff Berkowitz 2021, 2023. All rights reserved.
+
+package host
+
+// Memory access for the debugger.
+//
+// Since protocol v25, the Nano can read a list of up to 16 scattered
+// ranges of main memory in one command and return just those bytes.
+// This is cheaper than reading a 64-byte chunk for each of them.
+//
+// Since protocol v26, the Nano can search memory for a byte or word
+// under a mask and compare two ranges of memory, returning only the
+// matching addresses or the first mismatches. To compare memory with
+// the download file, we compare digests of its chunks (see diffMem).
+//
+// Since protocol v28, the Nano can write up to 64 bytes at any address,
+// so we can write unaligned bytes without reading the words around them.
+
+import (
+	"bufio"
+	"encoding/binary"
+	"fmt"
+	"os"
+	"strconv"
+	"strings"
+
+	"github.com/gmofishsauce/yarc/pkg/arduino"
+	sp "github.com/gmofishsauce/yarc/pkg/proto"
+)
+
+const (
+	scatterMaxRanges = 16
+	scatterMaxBytes  = 255
+
+	searchWords    = 0x01
+	searchMaxFound = 32
+
+	writeBytesMax = 64
+)
+
+type memRange struct {
+	addr   uint16
+	length int
+}
+
+// Read the bytes of the ranges, in order, in one command.
+func readScatter(nano *arduino.Arduino, ranges []memRange) ([]byte, error) {
+	if len(ranges) == 0 || len(ranges) > scatterMaxRanges {
+		return nil, fmt.Errorf("read scatter: %d ranges", len(ranges))
+	}
+	var counted []byte
+	total := 0
+	for _, r := range ranges {
+		if r.length < 1 || r.length > 0xFF || int(r.addr)+r.length > MemorySectionSize {
+			return nil, fmt.Errorf("read scatter: invalid range 0x%04X:%d", r.addr, r.length)
+		}
+		counted = append(counted, byte(r.addr>>8), byte(r.addr), byte(r.length))
+		total += r.length
+	}
+	if total > scatterMaxBytes {
+		return nil, fmt.Errorf("read scatter: %d bytes is too many", total)
+	}
+
+	fixed := []byte{sp.CmdExt, sp.ExtRdScatter, byte(len(counted))}
+	if err := doCountedSend(nano, fixed, counted); err != nil {
+		return nil, err
+	}
+	data, err := readCounted(nano)
+	if err != nil {
+		return nil, err
+	}
+	if len(data) != total {
+		return nil, fmt.Errorf("read scatter: expected %d bytes, got count %d", total, len(data))
+	}
+	return data, nil
+}
+
+// Command handler: rg addr:len [addr:len ...]
+func doReadScatter(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	const usage = "usage: rg addr:len [addr:len ...]"
+	words := strings.Fields(line)
+	if len(words) < 2 {
+		fmt.Println(usage)
+		return nostr, nil
+	}
+	var ranges []memRange
+	for _, w := range words[1:] {
+		parts := strings.Split(w, ":")
+		if len(parts) != 2 {
+			fmt.Println(usage)
+			return nostr, nil
+		}
+		addr, err := strconv.ParseUint(parts[0], 0, 16)
+		if err != nil {
+			fmt.Println(usage)
+			return nostr, nil
+		}
+		length, err := strconv.ParseUint(parts[1], 0, 8)
+		if err != nil {
+			fmt.Println(usage)
+			return nostr, nil
+		}
+		ranges = append(ranges, memRange{uint16(addr), int(length)})
+	}
+
+	data, err := readScatter(nano, ranges)
+	if err != nil {
+		return nostr, err
+	}
+	for _, r := range ranges {
+		fmt.Printf("0x%04X:", r.addr)
+		for _, b := range data[:r.length] {
+			fmt.Printf(" %02X", b)
+		}
+		fmt.Println()
+		data = data[r.length:]
+	}
+	return nostr, nil
+}
+
+// Write data at addr, which need not be aligned, in commands of up to
+// writeBytesMax bytes.
+func writeMemBytes(nano *arduino.Arduino, addr uint16, data []byte) error {
+	if int(addr)+len(data) > MemorySectionSize {
+		return fmt.Errorf("write bytes: invalid range 0x%04X:%d", addr, len(data))
+	}
+	for len(data) > 0 {
+		n := len(data)
+		if n > writeBytesMax {
+			n = writeBytesMax
+		}
+		fixed := []byte{sp.CmdExt, sp.ExtWrMemBytes, byte(addr >> 8), byte(addr), byte(n)}
+		if err := doCountedSend(nano, fixed, data[:n]); err != nil {
+			return err
+		}
+		addr += uint16(n)
+		data = data[n:]
+	}
+	return nil
+}
+
+// Command handler: wb addr byte [byte ...]
+func doWriteBytes(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	const usage = "usage: wb addr byte [byte ...]"
+	words := strings.Fields(line)
+	if len(words) < 3 {
+		fmt.Println(usage)
+		return nostr, nil
+	}
+	addr, err := strconv.ParseUint(words[1], 0, 16)
+	if err != nil {
+		fmt.Println(usage)
+		return nostr, nil
+	}
+	var data []byte
+	for _, w := range words[2:] {
+		b, err := strconv.ParseUint(w, 0, 8)
+		if err != nil {
+			fmt.Println(usage)
+			return nostr, nil
+		}
+		data = append(data, byte(b))
+	}
+	return nostr, writeMemBytes(nano, uint16(addr), data)
+}
+
+// Return the addresses in [start, end) of bytes, or aligned words if
+// words is true, that match value in the bits of mask. At most max
+// addresses are returned.
+func searchMem(nano *arduino.Arduino, start int, end int, value uint16, mask uint16,
+	words bool, max int) ([]uint16, error) {
+	var flags byte
+	if words {
+		flags = searchWords
+	}
+	var found []uint16
+	for start < end && len(found) < max {
+		params := []byte{flags, byte(start >> 8), byte(start), byte(end >> 8), byte(end),
+			byte(value >> 8), byte(value), byte(mask >> 8), byte(mask)}
+		if err := doCountedSend(nano, []byte{sp.CmdExt, sp.ExtMemSearch, byte(len(params))},
+			params); err != nil {
+			return nil, err
+		}
+		b, err := readCounted(nano)
+		if err != nil {
+			return nil, err
+		}
+		for i := 0; i+1 < len(b); i += 2 {
+			found = append(found, binary.BigEndian.Uint16(b[i:]))
+		}
+		if len(b) < 2*searchMaxFound {
+			break
+		}
+		start = int(found[len(found)-1]) + 1
+	}
+	if len(found) > max {
+		found = found[:max]
+	}
+	return found, nil
+}
+
+// Compare the n bytes at a with the n bytes at b. Return the number of
+// mismatches and the offsets of the first few.
+func compareMem(nano *arduino.Arduino, a uint16, b uint16, n uint16) (int, []uint16, error) {
+	r, err := doCountedReceive(nano, []byte{sp.CmdExt, sp.ExtMemCompare,
+		byte(a >> 8), byte(a), byte(b >> 8), byte(b), byte(n >> 8), byte(n)})
+	if err != nil {
+		return 0, nil, err
+	}
+	if len(r) < 2 || len(r)%2 != 0 {
+		return 0, nil, fmt.Errorf("compare: unexpected length %d", len(r))
+	}
+	var diffs []uint16
+	for i := 2; i < len(r); i += 2 {
+		diffs = append(diffs, binary.BigEndian.Uint16(r[i:]))
+	}
+	return int(binary.BigEndian.Uint16(r)), diffs, nil
+}
+
+// Return the chunks of memory that differ from the memory section of the
+// download file, by comparing digests.
+func diffMem(nano *arduino.Arduino, content []byte) ([]int, error) {
+	chunks := make([]int, MemorySectionSize/chunkSize)
+	for i := range chunks {
+		chunks[i] = i
+	}
+	changed, err := changedChunks(nano, storeMem, content[:MemorySectionSize], chunks)
+	if err != nil {
+		return nil, err
+	}
+	var result []int
+	for _, chunk := range chunks {
+		if changed[chunk] {
+			result = append(result, chunk)
+		}
+	}
+	return result, nil
+}
+
+// Read a count byte and the counted bytes that follow it.
+func readCounted(nano *arduino.Arduino) ([]byte, error) {
+	count, err := nano.ReadFor(responseDelay)
+	if err != nil {
+		return nil, err
+	}
+	data := make([]byte, count)
+	for i := range data {
+		if data[i], err = nano.ReadFor(responseDelay); err != nil {
+			return nil, err
+		}
+	}
+	return data, nil
+}
+
+// Command handler: ms [w] start end value [mask]
+func doSearchMem(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	const usage = "usage: ms [w] start end value [mask]"
+	words := strings.Fields(line)[1:]
+	wordMode := len(words) > 0 && words[0] == "w"
+	if wordMode {
+		words = words[1:]
+	}
+	if len(words) < 3 || len(words) > 4 {
+		fmt.Println(usage)
+		return nostr, nil
+	}
+	var args [4]uint64
+	args[3] = 0xFFFF
+	for i, w := range words {
+		var err error
+		if args[i], err = strconv.ParseUint(w, 0, 16); err != nil {
+			fmt.Println(usage)
+			return nostr, nil
+		}
+	}
+	if args[0] > args[1] || args[1] > MemorySectionSize {
+		fmt.Println(usage)
+		return nostr, nil
+	}
+
+	found, err := searchMem(nano, int(args[0]), int(args[1]), uint16(args[2]), uint16(args[3]),
+		wordMode, 256)
+	if err != nil {
+		return nostr, err
+	}
+	for i, addr := range found {
+		fmt.Printf(" 0x%04X", addr)
+		if i%8 == 7 {
+			fmt.Println()
+		}
+	}
+	fmt.Printf("\n%d found\n", len(found))
+	return nostr, nil
+}
+
+// Command handler: mc a b length
+func doCompareMem(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	const usage = "usage: mc a b length"
+	words := strings.Fields(line)
+	if len(words) != 4 {
+		fmt.Println(usage)
+		return nostr, nil
+	}
+	var args [3]uint64
+	for i, w := range words[1:] {
+		var err error
+		if args[i], err = strconv.ParseUint(w, 0, 16); err != nil {
+			fmt.Println(usage)
+			return nostr, nil
+		}
+	}
+	if args[0]+args[2] > MemorySectionSize || args[1]+args[2] > MemorySectionSize {
+		fmt.Println(usage)
+		return nostr, nil
+	}
+
+	n, diffs, err := compareMem(nano, uint16(args[0]), uint16(args[1]), uint16(args[2]))
+	if err != nil {
+		return nostr, err
+	}
+	fmt.Printf("%d bytes differ\n", n)
+	for _, off := range diffs {
+		fmt.Printf("  +0x%04X: 0x%04X, 0x%04X\n", off, int(args[0])+int(off), int(args[1])+int(off))
+	}
+	return nostr, nil
+}
+
+// Command handler: dm. Lists the 64-byte chunks of memory that differ
+// from yarc.bin.
+func doDiffMem(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	yarcbin, err := os.Open("./yarc.bin")
+	if err != nil {
+		yarcbin, err = os.Open("../yarc.bin")
+		if err != nil {
+			return nostr, err
+		}
+	}
+	defer yarcbin.Close()
+	content, err := ReadFile(bufio.NewReader(yarcbin))
+	if err != nil {
+		return nostr, err
+	}
+
+	chunks, err := diffMem(nano, content)
+	if err != nil {
+		return nostr, err
+	}
+	for _, chunk := range chunks {
+		fmt.Printf("0x%04X differs\n", chunk*chunkSize)
+	}
+	fmt.Printf("%d chunks differ\n", len(chunks))
+	return nostr, nil
+}
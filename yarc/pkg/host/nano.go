@@ -19,7 +19,10 @@ import (
 
 func establishConnection(nano *arduino.Arduino, wasReset bool) error {
 	if wasReset {
-		time.Sleep(3 * time.Second)
+		// Give the bootloader time to start the firmware. The firmware
+		// answers syncs at once (it initializes in the background) and
+		// getSyncResponse() retries, so this needn't cover the worst case.
+		time.Sleep(1 * time.Second)
 	} else {
 		if err := drain(nano); err != nil {
 			return err
@@ -88,6 +91,45 @@ func checkProtocolVersion(nano *arduino.Arduino) error {
 	return nil
 }
 
+// Bits of the init status result (see the protocol spec). The Nano
+// initializes in the background after a reset and defers commands that
+// use the YARC until initDone is set. The image bits are set for stores
+// that still hold the image recorded by the last download.
+const (
+	initSelfTest = 0x01
+	initPorClear = 0x02
+	initWcs      = 0x04
+	initMem      = 0x08
+	initWcsImage = 0x10
+	initMemImage = 0x20
+	initAluImage = 0x40
+	initDone     = 0x80
+)
+
+func getInitStatus(nano *arduino.Arduino) (byte, error) {
+	b, err := doFixedCommand(nano, []byte{sp.CmdExt, sp.ExtInitStatus}, 1)
+	if err != nil {
+		return 0, err
+	}
+	return b[0], nil
+}
+
+// Wait for the Nano to finish initialization. Commands that use the YARC
+// would wait anyway, but the wait might exceed the response timeout.
+func waitForNanoReady(nano *arduino.Arduino) error {
+	for start := time.Now(); time.Since(start) < 3*responseDelay; {
+		status, err := getInitStatus(nano)
+		if err != nil {
+			return err
+		}
+		if status&initDone != 0 {
+			return nil
+		}
+		time.Sleep(100 * time.Millisecond)
+	}
+	return fmt.Errorf("Nano did not finish initialization")
+}
+
 func getNanoRequest(nano *arduino.Arduino) (string, error) {
 	bytes, err := doCountedReceive(nano, []byte{sp.CmdPoll})
 	if err != nil {
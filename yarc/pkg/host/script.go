@@ -0,0 +1,255 @@
+// Copyright (c) Jeff Berkowitz 2021, 2023. All rights reserved.
+
+package host
+
+// Bus-operation scripts.
+//
+// Since protocol v29, the Nano can run a script of bus operations (set
+// the address and data registers, the MCR, ACR and K, clock, read and
+// compare the BIR, loop and branch) uploaded as one command. This lets us
+// try hardware tests and bring-up sequences without reflashing the Nano
+// and without a round trip for each operation.
+//
+// Scripts are text files with one operation per line. A line may start
+// with a label ("name:"), and "#" starts a comment. The operations are:
+//
+//	ah|al|dh|dl value     set one bus register
+//	adhl ah al dh dl      set all four
+//	mcr value             set the MCR
+//	acr value             set the ACR
+//	k k3 k2 k1 k0         write the K register
+//	clock [count]         clock count times (1 to 256, default 1)
+//	read                  append the BIR to the results
+//	cmp value [mask]      compare the BIR under mask (default 0xFF)
+//	beq|bne label         branch on the last compare
+//	loop count            run up to the matching next count times (1 to 256)
+//	next
+//	fail code             stop with a failure code
+//	end
+
+import (
+	"bufio"
+	"fmt"
+	"os"
+	"strconv"
+	"strings"
+
+	"github.com/gmofishsauce/yarc/pkg/arduino"
+	sp "github.com/gmofishsauce/yarc/pkg/proto"
+)
+
+const (
+	scriptMaxSize = 128
+
+	scriptEnd   = 0x00
+	scriptAH    = 0x01
+	scriptAL    = 0x02
+	scriptDH    = 0x03
+	scriptDL    = 0x04
+	scriptADHL  = 0x05
+	scriptMCR   = 0x06
+	scriptACR   = 0x07
+	scriptK     = 0x08
+	scriptClock = 0x09
+	scriptRead  = 0x0A
+	scriptCmp   = 0x0B
+	scriptBeq   = 0x0C
+	scriptBne   = 0x0D
+	scriptLoop  = 0x0E
+	scriptNext  = 0x0F
+	scriptFail  = 0x10
+
+	scriptFailed = 1 // status
+)
+
+// Operation codes and argument counts by name. Branches take a label.
+var scriptOps = map[string]struct {
+	code  byte
+	nArgs int
+}{
+	"end":   {scriptEnd, 0},
+	"ah":    {scriptAH, 1},
+	"al":    {scriptAL, 1},
+	"dh":    {scriptDH, 1},
+	"dl":    {scriptDL, 1},
+	"adhl":  {scriptADHL, 4},
+	"mcr":   {scriptMCR, 1},
+	"acr":   {scriptACR, 1},
+	"k":     {scriptK, 4},
+	"clock": {scriptClock, 1},
+	"read":  {scriptRead, 0},
+	"cmp":   {scriptCmp, 2},
+	"beq":   {scriptBeq, 1},
+	"bne":   {scriptBne, 1},
+	"loop":  {scriptLoop, 1},
+	"next":  {scriptNext, 0},
+	"fail":  {scriptFail, 1},
+}
+
+var scriptStatus = []string{
+	"ok",
+	"failed",
+	"invalid operation",
+	"invalid branch",
+	"too many results or nested loops",
+	"too many operations",
+}
+
+type scriptResult struct {
+	status  byte
+	pc      byte
+	code    byte
+	results []byte
+}
+
+// Assemble the text of a script.
+func assembleScript(lines []string) ([]byte, error) {
+	var script []byte
+	labels := make(map[string]int)
+	type fixup struct {
+		at    int // offset of the branch offset byte
+		label string
+		line  int
+	}
+	var fixups []fixup
+
+	for n, line := range lines {
+		if i := strings.Index(line, "#"); i >= 0 {
+			line = line[:i]
+		}
+		words := strings.Fields(line)
+		if len(words) > 0 && strings.HasSuffix(words[0], ":") {
+			label := strings.TrimSuffix(words[0], ":")
+			if _, dup := labels[label]; dup || label == "" {
+				return nil, fmt.Errorf("line %d: invalid label %q", n+1, label)
+			}
+			labels[label] = len(script)
+			words = words[1:]
+		}
+		if len(words) == 0 {
+			continue
+		}
+
+		op, ok := scriptOps[words[0]]
+		if !ok {
+			return nil, fmt.Errorf("line %d: unknown operation %q", n+1, words[0])
+		}
+		args := words[1:]
+		switch op.code {
+		case scriptClock:
+			if len(args) == 0 {
+				args = []string{"1"}
+			}
+		case scriptCmp:
+			if len(args) == 1 {
+				args = append(args, "0xFF")
+			}
+		}
+		if len(args) != op.nArgs {
+			return nil, fmt.Errorf("line %d: %s takes %d arguments", n+1, words[0], op.nArgs)
+		}
+
+		script = append(script, op.code)
+		if op.code == scriptBeq || op.code == scriptBne {
+			fixups = append(fixups, fixup{len(script), args[0], n + 1})
+			script = append(script, 0)
+			continue
+		}
+		for _, a := range args {
+			v, err := strconv.ParseUint(a, 0, 16)
+			if err != nil || v > 0x100 {
+				return nil, fmt.Errorf("line %d: invalid argument %q", n+1, a)
+			}
+			counted := op.code == scriptClock || op.code == scriptLoop
+			if (v == 0x100 && !counted) || (v == 0 && counted) {
+				return nil, fmt.Errorf("line %d: invalid argument %q", n+1, a)
+			}
+			script = append(script, byte(v)) // 256 is sent as 0
+		}
+	}
+
+	for _, f := range fixups {
+		target, ok := labels[f.label]
+		if !ok {
+			return nil, fmt.Errorf("line %d: undefined label %q", f.line, f.label)
+		}
+		offset := target - (f.at + 1)
+		if offset < -128 || offset > 127 {
+			return nil, fmt.Errorf("line %d: branch to %q is too far", f.line, f.label)
+		}
+		script[f.at] = byte(offset)
+	}
+	if len(script) == 0 || len(script) > scriptMaxSize {
+		return nil, fmt.Errorf("script is %d bytes (1 to %d allowed)", len(script), scriptMaxSize)
+	}
+	return script, nil
+}
+
+// Run an assembled script on the Nano.
+func runScript(nano *arduino.Arduino, script []byte) (scriptResult, error) {
+	var r scriptResult
+	if err := doCountedSend(nano, []byte{sp.CmdExt, sp.ExtRunScript, byte(len(script))},
+		script); err != nil {
+		return r, err
+	}
+	b, err := readCounted(nano)
+	if err != nil {
+		return r, err
+	}
+	if len(b) < 3 {
+		return r, fmt.Errorf("run script: unexpected length %d", len(b))
+	}
+	r.status, r.pc, r.code, r.results = b[0], b[1], b[2], b[3:]
+	return r, nil
+}
+
+// Command handler: sx file
+func doScript(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	words := strings.Fields(line)
+	if len(words) != 2 {
+		fmt.Println("usage: sx file")
+		return nostr, nil
+	}
+	f, err := os.Open(words[1])
+	if err != nil {
+		return nostr, err
+	}
+	defer f.Close()
+	var lines []string
+	scanner := bufio.NewScanner(f)
+	for scanner.Scan() {
+		lines = append(lines, scanner.Text())
+	}
+	if err := scanner.Err(); err != nil {
+		return nostr, err
+	}
+	script, err := assembleScript(lines)
+	if err != nil {
+		fmt.Printf("%s: %v\n", words[1], err)
+		return nostr, nil
+	}
+
+	r, err := runScript(nano, script)
+	if err != nil {
+		return nostr, err
+	}
+	status := fmt.Sprintf("status %d", r.status)
+	if int(r.status) < len(scriptStatus) {
+		status = scriptStatus[r.status]
+	}
+	fmt.Printf("%s at offset %d", status, r.pc)
+	if r.status == scriptFailed {
+		fmt.Printf(", code %d", r.code)
+	}
+	fmt.Println()
+	for i, b := range r.results {
+		fmt.Printf(" %02X", b)
+		if i%16 == 15 {
+			fmt.Println()
+		}
+	}
+	if len(r.results)%16 != 0 {
+		fmt.Println()
+	}
+	return nostr, nil
+}
@@ -132,7 +132,9 @@ func session(input *Input, nano *arduino.Arduino) error {
 
 	for {
 		if err := doPoll(nano); err != nil {
-			return err
+			if err = recoverSession(nano, err); err != nil {
+				return err
+			}
 		}
 
 		var line string
@@ -141,12 +143,28 @@ func session(input *Input, nano *arduino.Arduino) error {
 		}
 		if len(line) > 1 { // 1 for the newline
 			if err := process(line[:len(line)-1], nano); err != nil {
-				return err
+				if err = recoverSession(nano, err); err != nil {
+					return err
+				}
 			}
 		}
 	}
 }
 
+// In framed mode, we can recover from a protocol error without ending
+// the session. Return nil if we did, or the error that ends the session.
+func recoverSession(nano *arduino.Arduino, err error) error {
+	if !nano.Framed() {
+		return err
+	}
+	log.Printf("session error: %v: resynchronizing\n", err)
+	if rerr := resynchronize(nano); rerr != nil {
+		log.Printf("resynchronize: %v\n", rerr)
+		return err
+	}
+	return nil
+}
+
 func nanoSyscall(req string) error {
 	return fmt.Errorf("unexpected syscall from Nano: %s", req)
 }
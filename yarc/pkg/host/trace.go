@@ -0,0 +1,115 @@
+// Copyright (c) Jeff Berkowitz 2021, 2023. All rights reserved.
+
+package host
+
+// Bus trace.
+//
+// Since protocol v23, the Nano can record the bus input register (BIR)
+// and the MCR after each clock it delivers, other than the hardware
+// fast clock. The trace is a FIFO on the Nano; we turn it on, clock
+// (with cc, cb, ru, or dc), and drain it in chunks of up to 64 entries.
+// While the trace is full the Nano holds the clock, so bursts and run
+// until lose nothing. Entries the Nano spilled to scratch memory can
+// be read only while the YARC is stopped.
+
+import (
+	"fmt"
+	"strings"
+
+	"github.com/gmofishsauce/yarc/pkg/arduino"
+	sp "github.com/gmofishsauce/yarc/pkg/proto"
+)
+
+const (
+	traceOff       = 0
+	traceOn        = 1
+	traceUnchanged = 0xFF
+
+	traceReadMax = 64
+)
+
+type traceEntry struct {
+	bir byte
+	mcr byte
+}
+
+// Turn the trace on (clearing it) or off, or leave it unchanged, and
+// return the number of entries pending and lost.
+func traceControl(nano *arduino.Arduino, ctl byte) (int, int, error) {
+	b, err := doCountedReceive(nano, []byte{sp.CmdExt, sp.ExtTraceCtl, ctl})
+	if err != nil {
+		return 0, 0, err
+	}
+	if len(b) != 4 {
+		return 0, 0, fmt.Errorf("trace control: unexpected length %d", len(b))
+	}
+	return int(b[0])<<8 | int(b[1]), int(b[2])<<8 | int(b[3]), nil
+}
+
+// Read and remove up to n of the oldest trace entries.
+func traceRead(nano *arduino.Arduino, n int) ([]traceEntry, error) {
+	b, err := doCountedReceive(nano, []byte{sp.CmdExt, sp.ExtTraceRead, byte(n)})
+	if err != nil {
+		return nil, err
+	}
+	if len(b)%2 != 0 || len(b) > 2*n {
+		return nil, fmt.Errorf("trace read: unexpected length %d", len(b))
+	}
+	entries := make([]traceEntry, len(b)/2)
+	for i := range entries {
+		entries[i] = traceEntry{b[2*i], b[2*i+1]}
+	}
+	return entries, nil
+}
+
+// Command handler: tr [on|off]. With no argument, read and print
+// the pending trace entries.
+func doTrace(cmd *protocolCommand, nano *arduino.Arduino, line string) (string, error) {
+	words := strings.Fields(line)
+	if len(words) > 2 {
+		fmt.Println("usage: tr [on|off]")
+		return nostr, nil
+	}
+	if len(words) == 2 {
+		var ctl byte
+		switch words[1] {
+		case "on":
+			ctl = traceOn
+		case "off":
+			ctl = traceOff
+		default:
+			fmt.Println("usage: tr [on|off]")
+			return nostr, nil
+		}
+		pending, lost, err := traceControl(nano, ctl)
+		if err != nil {
+			return nostr, err
+		}
+		fmt.Printf("trace %s: %d pending, %d lost\n", words[1], pending, lost)
+		return nostr, nil
+	}
+
+	pending, lost, err := traceControl(nano, traceUnchanged)
+	if err != nil {
+		return nostr, err
+	}
+	for cycle := 0; pending > 0; {
+		entries, err := traceRead(nano, traceReadMax)
+		if err != nil {
+			return nostr, err
+		}
+		if len(entries) == 0 {
+			fmt.Printf("%d entries are in scratch memory; stop the YARC to read them\n", pending)
+			break
+		}
+		for _, e := range entries {
+			fmt.Printf("%6d: BIR 0x%02X MCR 0x%02X\n", cycle, e.bir, e.mcr)
+			cycle++
+		}
+		pending -= len(entries)
+	}
+	if lost != 0 {
+		fmt.Printf("%d entries lost\n", lost)
+	}
+	return nostr, nil
+}
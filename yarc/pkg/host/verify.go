@@ -0,0 +1,163 @@
+// Copyright (c) Jeff Berkowitz 2021, 2023. All rights reserved.
+
+package host
+
+// Download verification.
+//
+// Since protocol v19, the host chooses how the Nano verifies downloaded
+// data for the session: it can read back every write command's data
+// (full), every eighth (sampled), or none. With the deferred digest
+// policy, the Nano writes at full speed and we verify each section
+// afterward by comparing digests of the chunks we wrote with digests
+// computed from the file, one digest command per run of up to 64 chunks.
+// Either way, the Nano reports verification failures instead of
+// panicking, and we collect them after each section.
+
+import (
+	"fmt"
+
+	"github.com/gmofishsauce/yarc/pkg/arduino"
+	sp "github.com/gmofishsauce/yarc/pkg/proto"
+)
+
+// Verification policies, as numbered in the protocol.
+const (
+	verifyFull      = 0
+	verifySampled   = 1
+	verifyDigest    = 2
+	verifyNone      = 3
+	verifyUnchanged = 0xFF
+)
+
+var verifyPolicies = map[string]byte{
+	"full":    verifyFull,
+	"sampled": verifySampled,
+	"digest":  verifyDigest,
+	"none":    verifyNone,
+}
+
+// The verification policy for downloads. It can be changed with the
+// "vp" command.
+var verifyPolicy byte = verifyDigest
+
+// The most chunks the Nano digests in one command. Reading the three ALU
+// RAMs is slow, so we ask for fewer ALU chunks to stay well within the
+// response timeout.
+func maxDigestChunks(store byte) int {
+	if store == storeAlu {
+		return 32
+	}
+	return 64
+}
+
+// The verification failures reported by the Nano.
+type verifyResult struct {
+	failures byte   // saturates at 255
+	store    byte   // of the first failure
+	addr     uint16 // of the first failure
+}
+
+// Set the Nano's verification policy (or leave it unchanged, given
+// verifyUnchanged) and collect and clear its verification failures.
+func setVerify(nano *arduino.Arduino, policy byte) (verifyResult, error) {
+	var result verifyResult
+	b, err := doCountedReceive(nano, []byte{sp.CmdExt, sp.ExtVerify, policy})
+	if err != nil {
+		return result, err
+	}
+	if len(b) != 4 {
+		return result, fmt.Errorf("verify: unexpected length %d", len(b))
+	}
+	result.failures = b[0]
+	result.store = b[1]
+	result.addr = uint16(b[2])<<8 | uint16(b[3])
+	return result, nil
+}
+
+// Return the Nano's digest of n chunks of the store starting at first.
+func getDigest(nano *arduino.Arduino, store byte, first int, n int) (uint16, error) {
+	b, err := doCountedReceive(nano, []byte{sp.CmdExt, sp.ExtDigest, store,
+		byte(first >> 8), byte(first), byte(n >> 8), byte(n)})
+	if err != nil {
+		return 0, err
+	}
+	if len(b) != 2 {
+		return 0, fmt.Errorf("digest: unexpected length %d", len(b))
+	}
+	return uint16(b[0])<<8 | uint16(b[1]), nil
+}
+
+// The Nano's scratch memory; the Nano doesn't digest it.
+const scratchMem = 0x7700
+
+// Return true if the chunk is one the Nano uses for scratch and doesn't
+// digest: a slice of a scratch opcode (0xF0 to 0xFB) or scratch memory.
+func scratchChunk(store byte, chunk int) bool {
+	switch store {
+	case storeWcs:
+		return chunk/4 >= 0x70 && chunk/4 <= 0x7B
+	case storeMem:
+		return chunk*chunkSize >= scratchMem
+	}
+	return false
+}
+
+// Return crc updated with the chunk of the section as the Nano digests it
+// (see DigestChunk() in yarc_utils.h). WCS chunks are slices of opcodes,
+// and scratch chunks aren't digested. Each byte of ALU RAM is digested
+// three times, once for each of the three RAMs.
+func chunkDigest(store byte, section []byte, chunk int, crc uint16) uint16 {
+	if scratchChunk(store, chunk) {
+		return crc
+	}
+	switch store {
+	case storeWcs:
+		op, slice := chunk/4, chunk%4
+		for slot := 0; slot < 64; slot++ {
+			crc = arduino.Crc16Update(crc, section[op*256+4*slot+slice:][:1])
+		}
+	case storeMem:
+		crc = arduino.Crc16Update(crc, section[chunk*chunkSize:(chunk+1)*chunkSize])
+	case storeAlu:
+		for _, b := range section[chunk*chunkSize : (chunk+1)*chunkSize] {
+			crc = arduino.Crc16Update(crc, []byte{b, b, b})
+		}
+	}
+	return crc
+}
+
+// Verify the chunks of the section that were written as the policy
+// directs, then collect the failures the Nano found while writing.
+func verifySection(nano *arduino.Arduino, name string, store byte, section []byte, written []int) error {
+	if verifyPolicy == verifyDigest {
+		for i := 0; i < len(written); {
+			j := i + 1
+			for j < len(written) && written[j] == written[j-1]+1 && j-i < maxDigestChunks(store) {
+				j++
+			}
+			var expected uint16
+			for _, chunk := range written[i:j] {
+				expected = chunkDigest(store, section, chunk, expected)
+			}
+			digest, err := getDigest(nano, store, written[i], j-i)
+			if err != nil {
+				return err
+			}
+			if digest != expected {
+				return fmt.Errorf("%s verify failed: digest of chunks %d..%d is 0x%04X, expected 0x%04X",
+					name, written[i], written[j-1], digest, expected)
+			}
+			i = j
+		}
+	}
+
+	result, err := setVerify(nano, verifyUnchanged)
+	if err != nil {
+		return err
+	}
+	if result.failures != 0 {
+		return fmt.Errorf("%s verify failed: %d failures, the first in store %d at 0x%04X",
+			name, result.failures, result.store, result.addr)
+	}
+	return nil
+}
@@ -3,7 +3,7 @@
 
 package serial_protocol
 
-const ProtocolVersion = 11
+const ProtocolVersion = 32
 
 func Ack(b byte) byte {
 	return ^b
@@ -21,6 +21,7 @@ const CmdStopYarc          = 0xE8
 const CmdPoll              = 0xE9
 const CmdSvcResponse       = 0xEA
 const CmdDebug             = 0xEB
+const CmdExt               = 0xEC
 const CmdGetVer            = 0xEE
 const CmdSync              = 0xEF
 const CmdSetArh            = 0xF0
@@ -36,6 +37,31 @@ const CmdSetMcr            = 0xFC
 const CmdWrAlu             = 0xFD
 const CmdRdAlu             = 0xFE
 
+const ExtCostResults       = 0x01
+const ExtWrOpcode          = 0x02
+const ExtFill              = 0x03
+const ExtInitStatus        = 0x04
+const ExtSaveImage         = 0x05
+const ExtGetImage          = 0x06
+const ExtGenAlu            = 0x07
+const ExtRdAlu3            = 0x08
+const ExtVerify            = 0x09
+const ExtDigest            = 0x0A
+const ExtChunkDigests      = 0x0B
+const ExtClockBurst        = 0x0C
+const ExtBurstStatus       = 0x0D
+const ExtRunUntil          = 0x0E
+const ExtRunResult         = 0x0F
+const ExtTraceCtl          = 0x10
+const ExtTraceRead         = 0x11
+const ExtCounters          = 0x12
+const ExtRdScatter         = 0x13
+const ExtMemSearch         = 0x14
+const ExtMemCompare        = 0x15
+const ExtFramed            = 0x16
+const ExtWrMemBytes        = 0x17
+const ExtRunScript         = 0x18
+
 const ErrNosync            = 0x80
 const ErrPassive           = 0x81
 const ErrOneclock          = 0x82
@@ -25,8 +25,54 @@ import (
 //					   word transfers on even address boundaries. The count
 //					   is still in bytes.
 // Protocol version 11 Add the debug command (0xEB)
-
-const protocolVersion = 11
+// Protocol version 12 Add the extended command (0xEC), which is followed
+//					   by a subcommand byte; the one-byte command space is
+//					   nearly exhausted. First subcommand: COST results.
+// Protocol version 13 Add the write opcode subcommand (0xEC 0x02), which
+//					   writes all four slices of an opcode in one command.
+// Protocol version 14 Add the fill subcommand (0xEC 0x03), which fills all
+//					   of the WCS, main memory, or ALU RAM with a constant.
+// Protocol version 15 Add the init status subcommand (0xEC 0x04). The Nano
+//					   initializes in the background after reset and defers
+//					   commands that use the YARC until it's done.
+// Protocol version 16 Add the save image (0xEC 0x05) and get image (0xEC 0x06)
+//					   subcommands, which record the digests of the loaded
+//					   image so the host can skip downloads after a warm reset.
+// Protocol version 17 Add the generate ALU subcommand (0xEC 0x07), which
+//					   computes the standard ALU tables on the Nano.
+// Protocol version 18 Add the read ALU3 subcommand (0xEC 0x08), which reads
+//					   all three ALU RAMs in one pass.
+// Protocol version 19 Add the verify (0xEC 0x09) and digest (0xEC 0x0A)
+//					   subcommands. The host chooses how downloads are
+//					   verified; failures are reported, not panics.
+// Protocol version 20 Add the chunk digests subcommand (0xEC 0x0B), which
+//					   allows the host to download only changed chunks.
+// Protocol version 21 Add the clock burst (0xEC 0x0C) and burst status
+//					   (0xEC 0x0D) subcommands.
+// Protocol version 22 Add the run until (0xEC 0x0E) and run result
+//					   (0xEC 0x0F) subcommands.
+// Protocol version 23 Add the trace control (0xEC 0x10) and trace read
+//					   (0xEC 0x11) subcommands.
+// Protocol version 24 Add the execution counters subcommand (0xEC 0x12).
+// Protocol version 25 Add the scatter-gather memory read subcommand
+//					   (0xEC 0x13).
+// Protocol version 26 Add the memory search (0xEC 0x14) and memory compare
+//					   (0xEC 0x15) subcommands.
+// Protocol version 27 Add the framed mode subcommand (0xEC 0x16), which
+//					   carries the protocol in CRC-checked frames with
+//					   retransmission and in-band resynchronization.
+// Protocol version 28 Add the write memory bytes subcommand (0xEC 0x17),
+//					   which writes unaligned byte ranges.
+// Protocol version 29 Add the run script subcommand (0xEC 0x18), which runs
+//					   a script of bus operations uploaded by the host.
+// Protocol version 30 Write opcode (0xEC 0x02) takes a first slot argument
+//					   and writes at most 16 words unless framed.
+// Protocol version 31 Remove the service latency fields from the execution
+//					   counters (0xEC 0x12), which nothing could set.
+// Protocol version 32 Scratch memory (0x7700 - 0x77FF) is no longer part
+//					   of the memory digests (0xEC 0x0A, 0xEC 0x0B).
+
+const protocolVersion = 32
 
 var names = []struct {
 	name string
@@ -44,6 +90,7 @@ var names = []struct {
 	{"STCMD_POLL", 0xE9},
 	{"STCMD_SVC_RESPONSE", 0xEA},
 	{"STCMD_DEBUG", 0xEB},
+	{"STCMD_EXT", 0xEC},
 	{"STCMD_GET_VER", 0xEE},
 	{"STCMD_SYNC", 0xEF},
 	{"STCMD_SET_ARH", 0xF0},
@@ -60,6 +107,38 @@ var names = []struct {
 	{"STCMD_RD_ALU", 0xFE},
 }
 
+// Subcommands of STCMD_EXT. The subcommand byte immediately follows the
+// command byte. Subcommand 0 is reserved and always nak'd.
+var extensions = []struct {
+	name string
+	val  int
+}{
+	{"STEXT_COST_RESULTS", 0x01},
+	{"STEXT_WR_OPCODE", 0x02},
+	{"STEXT_FILL", 0x03},
+	{"STEXT_INIT_STATUS", 0x04},
+	{"STEXT_SAVE_IMAGE", 0x05},
+	{"STEXT_GET_IMAGE", 0x06},
+	{"STEXT_GEN_ALU", 0x07},
+	{"STEXT_RD_ALU3", 0x08},
+	{"STEXT_VERIFY", 0x09},
+	{"STEXT_DIGEST", 0x0A},
+	{"STEXT_CHUNK_DIGESTS", 0x0B},
+	{"STEXT_CLOCK_BURST", 0x0C},
+	{"STEXT_BURST_STATUS", 0x0D},
+	{"STEXT_RUN_UNTIL", 0x0E},
+	{"STEXT_RUN_RESULT", 0x0F},
+	{"STEXT_TRACE_CTL", 0x10},
+	{"STEXT_TRACE_READ", 0x11},
+	{"STEXT_COUNTERS", 0x12},
+	{"STEXT_RD_SCATTER", 0x13},
+	{"STEXT_MEM_SEARCH", 0x14},
+	{"STEXT_MEM_COMPARE", 0x15},
+	{"STEXT_FRAMED", 0x16},
+	{"STEXT_WR_MEM_BYTES", 0x17},
+	{"STEXT_RUN_SCRIPT", 0x18},
+}
+
 var errors = []struct {
 	name string
 	val  int
@@ -92,6 +171,11 @@ func generateCSymbols(filename string) {
 	}
 	fmt.Fprintf(f, "\n")
 
+	for _, xs := range extensions {
+		fmt.Fprintf(f, "#define %-20s 0x%02X\n", xs.name, xs.val)
+	}
+	fmt.Fprintf(f, "\n")
+
 	for _, es := range errors {
 		fmt.Fprintf(f, "#define %-20s 0x%02X\n", es.name, es.val)
 	}
@@ -115,6 +199,11 @@ func generateGoSymbols(filename string) {
 	}
 	fmt.Fprintf(f, "\n")
 
+	for _, xs := range extensions {
+		fmt.Fprintf(f, "const %-20s = 0x%02X\n", mkGoSym(xs.name), xs.val)
+	}
+	fmt.Fprintf(f, "\n")
+
 	for _, es := range errors {
 		fmt.Fprintf(f, "const %-20s = 0x%02X\n", mkGoSym(es.name), es.val)
 	}